@@ -6,12 +6,14 @@
  */
 
 #include <cstring>
+#include <algorithm>
 #include "inc/client.h"
 #include "inc/message.h"
 #include "inc/common.h"
 #include "inc/sodium_ae.h"
 #include <sodium.h>
 #include "inc/parser.h"
+#include "inc/probes.h"
 #include "spdlog/spdlog.h"
 
 //#define DEBUG
@@ -25,8 +27,13 @@ WgacClient::WgacClient() {
 
 WgacClient::~WgacClient() {
 	close();
+	closeAttempts();
+	closeReactor();
 }
 
+/**
+ * Start a non-blocking connect. The event loop sees the result as EPOLLOUT.
+ */
 pipe_ret_t WgacClient::connectTo(const std::string& address, unsigned short port) {
 	try {
 		initializeSocket();
@@ -36,25 +43,25 @@ pipe_ret_t WgacClient::connectTo(const std::string& address, unsigned short port
 	}
 
 	const int connectResult = connect(_sockfd.get(), (struct sockaddr*)&_server, sizeof(_server));
-	const bool connectionFailed = (connectResult == -1);
+	const bool connectionFailed = (connectResult == -1 && errno != EINPROGRESS);
 	if (connectionFailed) {
-		return pipe_ret_t::failure(strerror(errno));
+		pipe_ret_t ret = pipe_ret_t::failure(strerror(errno));
+		::close(_sockfd.get());
+		_sockfd.set(-1);
+		return ret;
 	}
 
-	_isConnected = true;
 	_isClosed = false;
+	_rbuf.clear();
+	_wbuf.clear();
 
 	return pipe_ret_t::success();
 }
 
-void WgacClient::startReceivingMessages() {
-	_receiveTask = new std::thread(&WgacClient::receiveTask, this);
-}
-
 void WgacClient::initializeSocket() {
 	pipe_ret_t ret;
 
-	_sockfd.set(socket(AF_INET, SOCK_STREAM, 0));
+	_sockfd.set(socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
 	const bool socketFailed = (_sockfd.get() == -1);
 	if (socketFailed) {
 		spdlog::error("socket failed");
@@ -110,6 +117,8 @@ std::string convert_message2string(unsigned char* msg, size_t size) {
 		total_s = "cmd:=NOK\n";
 	else if (smsg->type == AUTOCONN::BYE)
 		total_s = "cmd:=BYE\n";
+	else if (smsg->type == AUTOCONN::JOIN)
+		total_s = "cmd:=JOIN\n";
 	else
 		total_s = "cmd:=NOK\n";
 
@@ -157,64 +166,54 @@ pipe_ret_t WgacClient::sendMsg(unsigned char* msg, size_t size) {
 	std::vector<unsigned char> encrypted_message = sodium_ae::encrypt_message(original_message,
 			getPreparePublicKey(), getPrepareSecretKey());
 
-	const size_t sent_bytes = send(_sockfd.get(), encrypted_message.data(), encrypted_message.size(), 0);
-
-	if (sent_bytes < 0) { // send failed
+	_wbuf.insert(_wbuf.end(), encrypted_message.begin(), encrypted_message.end());
+	if (!flushWrite()) {
 		return pipe_ret_t::failure(strerror(errno));
 	}
-	if (sent_bytes < encrypted_message.size()) { // not all bytes were sent
-		char errorMsg[100];
-		sprintf(errorMsg, "Only %lu bytes out of %lu was sent to client", sent_bytes, encrypted_message.size());
-		return pipe_ret_t::failure(errorMsg);
-	}
 	return pipe_ret_t::success();
 }
 
-/*
- * Thread routine: Receive a message from server
+/**
+ * Cut one message out of the receive buffer.
+ * Frame: payload length(4 bytes) | NONCE(24 bytes) | ciphertext + MAC(16 bytes)
+ * Returns false if no complete frame is buffered yet.
  */
-void WgacClient::receiveTask() {
-	while(_isConnected) {
-		const fd_wait::Result waitResult = fd_wait::waitFor(_sockfd);
-
-		if (waitResult == fd_wait::Result::FAILURE) {
-			spdlog::info("fd_wait::Result::FAILURE !!!");
-			_isConnected = false;
-			return;
-		} else if (waitResult == fd_wait::Result::TIMEOUT) {
-			continue;
-		}
-
-		unsigned char recv_buf[1024] {};
-		const size_t received_bytes = recv(_sockfd.get(), recv_buf, sizeof(recv_buf), 0);
-		if (received_bytes < 1) {
-			std::string errorMsg;
-			if (received_bytes == 0) { //server closed connection
-				errorMsg = "Server closed connection";
-			} else {
-				errorMsg = strerror(errno);
+bool WgacClient::nextMessage(message_t& rmsg, bool& bad_frame) {
+	bad_frame = false;
+	while (!_rbuf.empty()) {
+		std::vector<unsigned char> encrypted_message;
+		if (!sodium_ae::next_frame(_rbuf, encrypted_message, bad_frame)) {
+			if (bad_frame) {
+				spdlog::warn("Invalid frame length from server.");
 			}
-			_isConnected = false;
-			return;
+			return false;
 		}
+		const uint32_t payload_len = encrypted_message.size() - sizeof(uint32_t);
 
-		std::vector<unsigned char> encrypted_message(recv_buf, recv_buf + received_bytes);
+		/* a frame that fails to decrypt or parse is dropped, the stream stays in sync */
 		bool decrypt_failure = false;
 		std::vector<unsigned char> decrypted_message = sodium_ae::decrypt_message(
 				encrypted_message, getPreparePublicKey(), getPrepareSecretKey(), decrypt_failure);
-		if (!decrypt_failure) {
-			char xbuf[1024] {};
-			message_t rmsg {};
-			memcpy(xbuf, reinterpret_cast<char*>(decrypted_message.data()),
-					decrypted_message.size() * sizeof(unsigned char));
-			if (!parser::parse_new_message_string(xbuf, &rmsg)) {
-				spdlog::error("Failed to parse message string");
-				return;
-			}
-			/* Let's put this message to <message queue>. */
-			_msgQueue.push(rmsg);
+		if (decrypt_failure) {
+			WGAC_PROBE1(decrypt_fail, payload_len);
+			continue;
 		}
+		WGAC_PROBE1(decrypt_ok, payload_len);
+
+		std::string xbuf(decrypted_message.begin(), decrypted_message.end());
+		std::memset(&rmsg, 0, sizeof(rmsg));
+		uint32_t retry_after = 0;
+		if (!parser::parse_new_message_string(xbuf.data(), &rmsg, &retry_after)) {
+			spdlog::error("Failed to parse message string");
+			continue;
+		}
+		if (rmsg.type == AUTOCONN::NOK && retry_after > 0) {
+			spdlog::info("<<< NOK: retry after {} s.", retry_after);
+			_retryAfterMs = retry_after * 1000;
+		}
+		return true;
 	}
+	return false;
 }
 #else //======================================================================================
 //No authenticated encryption routines
@@ -224,62 +223,89 @@ void WgacClient::receiveTask() {
 pipe_ret_t WgacClient::sendMsg(unsigned char* msg, size_t size) {
 	std::string total_s = convert_message2string(msg, size);
 
-	const char* buf_ptr = total_s.c_str();
-	try {
-		const size_t sent_bytes = ::send(_sockfd.get(), buf_ptr, total_s.length(), 0);
-	} catch (const std::runtime_error &error) {
+	_wbuf.insert(_wbuf.end(), total_s.begin(), total_s.end());
+	if (!flushWrite()) {
 		return pipe_ret_t::failure(">>> Oops message sending is failed.");
 	}
 	return pipe_ret_t::success();
 }
 
 /**
- * Thread routine: Receive a message from server
+ * Cut one message out of the receive buffer: the text ends with the allowedips line.
+ * Returns false if no complete message is buffered yet.
  */
-void WgacClient::receiveTask() {
-	while(_isConnected) {
-		const fd_wait::Result waitResult = fd_wait::waitFor(_sockfd);
-
-		if (waitResult == fd_wait::Result::FAILURE) {
-			spdlog::info("fd_wait::Result::FAILURE !!!");
-			_isConnected = false;
-			return;
-		} else if (waitResult == fd_wait::Result::TIMEOUT) {
-			continue;
+bool WgacClient::nextMessage(message_t& rmsg, bool& bad_frame) {
+	static const std::string last_field {"allowedips:="};
+
+	bad_frame = false;
+	while (!_rbuf.empty()) {
+		auto field = std::search(_rbuf.begin(), _rbuf.end(), last_field.begin(), last_field.end());
+		auto eol = std::find(field, _rbuf.end(), '\n');
+		if (eol == _rbuf.end()) {
+			if (_rbuf.size() > MAX_PACKET_SIZE) {
+				spdlog::warn("Message from server is too long.");
+				bad_frame = true;
+			}
+			return false;
 		}
 
-		message_t rmsg {};
-		char recv_buf[1024] {};
-		const size_t received_bytes = recv(_sockfd.get(), recv_buf, sizeof(recv_buf), 0);
-		if (!parser::parse_new_message_string(recv_buf, &rmsg)) {
+		std::string xbuf(_rbuf.begin(), eol + 1);
+		_rbuf.erase(_rbuf.begin(), eol + 1);
+
+		std::memset(&rmsg, 0, sizeof(rmsg));
+		uint32_t retry_after = 0;
+		if (!parser::parse_new_message_string(xbuf.data(), &rmsg, &retry_after)) {
 			spdlog::error("Failed to parse message string");
-			return;
+			continue;
 		}
-
-		if (received_bytes < 1) {
-			std::string errorMsg;
-			if (received_bytes == 0) { //server closed connection
-				errorMsg = "Server closed connection";
-			} else {
-				errorMsg = strerror(errno);
-			}
-			_isConnected = false;
-			return;
-		} else {
-			/* Let's put this message to <message queue>. */
-			_msgQueue.push(rmsg);
+		if (rmsg.type == AUTOCONN::NOK && retry_after > 0) {
+			spdlog::info("<<< NOK: retry after {} s.", retry_after);
+			_retryAfterMs = retry_after * 1000;
 		}
+		return true;
 	}
+	return false;
 }
 #endif //======================================================================================
 
-void WgacClient::terminateReceiveThread() {
-	_isConnected = false;
+/**
+ * Write as much of the pending bytes as the socket accepts.
+ * The event loop waits for EPOLLOUT while something is left.
+ */
+bool WgacClient::flushWrite() {
+	while (!_wbuf.empty()) {
+		ssize_t sent = ::send(_sockfd.get(), _wbuf.data(), _wbuf.size(), MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+			return false;
+		}
+		_wbuf.erase(_wbuf.begin(), _wbuf.begin() + sent);
+	}
+	updateSocketEvents();
+	return true;
+}
 
-	if (_receiveTask) {
-		_receiveTask->join();
-		delete _receiveTask;
-		_receiveTask = nullptr;
+/**
+ * Append everything readable to the receive buffer.
+ * Returns false when the server closed the connection or on error.
+ */
+bool WgacClient::readSocket() {
+	uint8_t recv_buf[1024];
+	while (true) {
+		ssize_t received_bytes = ::recv(_sockfd.get(), recv_buf, sizeof(recv_buf), 0);
+		if (received_bytes > 0) {
+			_rbuf.insert(_rbuf.end(), recv_buf, recv_buf + received_bytes);
+			continue;
+		}
+		if (received_bytes == 0) {
+			spdlog::info("<<< Server closed connection.");
+			return false;
+		}
+		if (errno == EINTR) continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+		spdlog::info("<<< recv failed: {}", strerror(errno));
+		return false;
 	}
 }
 
@@ -287,20 +313,15 @@ pipe_ret_t WgacClient::close() {
 	if (_isClosed) {
 		return pipe_ret_t::failure("client is already closed");
 	}
-	terminateReceiveThread();
+	_isConnected = false;
+	_rbuf.clear();
+	_wbuf.clear();
 
 	const bool closeFailed = (::close(_sockfd.get()) == -1);
+	_sockfd.set(-1);
 	if (closeFailed) {
 		return pipe_ret_t::failure(strerror(errno));
 	}
 	_isClosed = true;
 	return pipe_ret_t::success();
 }
-
-void WgacClient::setRestart(bool flag) {
-	_flagTerminate = flag;
-}
-
-bool WgacClient::shouldRestart() {
-	return _flagTerminate;
-}
@@ -17,6 +17,11 @@
 #include "inc/common.h"
 
 #include <sys/select.h>
+#include <sys/wait.h>
+#include <spawn.h>
+#include <signal.h>
+
+extern char** environ;
 
 #define SELECT_FAILED -1
 #define SELECT_TIMEOUT 0
@@ -90,4 +95,52 @@ bool exec(const std::string& cmd, std::vector<std::string>& output_list, std::st
 	return true;
 }
 
+/**
+ * Run a program with argv(no shell involved) and wait for it
+ * Return true if it exited with 0
+ */
+bool spawn(const std::vector<std::string>& argv, std::string& error_text) {
+	if (argv.empty()) {
+		error_text = "empty argv";
+		return false;
+	}
+
+	std::vector<char*> args;
+	args.reserve(argv.size() + 1);
+	for (const auto& arg : argv) {
+		args.push_back(const_cast<char*>(arg.c_str()));
+	}
+	args.push_back(nullptr);
+
+	/* the event loop blocks its signals, the child must not inherit that */
+	posix_spawnattr_t attr;
+	sigset_t empty_mask;
+	sigemptyset(&empty_mask);
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigmask(&attr, &empty_mask);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+	pid_t pid;
+	int ret = posix_spawn(&pid, args[0], nullptr, &attr, args.data(), environ);
+	posix_spawnattr_destroy(&attr);
+	if (ret != 0) {
+		error_text = "posix_spawn(" + argv[0] + ") failed: " + strerror(ret);
+		return false;
+	}
+
+	int status = 0;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			error_text = "waitpid failed: " + std::string(strerror(errno));
+			return false;
+		}
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		error_text = argv[0] + " exited abnormally(status " + std::to_string(status) + ")";
+		return false;
+	}
+	return true;
+}
+
 }
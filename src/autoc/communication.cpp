@@ -12,9 +12,8 @@
 #include <map>
 #include <thread>
 #include <chrono>
-#include <net/if.h>
-#include <sys/ioctl.h>
 #include <time.h>
+#include <fstream>
 #include <sodium.h>
 #include "inc/message.h"
 #include "inc/client.h"
@@ -22,126 +21,82 @@
 #include "inc/pipe_ret_t.h"
 #include "inc/common.h"
 #include "inc/cidr.h"
+#include "inc/probes.h"
 #include "spdlog/spdlog.h"
 
 /**
- * Get local mac address
+ * Initialize a message with the given fields and the cached mac address
  */
-void get_local_mac_address(char* macaddr) {
-	struct ifreq s;
-	int fd, i;
-	fd = socket(PF_INET, SOCK_DGRAM, IPPROTO_IP);
-	if (fd >= 0) {
-#ifdef VTYSH
-		sprintf((char*)s.ifr_name, "%s", "eth0");
-#else
-		sprintf((char*)s.ifr_name, "%s", "enp4s0");
-#endif
-		if (0 == ioctl(fd, SIOCGIFHWADDR, &s)) {
-			for (i = 0; i < 6; i++)
-				macaddr[i] = (unsigned char) s.ifr_addr.sa_data[i];
-		}
-		close(fd);
-	}
+static inline void init_smsg(message_t* smsg, enum AUTOCONN type, uint32_t ip, uint32_t mask, const netif_t& netif) {
+	std::memset(smsg, 0, sizeof(message_t));
+	smsg->type = type;
+	std::memcpy(smsg->mac_addr, netif.mac_addr, sizeof(smsg->mac_addr));
+	smsg->vpnIP.s_addr = ip;
+	smsg->vpnNetmask.s_addr = mask;
 }
 
-bool send_all(int sock, const uint8_t* data, size_t len) {
-	size_t sent = 0;
-	while (sent < len) {
-		ssize_t res = ::send(sock, data + sent, len - sent, 0);
-		if (res <= 0) return false;
-		sent += res;
+/**
+ * Send a JOIN message(HELLO + PING in one request).
+ * The HELLO + PONG(or NOK/BYE) reply is handled by handle_message().
+ */
+bool WgacClient::send_join_message() {
+	message_t smsg;
+
+	init_smsg(&smsg, AUTOCONN::JOIN, 0, 0, _netif);
+
+	std::memcpy(smsg.public_key, _config.getstr("this_public_key").c_str(), WG_KEY_LEN_BASE64);
+
+	if (_netif.epIP.s_addr == 0) {
+		spdlog::warn("Endpoint address is unknown(set this_endpoint_ip).");
+		return false;
 	}
-	return true;
-}
+	smsg.epIP = _netif.epIP;
+	smsg.epPort = _netif.epPort;
+	std::memcpy(smsg.allowed_ips, _config.getstr("this_allowed_ips").c_str(), 256);
 
-bool recv_all(int sock, uint8_t* data, size_t len) {
-	size_t received = 0;
-	while (received < len) {
-		ssize_t res = ::recv(sock, data + received, len - received, 0);
-		if (res <= 0) return false;
-		received += res;
+	pipe_ret_t sendRet = sendMsg(reinterpret_cast<unsigned char*>(&smsg), sizeof(message_t));
+	if (!sendRet.isSuccessful()) {
+		spdlog::debug(">>> Failed to send message.");
+		return false;
 	}
+	spdlog::info(">>> JOIN message sent to server.");
 	return true;
 }
 
 /**
- * Initialize a message with the given fields
+ * Send a HELLO message. The HELLO/NOK reply is handled by handle_message().
  */
-static inline void init_smsg(message_t* smsg, enum AUTOCONN type, uint32_t ip, uint32_t mask) {
-	std::memset(smsg, 0, sizeof(message_t));
-	smsg->type = type;
-	get_local_mac_address(reinterpret_cast<char*>(smsg->mac_addr));
-	smsg->vpnIP.s_addr = ip;
-	smsg->vpnNetmask.s_addr = mask;
-}
-
-/**
- * Send a HELLO message and receive an HELLO/NOK message
- */
-bool WgacClient::send_hello_message(enum AUTOCONN& flag) {
+bool WgacClient::send_hello_message() {
 	message_t smsg;
 
-	init_smsg(&smsg, AUTOCONN::HELLO, 0, 0);
+	init_smsg(&smsg, AUTOCONN::HELLO, 0, 0, _netif);
 
 	std::memcpy(smsg.public_key, _config.getstr("this_public_key").c_str(), WG_KEY_LEN_BASE64);
 
-	if (inet_pton(AF_INET, _config.getstr("this_endpoint_ip").c_str(), &(smsg.epIP)) != 1) {
-		spdlog::warn("inet_pton(this_endpoint_ip) failed.");
+	if (_netif.epIP.s_addr == 0) {
+		spdlog::warn("Endpoint address is unknown(set this_endpoint_ip).");
 		return false;
 	}
-	smsg.epPort = _config.getint("this_endpoint_port");
+	smsg.epIP = _netif.epIP;
+	smsg.epPort = _netif.epPort;
 	std::memcpy(smsg.allowed_ips, _config.getstr("this_allowed_ips").c_str(), 256);
 
 	pipe_ret_t sendRet = sendMsg(reinterpret_cast<unsigned char*>(&smsg), sizeof(message_t));
 	if (!sendRet.isSuccessful()) {
 		spdlog::debug(">>> Failed to send message.");
 		return false;
-	} else {
-		spdlog::info(">>> HELLO message sent to server.");
-	}
-
-	std::this_thread::sleep_for(std::chrono::milliseconds(500));
-
-	//Get the vpn ip allocated from server
-	message_t rmsg;
-	if (handle_message_queue(&rmsg)) {
-		if (rmsg.type == AUTOCONN::HELLO) {
-			spdlog::info("<<< HELLO message received.");
-			/* save the vpnIP and vpnNetmask come from server */
-			char s[16];
-			snprintf(s, sizeof(s), "%s", inet_ntoa(rmsg.vpnIP));
-			std::string value1(s);
-			_config.setstr("this_vpn_ip", value1);
-
-			sprintf(s, "%s", inet_ntoa(rmsg.vpnNetmask));
-			std::string value2(s);
-			_config.setstr("this_vpn_netmask", value2);
-
-			spdlog::info("--- vpnIP({}/{}) received from server.", value1, value2);
-			return true;
-		} else if (rmsg.type == AUTOCONN::BYE) {
-			spdlog::info("<<< OMG! BYE message received.");
-			_isConnected = false;
-			flag = AUTOCONN::BYE;
-			return false;
-		} else {
-			spdlog::info("<<< Oops, HELLO message NOT received.");
-			return false;
-		}
-	} else {
-		spdlog::info("<<< No message has arrived.");
-		return false;
 	}
+	spdlog::info(">>> HELLO message sent to server.");
+	return true;
 }
 
 /**
- * Send a PING message and receive a PONG/NOK message
+ * Send a PING message. The PONG/NOK reply is handled by handle_message().
  */
-bool WgacClient::send_ping_message(message_t* pmsg) {
+bool WgacClient::send_ping_message() {
 	message_t smsg;
 
-	init_smsg(&smsg, AUTOCONN::PING, 0, 0);
+	init_smsg(&smsg, AUTOCONN::PING, 0, 0, _netif);
 
 	//from saved vpn ip !!!
 	if (inet_pton(AF_INET, _config.getstr("this_vpn_ip").c_str(), &(smsg.vpnIP)) != 1) {
@@ -155,44 +110,30 @@ bool WgacClient::send_ping_message(message_t* pmsg) {
 
 	std::memcpy(smsg.public_key, _config.getstr("this_public_key").c_str(), WG_KEY_LEN_BASE64);
 
-	if (inet_pton(AF_INET, _config.getstr("this_endpoint_ip").c_str(), &(smsg.epIP)) != 1) {
-		spdlog::warn("inet_pton(this_endpoint_ip) failed.");
+	if (_netif.epIP.s_addr == 0) {
+		spdlog::warn("Endpoint address is unknown(set this_endpoint_ip).");
 		return false;
 	}
-	smsg.epPort = _config.getint("this_endpoint_port");
+	smsg.epIP = _netif.epIP;
+	smsg.epPort = _netif.epPort;
 	std::memcpy(smsg.allowed_ips, _config.getstr("this_allowed_ips").c_str(), 256);
 
 	pipe_ret_t sendRet = sendMsg(reinterpret_cast<unsigned char*>(&smsg), sizeof(message_t));
 	if (!sendRet.isSuccessful()) {
 		spdlog::debug(">>> Failed to send message.");
 		return false;
-	} else {
-		spdlog::info(">>> PING message sent to server.");
-	}
-
-	std::this_thread::sleep_for(std::chrono::milliseconds(500));
-
-	if (handle_message_queue(pmsg)) {
-		if (pmsg->type == AUTOCONN::PONG) {
-			spdlog::info("<<< PONG message received.");
-			return true;
-		} else {
-			spdlog::info("<<< Oops, PONG message NOT received.");
-			return false;
-		}
-	} else {
-		spdlog::info("<<< No message has arrived.");
-		return false;
 	}
+	spdlog::info(">>> PING message sent to server.");
+	return true;
 }
 
 /**
- * Send a BYE message and receive an BYE/NOK message
+ * Send a BYE message. The BYE reply is handled by handle_message().
  */
 bool WgacClient::send_bye_message() {
 	message_t smsg;
 
-	init_smsg(&smsg, AUTOCONN::BYE, 0, 0);
+	init_smsg(&smsg, AUTOCONN::BYE, 0, 0, _netif);
 
 	if (inet_pton(AF_INET, _config.getstr("this_vpn_ip").c_str(), &(smsg.vpnIP)) != 1) {
 		spdlog::warn("inet_pton(this_vpn_ip) failed.");
@@ -208,59 +149,277 @@ bool WgacClient::send_bye_message() {
 	if (!sendRet.isSuccessful()) {
 		spdlog::debug(">>> Failed to send message.");
 		return false;
-	} else {
-		spdlog::info(">>> BYE message sent to server.");
 	}
+	spdlog::info(">>> BYE message sent to server.");
+	return true;
+}
 
-	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+/**
+ * Step#1 of a session: exchange public keys(plain text, 44 bytes each way)
+ */
+bool WgacClient::send_public_key() {
+	const std::string& pubkey = _config.getstr("this_public_key");
+	if (pubkey.size() < WG_KEY_LEN_BASE64 - 1) {
+		spdlog::error("Client public key is not set.");
+		return false;
+	}
 
-	message_t rmsg;
-	if (handle_message_queue(&rmsg)) {
-		if (rmsg.type == AUTOCONN::BYE) {
-			spdlog::info("<<< BYE message received.");
-			remove_wireguard(&rmsg);
-			return true;
-		} else {
-			spdlog::info("<<< Oops, BYE message NOT received.");
+	_wbuf.insert(_wbuf.end(), pubkey.begin(), pubkey.begin() + WG_KEY_LEN_BASE64 - 1);
+	if (!flushWrite()) {
+		spdlog::error("Client public key transmission failed");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Take the server public key out of the receive buffer.
+ * Returns false while it is incomplete; a malformed key closes the connection.
+ * With a pinned key(0-RTT) the request is already out, so the key is only compared.
+ */
+bool WgacClient::receive_public_key() {
+	if (_rbuf.size() < WG_KEY_LEN_BASE64 - 1) {
+		return false;
+	}
+
+	char server_pk_base64[WG_KEY_LEN_BASE64] {};
+	std::memcpy(server_pk_base64, _rbuf.data(), WG_KEY_LEN_BASE64 - 1);
+	_rbuf.erase(_rbuf.begin(), _rbuf.begin() + WG_KEY_LEN_BASE64 - 1);
+	_awaitingServerKey = false;
+
+	uint8_t server_pk[crypto_box_PUBLICKEYBYTES] {};
+	if (!key_from_base64(server_pk, server_pk_base64)) {
+		spdlog::error("Public key is not the correct length or format");
+		disconnect(reconnectDelay());
+		return false;
+	}
+
+	if (_session != SESSION::KEY_EXCHANGE) {
+		if (sodium_memcmp(server_pk, getPreparePublicKey().data(), WG_KEY_LEN) != 0) {
+			/* the server could not decrypt the request, it says BYE and stops reading */
+			spdlog::warn("--- Pinned server public key is stale, falling back to the full key exchange.");
+			_pinStale = true;
+			disconnect(0);
 			return false;
 		}
-	} else {
-		spdlog::info("<<< Any message NOT arrived.");
+		spdlog::debug("--- Pinned server public key is confirmed.");
+		WGAC_PROBE1(key_exchange_done, 1);
+		return true;
+	}
+
+	setPreparePublicKey(server_pk); /* server public key */
+	WGAC_PROBE1(key_exchange_done, 0);
+	return true;
+}
+
+/**
+ * Pinned server public key: server_public_key in the config(pre-provisioned),
+ * or the key cached in server_key_file by an earlier session with this server.
+ */
+bool WgacClient::load_pinned_key(const std::string& server_ip, uint8_t key[WG_KEY_LEN]) {
+	if (!_pinServerKey || _pinStale) {
 		return false;
 	}
+
+	if (_config.contains("server_public_key")) {
+		return key_from_base64(key, _config.getstr("server_public_key").c_str());
+	}
+
+	/* <server address> <base64 public key> per line */
+	std::ifstream file(_serverKeyFile);
+	std::string server, pubkey;
+	while (file >> server >> pubkey) {
+		if (server == server_ip) {
+			return key_from_base64(key, pubkey.c_str());
+		}
+	}
+	return false;
 }
 
 /**
- * Extract a message from message queue.
+ * Trust on first use: remember the server public key of a successful session
  */
-bool WgacClient::handle_message_queue(message_t* pmsg) {
-	time_t t, last_time = 0;
-	last_time = time(NULL);
-
-	while (1) {
-		if (!_msgQueue.empty()) {
-			*pmsg = _msgQueue.front();
-			_msgQueue.pop();
-			return true;
+void WgacClient::save_pinned_key() {
+	_pinStale = false;
+	if (!_pinServerKey || _config.contains("server_public_key")) {
+		return;
+	}
+
+	char pubkey[WG_KEY_LEN_BASE64] {};
+	key_to_base64(pubkey, getPreparePublicKey().data());
+
+	std::vector<std::string> lines;
+	std::ifstream in(_serverKeyFile);
+	std::string server, cached;
+	bool up_to_date = false;
+	while (in >> server >> cached) {
+		if (server == _server_ip) {
+			up_to_date = (cached == pubkey);
+		} else {
+			lines.push_back(server + " " + cached);
 		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		t = time(NULL);
-		if (t - last_time > 1) {
-			pmsg->type = AUTOCONN::NOK;
+	}
+	in.close();
+	if (up_to_date) {
+		return;
+	}
+	lines.push_back(_server_ip + " " + pubkey);
+
+	/* write a new file and rename it, so that a crash never leaves half a file */
+	const std::string tmpfile = _serverKeyFile + ".tmp";
+	std::ofstream out(tmpfile, std::ios::trunc);
+	for (const auto& line : lines) {
+		out << line << "\n";
+	}
+	out.close();
+	if (!out || std::rename(tmpfile.c_str(), _serverKeyFile.c_str()) != 0) {
+		spdlog::debug("Can't save the server public key to {}.", _serverKeyFile);
+		std::remove(tmpfile.c_str());
+		return;
+	}
+	spdlog::info("--- Server public key is pinned in {}.", _serverKeyFile);
+}
+
+/**
+ * Step#2 of a session: JOIN, or HELLO when the server is too old for JOIN
+ */
+void WgacClient::send_first_request() {
+	if (_joinSupported && !_helloOnly) {
+		_joinHello = false;
+		send_request(send_join_message(), SESSION::JOIN_WAIT);
+	} else {
+		send_request(send_hello_message(), SESSION::HELLO_WAIT);
+	}
+}
+
+/**
+ * Save the vpnIP and vpnNetmask come from server(HELLO)
+ */
+void WgacClient::save_vpn_address(const message_t& rmsg) {
+	char s[16];
+	snprintf(s, sizeof(s), "%s", inet_ntoa(rmsg.vpnIP));
+	std::string value1(s);
+	_config.setstr("this_vpn_ip", value1);
+
+	snprintf(s, sizeof(s), "%s", inet_ntoa(rmsg.vpnNetmask));
+	std::string value2(s);
+	_config.setstr("this_vpn_netmask", value2);
+
+	spdlog::info("--- vpnIP({}/{}) received from server.", value1, value2);
+}
+
+/**
+ * Send a request and wait for its reply until the request deadline
+ */
+void WgacClient::send_request(bool sent, SESSION next) {
+	if (!sent) {
+		request_failed("send");
+		return;
+	}
+	_session = next;
+	armTimer(_requestTimeoutMs);
+}
+
+/**
+ * HELLO/PING failed(NOK, timeout or send error): try again after a backoff,
+ * at most request_retries times. A NOK with a retry-after hint is the server
+ * throttling, not a failure: it is retried at the hint without counting.
+ */
+void WgacClient::request_failed(const char* what) {
+	spdlog::info("<<< No valid reply({}).", what);
+	const bool throttled = (_retryAfterMs > 0);
+	if (!throttled && _requestRetries > 0 && ++_retryCount > _requestRetries) {
+		spdlog::warn("--- Giving up, send SIGUSR1 to try again.");
+		_session = SESSION::ESTABLISHED;
+		disarmTimer();
+		return;
+	}
+	_session = SESSION::RETRY_WAIT;
+	uint32_t delay = nextBackoff();
+	spdlog::info("--- Retrying in {} ms.", delay);
+	armTimer(delay);
+}
+
+/**
+ * Reply handling for the request in flight
+ */
+void WgacClient::handle_message(message_t& rmsg) {
+	WGAC_PROBE2(message, static_cast<int>(_session), static_cast<int>(rmsg.type));
+	switch (_session) {
+		case SESSION::JOIN_WAIT:
+			if (rmsg.type == AUTOCONN::HELLO && !_joinHello) {
+				spdlog::info("<<< HELLO message received.");
+				save_vpn_address(rmsg);
+				_joinHello = true;    /* PONG follows in the same reply */
+			} else if (rmsg.type == AUTOCONN::PONG && _joinHello) {
+				spdlog::info("<<< PONG message received.");
+				disarmTimer();
+				_session = SESSION::ESTABLISHED;
+				resetBackoff();
+				save_pinned_key();
+				setup_wireguard(&rmsg);   /* wireguard setup stage */
+			} else if (rmsg.type == AUTOCONN::BYE) {
+				spdlog::info("<<< OMG! BYE message received.");
+				_session = SESSION::ESTABLISHED;
+				disarmTimer();
+			} else {
+				spdlog::info("<<< Oops, JOIN reply NOT received.");
+				request_failed("JOIN");
+			}
+			break;
+
+		case SESSION::HELLO_WAIT:
+			if (rmsg.type == AUTOCONN::HELLO) {
+				spdlog::info("<<< HELLO message received.");
+				save_vpn_address(rmsg);
+				send_request(send_ping_message(), SESSION::PING_WAIT);
+			} else if (rmsg.type == AUTOCONN::BYE) {
+				spdlog::info("<<< OMG! BYE message received.");
+				_session = SESSION::ESTABLISHED;
+				disarmTimer();
+			} else {
+				spdlog::info("<<< Oops, HELLO message NOT received.");
+				request_failed("HELLO");
+			}
+			break;
+
+		case SESSION::PING_WAIT:
+			if (rmsg.type == AUTOCONN::PONG) {
+				spdlog::info("<<< PONG message received.");
+				disarmTimer();
+				_session = SESSION::ESTABLISHED;
+				resetBackoff();
+				save_pinned_key();
+				setup_wireguard(&rmsg);   /* wireguard setup stage */
+			} else {
+				spdlog::info("<<< Oops, PONG message NOT received.");
+				request_failed("PING");
+			}
+			break;
+
+		case SESSION::BYE_WAIT:
+			if (rmsg.type == AUTOCONN::BYE) {
+				spdlog::info("<<< BYE message received.");
+				remove_wireguard(&rmsg);
+				disconnect(_reconnect ? 0 : -1);
+			} else {
+				spdlog::info("<<< Oops, BYE message NOT received.");
+			}
+			break;
+
+		default:
+			spdlog::debug("<<< Unexpected message({}) is ignored.", static_cast<int>(rmsg.type));
 			break;
-		}
 	}
-	return false;
 }
 
 /**
- * Setup wireguard configuration with the wg tool or vtysh.
+ * Setup wireguard configuration with netlink(the wg tool as a fallback) or vtysh.
  */
 void WgacClient::setup_wireguard(message_t* rmsg) {
 	char szInfo[512] = {};
 	char vpnip_str[32] = {};
 	char epip_str[32] = {};
-	int ret = 0;
 
 	snprintf(vpnip_str, sizeof(vpnip_str), "%s", inet_ntoa(rmsg->vpnIP));
 	snprintf(epip_str, sizeof(epip_str), "%s", inet_ntoa(rmsg->epIP));
@@ -282,35 +441,10 @@ void WgacClient::setup_wireguard(message_t* rmsg) {
 		}
 	}
 
-	//Reconfigure wg0 interface -------------------------------------------------------------
-	snprintf(szInfo, sizeof(szInfo), "ip link delete wg0");
-	ret = std::system(szInfo);
-	if (ret < 0) {
-		spdlog::warn("<%s> failed(ret=%d).", szInfo, ret);
-	}
-
-	snprintf(szInfo, sizeof(szInfo), "ip link add dev wg0 type wireguard");
-	ret = std::system(szInfo);
-	if (ret < 0) {
-		spdlog::warn("<%s> failed(ret=%d).", szInfo, ret);
-	}
-
-	snprintf(szInfo, sizeof(szInfo), "ip address add dev wg0 %s/%d", inet_ntoa(vpnIP), cidr);
-	ret = std::system(szInfo);
-	if (ret < 0) {
-		spdlog::warn("<%s> failed(ret=%d).", szInfo, ret);
-	}
-
-	snprintf(szInfo, sizeof(szInfo), "ip link set up dev wg0");
-	ret = std::system(szInfo);
-	if (ret < 0) {
-		spdlog::warn("<%s> failed(ret=%d).", szInfo, ret);
-	}
-
-	snprintf(szInfo, sizeof(szInfo), "wg set wg0 listen-port 51820 private-key /qrwg/config/privatekey");
-	ret = std::system(szInfo);
-	if (ret < 0) {
-		spdlog::warn("<%s> failed(ret=%d).", szInfo, ret);
+	//Configure wg0 interface(only what differs) --------------------------------------------
+	if (!configure_interface(vpnIP, cidr)) {
+		spdlog::debug("netlink is not usable, falling back to the ip tool.");
+		configure_interface_with_ip_tool(vpnIP, cidr);
 	}
 	//---------------------------------------------------------------------------------------
 
@@ -319,17 +453,10 @@ void WgacClient::setup_wireguard(message_t* rmsg) {
 			"wg peer %s allowed-ips %s/32 endpoint %s:%d persistent-keepalive 25",
 			rmsg->public_key, vpnip_str, epip_str, rmsg->epPort);
 
-	char xbuf[1024];
-	snprintf(xbuf, sizeof(xbuf), "/usr/bin/qrwg/vtysh -e \"%s\"", szInfo);
-	ret = std::system(xbuf);
-	if (ret < 0) {
-		spdlog::warn("<%s> failed(ret=%d).", xbuf, ret);
-	}
-
-	snprintf(xbuf, sizeof(xbuf), "/usr/bin/qrwg/vtysh -e \"write\"");
-	ret = std::system(xbuf);
-	if (ret < 0) {
-		spdlog::warn("<%s> failed(ret=%d).", xbuf, ret);
+	/* the rule and the config write in one vtysh invocation */
+	std::string error_text;
+	if (!common::spawn({"/usr/bin/qrwg/vtysh", "-e", szInfo, "-e", "write"}, error_text)) {
+		spdlog::warn("{}", error_text);
 	}
 
 	spdlog::info("--- wireguard rule [{}]", szInfo);
@@ -340,19 +467,23 @@ void WgacClient::setup_wireguard(message_t* rmsg) {
 	send_start_vpn_message(AUTOCONN::START_VPN);
 	spdlog::info("--- OK, wireguard setup is complete.");
 #else /* WIREGUARD KERNEL */
-	std::string error_text;
-	std::vector<std::string> output_list;
-	snprintf(szInfo, sizeof(szInfo),
-			"wg set wg0 peer %s allowed-ips %s/32 endpoint %s:%d persistent-keepalive 25 &",
-			rmsg->public_key, vpnip_str, epip_str, rmsg->epPort);
-
-	std::string cmd(szInfo);
-	bool exec_result = common::exec(cmd, output_list, error_text);
-	if (exec_result) {
-		spdlog::info("--- wireguard rule [{}]", szInfo);
+	if (configure_peer(rmsg)) {
 		spdlog::info("--- OK, wireguard setup is complete.");
 	} else {
-		spdlog::warn("{}", error_text);
+		std::string error_text;
+		std::vector<std::string> output_list;
+		snprintf(szInfo, sizeof(szInfo),
+				"wg set wg0 peer %s allowed-ips %s/32 endpoint %s:%d persistent-keepalive 25",
+				rmsg->public_key, vpnip_str, epip_str, rmsg->epPort);
+
+		std::string cmd(szInfo);
+		bool exec_result = common::exec(cmd, output_list, error_text);
+		if (exec_result) {
+			spdlog::info("--- wireguard rule [{}]", szInfo);
+			spdlog::info("--- OK, wireguard setup is complete.");
+		} else {
+			spdlog::warn("{}", error_text);
+		}
 	}
 #endif
 #endif
@@ -361,100 +492,44 @@ void WgacClient::setup_wireguard(message_t* rmsg) {
 }
 
 /**
- * Remove a wireguard configuration with the wg tool or vtysh.
+ * Remove a wireguard configuration with netlink(the wg tool as a fallback) or vtysh.
  */
 void WgacClient::remove_wireguard(message_t* rmsg) {
 	char szInfo[256] = {};
-	int ret = 0;
 
 #ifdef VTYSH
 	snprintf(szInfo, sizeof(szInfo), "no wg peer %s", rmsg->public_key);
 
-	char xbuf[512];
-	snprintf(xbuf, sizeof(xbuf), "/usr/bin/qrwg/vtysh -e \"%s\"", szInfo);
-	ret = std::system(xbuf);
-	if (ret < 0) {
-		spdlog::warn("<%s> failed(ret=%d).", xbuf, ret);
-	}
-
-	snprintf(xbuf, sizeof(xbuf), "/usr/bin/qrwg/vtysh -e \"write\"");
-	ret = std::system(xbuf);
-	if (ret < 0) {
-		spdlog::warn("<%s> failed(ret=%d).", xbuf, ret);
+	/* the rule and the config write in one vtysh invocation */
+	std::string error_text;
+	if (!common::spawn({"/usr/bin/qrwg/vtysh", "-e", szInfo, "-e", "write"}, error_text)) {
+		spdlog::warn("{}", error_text);
 	}
 
 	spdlog::info("--- wireugard rule [{}]", szInfo);
 	spdlog::info("--- OK, wireguard rule is removed.");
 #else
-	std::string error_text;
-	std::vector<std::string> output_list;
-	snprintf(szInfo, sizeof(szInfo), "wg set wg0 peer %s remove", rmsg->public_key);
-
-	std::string cmd(szInfo);
-	bool exec_result = common::exec(cmd, output_list, error_text);
-	if (exec_result) {
-		spdlog::info("--- wireugard rule [{}]", szInfo);
+	if (unconfigure_peer(rmsg)) {
 		spdlog::info("--- OK, wireguard rule is removed.");
 	} else {
-		spdlog::warn("{}", error_text);
+		std::string error_text;
+		std::vector<std::string> output_list;
+		snprintf(szInfo, sizeof(szInfo), "wg set wg0 peer %s remove", rmsg->public_key);
+
+		std::string cmd(szInfo);
+		bool exec_result = common::exec(cmd, output_list, error_text);
+		if (exec_result) {
+			spdlog::info("--- wireugard rule [{}]", szInfo);
+			spdlog::info("--- OK, wireguard rule is removed.");
+		} else {
+			spdlog::warn("{}", error_text);
+		}
 	}
 #endif
 
 	_isWireguardReady = false;
 }
 
-/**
- * Start PING-PONG negotiations
- */
-void WgacClient::start() {
-	message_t rmsg {};
-	int count {};
-	enum AUTOCONN flag { AUTOCONN::HELLO };
-
-	//step#1: Let's exchange public key
-	uint8_t client_pk_base64[WG_KEY_LEN_BASE64] {};
-	std::memcpy(client_pk_base64, _config.getstr("this_public_key").c_str(), WG_KEY_LEN_BASE64);
-
-	if (!send_all(_sockfd.get(), client_pk_base64, sizeof(client_pk_base64)-1)) {
-		std::cerr << "Client public key transmission failed" << std::endl;
-		return;
-	}
-	//std::cout << "client_pk_base64 --> " << client_pk_base64 << std::endl;
-
-	uint8_t server_pk_base64[WG_KEY_LEN_BASE64] {};
-	if (!recv_all(_sockfd.get(), server_pk_base64, sizeof(server_pk_base64)-1)) {
-		std::cerr << "Server public key reception failed" << std::endl;
-		return;
-	}
-	//std::cout << "server_pk_base64 --> " << server_pk_base64 << std::endl;
-
-	uint8_t server_pk[crypto_box_PUBLICKEYBYTES] {};
-	if (!key_from_base64(server_pk, reinterpret_cast<const char*>(server_pk_base64))) {
-		std::cerr << "Public key is not the correct length or format" << std::endl;
-		return;
-	}
-	setPreparePublicKey(server_pk); /* server public key */
-
-	//step#2: Start receiveTask thread
-	startReceivingMessages();
-	std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-
-	//step#3: Send PING-PONG messages
-	while (1) {
-		if (send_hello_message(flag)) {   /* PING-PING protocol stage */
-			if (send_ping_message(&rmsg)) {
-				setup_wireguard(&rmsg);	  /* wireguard setup stage */
-				break;
-			}
-		} else {
-			if (flag == AUTOCONN::BYE) break;
-			count++;
-			if (count > 3) break;
-		}
-		sleep(10);
-	}
-}
-
 ////////////////////////////////////////////////////////////////////////////////////////////
 
 /* wrapper around sendto for non blocking I/O */
@@ -0,0 +1,334 @@
+/*
+ * Server selection of the autoconnect client: every address of every server
+ * is raced happy eyeballs style and the fastest key exchange wins.
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include <sys/epoll.h>
+#include <sodium.h>
+#include "inc/client.h"
+#include "spdlog/spdlog.h"
+
+#define RTT_EWMA_WEIGHT 0.3
+
+/**
+ * Append the items of a comma separated list, without duplicates
+ */
+static void split_server_list(const std::string& list, std::vector<std::string>& servers) {
+	std::stringstream ss(list);
+	std::string item;
+	while (std::getline(ss, item, ',')) {
+		item.erase(0, item.find_first_not_of(" \t"));
+		item.erase(item.find_last_not_of(" \t") + 1);
+		if (!item.empty() && std::find(servers.begin(), servers.end(), item) == servers.end()) {
+			servers.push_back(item);
+		}
+	}
+}
+
+/**
+ * Servers of --server and of the servers config key(addresses or host names)
+ */
+void WgacClient::load_server_list() {
+	_servers.clear();
+	split_server_list(_server_ip, _servers);
+	if (_config.contains("servers")) {
+		split_server_list(_config.getstr("servers"), _servers);
+	}
+
+	if (_config.contains("server_port") &&
+			_config.getint("server_port") >= 1024 && _config.getint("server_port") < 65536) {
+		_serverPort = _config.getint("server_port");
+	}
+	if (_config.contains("happy_eyeballs_delay_ms") && _config.getint("happy_eyeballs_delay_ms") >= 0) {
+		_attemptDelayMs = _config.getint("happy_eyeballs_delay_ms");
+	}
+}
+
+/**
+ * Every A record of every server, the fastest(remembered RTT) first.
+ * Servers never measured come after the measured ones, failed ones last.
+ */
+std::vector<std::string> WgacClient::resolve_servers() {
+	std::vector<std::string> addrs;
+	auto add = [&addrs](const std::string& addr) {
+		if (std::find(addrs.begin(), addrs.end(), addr) == addrs.end()) {
+			addrs.push_back(addr);
+		}
+	};
+
+	for (const auto& server : _servers) {
+		struct in_addr in;
+		if (inet_aton(server.c_str(), &in)) {
+			add(inet_ntoa(in));
+			continue;
+		}
+
+		struct addrinfo hints {};
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		struct addrinfo* res = nullptr;
+		int err = getaddrinfo(server.c_str(), nullptr, &hints, &res);
+		if (err != 0) {
+			spdlog::warn("Failed to resolve {}: {}", server, gai_strerror(err));
+			continue;
+		}
+		for (struct addrinfo* ai = res; ai != nullptr; ai = ai->ai_next) {
+			add(inet_ntoa(reinterpret_cast<struct sockaddr_in*>(ai->ai_addr)->sin_addr));
+		}
+		freeaddrinfo(res);
+	}
+
+	auto rank = [this](const std::string& addr) {
+		auto it = _serverRtt.find(addr);
+		return (it == _serverRtt.end()) ? static_cast<double>(_connectTimeoutMs) : it->second;
+	};
+	std::stable_sort(addrs.begin(), addrs.end(), [&rank](const std::string& a, const std::string& b) {
+		return rank(a) < rank(b);
+	});
+	return addrs;
+}
+
+/**
+ * RTT of a key exchange(connect + server public key), averaged over the sessions.
+ * It includes the time the server takes to answer, so a busy server ranks lower.
+ */
+void WgacClient::note_server_rtt(const std::string& addr, double rtt_ms) {
+	auto it = _serverRtt.find(addr);
+	if (it == _serverRtt.end() || it->second >= _connectTimeoutMs) {
+		_serverRtt[addr] = rtt_ms;   /* first sample, or the server is back */
+	} else {
+		it->second += RTT_EWMA_WEIGHT * (rtt_ms - it->second);
+	}
+}
+
+void WgacClient::note_server_failure(const std::string& addr) {
+	_serverRtt[addr] = 2.0 * _connectTimeoutMs;
+}
+
+/**
+ * Connect to the next candidate. Candidates failing right away are skipped.
+ */
+bool WgacClient::startNextAttempt() {
+	while (_nextCandidate < _candidates.size()) {
+		server_attempt_t attempt;
+		attempt.address = _candidates[_nextCandidate++];
+		attempt.started = std::chrono::steady_clock::now();
+		_lastAttemptStart = attempt.started;
+
+		struct sockaddr_in sin {};
+		sin.sin_family = AF_INET;
+		sin.sin_port = htons(_serverPort);
+		inet_aton(attempt.address.c_str(), &sin.sin_addr);
+
+		attempt.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (attempt.fd < 0 ||
+				(connect(attempt.fd, (struct sockaddr*)&sin, sizeof(sin)) < 0 && errno != EINPROGRESS)) {
+			spdlog::info("--- Client failed to connect to {}: {}", attempt.address, strerror(errno));
+			note_server_failure(attempt.address);
+			if (attempt.fd >= 0) {
+				::close(attempt.fd);
+			}
+			continue;
+		}
+
+		struct epoll_event ev {};
+		ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+		ev.data.fd = attempt.fd;
+		epoll_ctl(_epollfd, EPOLL_CTL_ADD, attempt.fd, &ev);
+		spdlog::debug("--- Connecting to {}:{}", attempt.address, _serverPort);
+		_attempts.push_back(std::move(attempt));
+		return true;
+	}
+	return false;
+}
+
+void WgacClient::closeAttempts() {
+	for (auto& attempt : _attempts) {
+		epoll_ctl(_epollfd, EPOLL_CTL_DEL, attempt.fd, nullptr);
+		::close(attempt.fd);
+	}
+	_attempts.clear();
+	_candidates.clear();
+	_nextCandidate = 0;
+}
+
+/**
+ * Start a race over all server addresses. The best known one gets a head start
+ * of happy_eyeballs_delay_ms, then the next one joins, and so on.
+ */
+void WgacClient::beginConnect() {
+	closeAttempts();
+	_helloOnly = _joinFallback;
+	_joinFallback = false;
+	_candidates = resolve_servers();
+	if (_candidates.empty()) {
+		spdlog::info("--- No server address to connect to.");
+		_session = SESSION::DISCONNECTED;
+		armTimer(reconnectDelay());
+		return;
+	}
+
+	_session = SESSION::CONNECTING;
+	startNextAttempt();
+	scheduleRace();
+}
+
+/**
+ * Arm the timer for the next event of the race: an attempt deadline or
+ * the start of the next candidate. All candidates failed: reconnect later.
+ */
+void WgacClient::scheduleRace() {
+	if (_attempts.empty() && _nextCandidate >= _candidates.size()) {
+		spdlog::info("--- Client failed to connect to any server.");
+		disconnect(reconnectDelay());
+		return;
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+	auto next = std::chrono::steady_clock::time_point::max();
+	for (const auto& attempt : _attempts) {
+		next = std::min(next, attempt.started + std::chrono::milliseconds(_connectTimeoutMs));
+	}
+	if (_nextCandidate < _candidates.size()) {
+		next = std::min(next, _lastAttemptStart + std::chrono::milliseconds(_attemptDelayMs));
+	}
+	auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count();
+	armTimer(ms > 0 ? ms : 0);
+}
+
+void WgacClient::onRaceTimer() {
+	const auto now = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < _attempts.size();) {
+		if (now >= _attempts[i].started + std::chrono::milliseconds(_connectTimeoutMs)) {
+			failAttempt(i, "timed out", false);
+		} else {
+			i++;
+		}
+	}
+
+	if (_attempts.empty() || now >= _lastAttemptStart + std::chrono::milliseconds(_attemptDelayMs)) {
+		startNextAttempt();
+	}
+	scheduleRace();
+}
+
+/**
+ * Drop one attempt. The next candidate starts at once, a dead server costs no head start.
+ */
+void WgacClient::failAttempt(size_t index, const char* why, bool reschedule) {
+	server_attempt_t& attempt = _attempts[index];
+	spdlog::info("--- Client failed to connect to {}: {}", attempt.address, why);
+	note_server_failure(attempt.address);
+	epoll_ctl(_epollfd, EPOLL_CTL_DEL, attempt.fd, nullptr);
+	::close(attempt.fd);
+	_attempts.erase(_attempts.begin() + index);
+
+	if (reschedule) {
+		startNextAttempt();
+		scheduleRace();
+	}
+}
+
+/**
+ * Socket event of an attempt: connect result, then the server public key
+ */
+void WgacClient::onAttempt(int fd, uint32_t events) {
+	auto it = std::find_if(_attempts.begin(), _attempts.end(),
+			[fd](const server_attempt_t& attempt) { return attempt.fd == fd; });
+	if (it == _attempts.end()) {
+		return;
+	}
+	const size_t index = it - _attempts.begin();
+	server_attempt_t& attempt = *it;
+
+	if (!attempt.connected) {
+		int error = 0;
+		socklen_t len = sizeof(error);
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0) {
+			error = errno;
+		}
+		if (error == 0 && !(events & EPOLLOUT)) {
+			return;
+		}
+		if (error != 0) {
+			failAttempt(index, strerror(error));
+			return;
+		}
+
+		//step#1: Send our public key. Plain text, 44 bytes into a new socket.
+		const std::string& pubkey = _config.getstr("this_public_key");
+		if (pubkey.size() < WG_KEY_LEN_BASE64 - 1) {
+			spdlog::error("Client public key is not set.");
+			failAttempt(index, "no public key");
+			return;
+		}
+		if (::send(fd, pubkey.data(), WG_KEY_LEN_BASE64 - 1, MSG_NOSIGNAL) != WG_KEY_LEN_BASE64 - 1) {
+			failAttempt(index, "Client public key transmission failed");
+			return;
+		}
+		attempt.connected = true;
+
+		struct epoll_event ev {};
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.fd = fd;
+		epoll_ctl(_epollfd, EPOLL_CTL_MOD, fd, &ev);
+
+		uint8_t server_pk[WG_KEY_LEN];
+		if (load_pinned_key(attempt.address, server_pk)) {
+			/* 0-RTT: the key is known already, so this key exchange is complete */
+			winAttempt(index, server_pk);
+			sodium_memzero(server_pk, sizeof(server_pk));
+			return;
+		}
+	}
+
+	uint8_t buf[WG_KEY_LEN_BASE64];
+	ssize_t n;
+	while ((n = ::recv(fd, buf, sizeof(buf), 0)) > 0) {
+		attempt.rbuf.insert(attempt.rbuf.end(), buf, buf + n);
+	}
+	if (attempt.rbuf.size() >= WG_KEY_LEN_BASE64 - 1) {
+		winAttempt(index, nullptr);
+	} else if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+		failAttempt(index, "connection closed");
+	}
+}
+
+/**
+ * The winner becomes the connection of the session, the other attempts are closed
+ */
+void WgacClient::winAttempt(size_t index, uint8_t* pinned_key) {
+	server_attempt_t winner = std::move(_attempts[index]);
+	_attempts.erase(_attempts.begin() + index);
+	closeAttempts();
+
+	const std::chrono::duration<double, std::milli> rtt = std::chrono::steady_clock::now() - winner.started;
+	note_server_rtt(winner.address, rtt.count());
+	spdlog::info("--- Client connected successfully to {}(rtt {:.1f} ms)", winner.address, rtt.count());
+
+	_sockfd.set(winner.fd);
+	_isClosed = false;
+	_isConnected = true;
+	_rbuf = std::move(winner.rbuf);
+	_wbuf.clear();
+	_server_ip = winner.address;
+	_retryCount = 0;
+	_reconnect = false;
+	_session = SESSION::KEY_EXCHANGE;
+	_awaitingServerKey = true;
+	updateSocketEvents();
+
+	if (pinned_key) {
+		setPreparePublicKey(pinned_key);
+		send_first_request();
+	} else if (receive_public_key()) {
+		//step#2: Send JOIN(or HELLO-PING) messages
+		send_first_request();
+	}
+}
@@ -18,30 +18,66 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <vector>
-#include <queue>
+#include <map>
 #include <errno.h>
-#include <thread>
-#include <condition_variable>
-#include <mutex>
 #include <atomic>
+#include <chrono>
 #include "client_observer.h"
 #include "pipe_ret_t.h"
 #include "file_descriptor.h"
 #include "message.h"
 #include "configuration.h"
+#include "rt_netlink.h"
+#include "wg_netlink.h"
+
+/* protocol state of the connection, driven by the event loop */
+enum class SESSION {
+	DISCONNECTED,      // no socket, waiting for the reconnect timer(or SIGUSR1)
+	CONNECTING,        // non-blocking connect in progress
+	KEY_EXCHANGE,      // public key sent, waiting for the server public key
+	JOIN_WAIT,         // JOIN sent, waiting for HELLO + PONG(or NOK/BYE)
+	HELLO_WAIT,        // HELLO sent, waiting for HELLO/BYE/NOK
+	PING_WAIT,         // PING sent, waiting for PONG/NOK
+	RETRY_WAIT,        // HELLO/PING failed, waiting to send HELLO again
+	ESTABLISHED,       // wireguard is set up(or retries are exhausted)
+	BYE_WAIT           // BYE sent, waiting for BYE before closing
+};
+
+/* Network identity of this host(netif.cpp) */
+struct netif {
+	std::string ifname;                      // primary interface
+	int ifindex;
+	uint8_t mac_addr[6];
+	struct in_addr epIP;                     // endpoint address sent to the server
+	uint16_t epPort;
+};
+
+using netif_t = struct netif;
+
+/* One connection attempt of the server race(failover.cpp) */
+struct server_attempt {
+	std::string address;                     // server ip address
+	int fd = -1;
+	bool connected = false;                  // our public key is sent
+	std::chrono::steady_clock::time_point started;
+	std::vector<uint8_t> rbuf;               // server public key, so far
+};
+
+using server_attempt_t = struct server_attempt;
 
 class WgacClient {
 public:
 	WgacClient();
 	~WgacClient();
-	pipe_ret_t connectTo(const std::string& address, unsigned short port);
 
-	void start();
+	/* event loop: returns when a termination signal has been handled */
+	bool run();
 
+	pipe_ret_t connectTo(const std::string& address, unsigned short port);
 	pipe_ret_t sendMsg(unsigned char* msg, size_t size);
-	bool handle_message_queue(message_t* pmsg);
-	bool send_hello_message(enum AUTOCONN& flag);
-	bool send_ping_message(message_t* pmsg);
+	bool send_join_message();
+	bool send_hello_message();
+	bool send_ping_message();
 	bool send_bye_message();
 
 	void setup_wireguard(message_t* rmsg);
@@ -70,20 +106,66 @@ public:
 		_prepare_public_key.assign(key, key + WG_KEY_LEN);
 	}
 
-	/* for reconnection to server */
-	bool shouldRestart();
-	void setRestart(bool flag);
 	bool isWireguardReady() const { return _isWireguardReady; }
 
-	std::mutex& getMutex() { return _mtx; }
-	std::condition_variable& getCond() { return _cond; }
-
 private:
 	void initializeSocket();
-	void startReceivingMessages();
 	void setAddress(const std::string& address, unsigned short port);
-	void receiveTask();
-	void terminateReceiveThread();
+
+	/* event loop(reactor.cpp) */
+	bool initializeReactor();
+	void closeReactor();
+	void armTimer(uint32_t ms);
+	void disarmTimer();
+	void updateSocketEvents();
+	void onSignal();
+	void onTimer();
+	void onSocket(uint32_t events);
+	void disconnect(int reconnectMs);   /* -1: wait for SIGUSR1 */
+	void restart();
+	uint32_t nextBackoff();
+	uint32_t reconnectDelay();
+	void resetBackoff();
+
+	/* server selection(failover.cpp) */
+	void load_server_list();
+	std::vector<std::string> resolve_servers();
+	void note_server_rtt(const std::string& addr, double rtt_ms);
+	void note_server_failure(const std::string& addr);
+	void beginConnect();
+	bool startNextAttempt();
+	void closeAttempts();
+	void scheduleRace();
+	void onRaceTimer();
+	void onAttempt(int fd, uint32_t events);
+	void failAttempt(size_t index, const char* why, bool reschedule = true);
+	void winAttempt(size_t index, uint8_t* pinned_key);
+
+	/* network identity(netif.cpp) */
+	bool refresh_netif();
+	bool open_netif_events();
+	void onNetlink();
+
+	/* framing(client.cpp) */
+	bool flushWrite();
+	bool readSocket();
+	bool nextMessage(message_t& rmsg, bool& bad_frame);
+
+	/* protocol(communication.cpp) */
+	bool send_public_key();
+	bool receive_public_key();
+	bool load_pinned_key(const std::string& server, uint8_t key[WG_KEY_LEN]);
+	void save_pinned_key();
+	void send_first_request();
+	void save_vpn_address(const message_t& rmsg);
+	void handle_message(message_t& rmsg);
+	void request_failed(const char* what);
+	void send_request(bool sent, SESSION next);
+
+	bool configure_interface(const struct in_addr& vpnIP, int cidr);
+	void configure_interface_with_ip_tool(const struct in_addr& vpnIP, int cidr);
+	bool configure_peer(const message_t* rmsg);
+	bool unconfigure_peer(const message_t* rmsg);
 
 #ifdef WIREGUARD_C_DAEMON
 	ssize_t xsendto(int sockfd, const void* buf, size_t len, int flags, const
@@ -95,25 +177,69 @@ private:
 	std::atomic<bool> _isConnected;
 	std::atomic<bool> _isClosed;
 	struct sockaddr_in _server;
-	std::thread* _receiveTask = nullptr;
 
 	/* for <PREPARE> stage */
 	std::vector<unsigned char> _prepare_secret_key;  /* client private key */
 	std::vector<unsigned char> _prepare_public_key;  /* server public key */
 
-	std::queue<message_t> _msgQueue;
 	Config _config;
-	std::string _server_ip;
+	RtNetlink _rtnl;
+	WgNetlink _wgnl;
+	NlSocket _rtnlEvents;                    /* link/address/route notifications */
+	netif_t _netif {};
+	std::string _server_ip;                  /* --server, then the address of the session */
+
+	/* server selection */
+	std::vector<std::string> _servers;       /* addresses or host names */
+	unsigned short _serverPort = 51822;
+	std::vector<std::string> _candidates;    /* addresses of the current race, fastest first */
+	size_t _nextCandidate = 0;
+	std::vector<server_attempt_t> _attempts;
+	std::chrono::steady_clock::time_point _lastAttemptStart;
+	uint32_t _attemptDelayMs = 250;          /* head start of each candidate */
+	std::map<std::string, double> _serverRtt;  /* ms, remembered across reconnects */
+
+	/* event loop */
+	int _epollfd = -1;
+	int _timerfd = -1;
+	int _signalfd = -1;
+	SESSION _session = SESSION::DISCONNECTED;
+	std::vector<uint8_t> _rbuf;              /* bytes received, not framed yet */
+	std::vector<uint8_t> _wbuf;              /* bytes not accepted by the socket yet */
+	uint32_t _requestTimeoutMs = 2000;       /* deadline of one request(key, HELLO, PING, BYE) */
+	uint32_t _connectTimeoutMs = 3000;
+	uint32_t _backoffBaseMs = 1000;          /* decorrelated jitter backoff of retries and reconnects */
+	uint32_t _backoffCapMs = 60000;
+	uint32_t _backoffMs = 0;                 /* previous delay, 0: no failure since the last session */
+	uint32_t _retryAfterMs = 0;              /* retry-after hint of the last NOK */
+	int _requestRetries = 3;                 /* HELLO/JOIN is sent again after a failure, 0: forever */
+	int _retryCount = 0;
+	uint32_t _reconnectBudget = 10;          /* reconnects in a burst, 0: no limit */
+	double _budgetTokens = 10;               /* one more every _backoffCapMs, < 0: owed */
+	std::chrono::steady_clock::time_point _budgetStamp;
+	bool _joinSupported = true;              /* false: HELLO/PING only(join_handshake = 0) */
+	bool _joinFallback = false;              /* JOIN timed out: HELLO/PING on the next connection */
+	bool _helloOnly = false;                 /* this connection is that next one */
+	bool _joinHello = false;                 /* HELLO part of the JOIN reply is in */
+
+	/* 0-RTT: the server public key is pinned after the first session(or pre-provisioned) */
+	bool _pinServerKey = true;
+	std::string _serverKeyFile {"/qrwg/config/server_publickey"};
+	bool _awaitingServerKey = false;         /* the server public key has not arrived yet */
+	bool _pinStale = false;                  /* the pinned key was wrong, do the full exchange */
+	bool _terminate = false;                 /* leave the loop once BYE is done */
+	bool _reconnect = false;                 /* connect again once BYE is done */
+	std::chrono::steady_clock::time_point _lastRestart;
 
-	/* for reconnection to server */
-	std::atomic<bool> _flagTerminate = false;
 	std::atomic<bool> _isWireguardReady = false;
-	std::mutex _mtx;
-	std::condition_variable _cond;
 };
 
+/* text form of a message, before encryption(client.cpp) */
+std::string convert_message2string(unsigned char* msg, size_t size);
+
 //////////////////////////////////////////////////////////////////////////////
 extern "C" {
 	bool initialize_curve25519(char *pubkey, char *privkey);
 	bool key_from_base64(uint8_t key[WG_KEY_LEN], const char *base64);
+	void key_to_base64(char base64[WG_KEY_LEN_BASE64], const uint8_t key[WG_KEY_LEN]);
 }
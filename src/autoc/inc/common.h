@@ -18,4 +18,5 @@ namespace fd_wait
 namespace common
 {
 	bool exec(const std::string& cmd, std::vector<std::string>& output_list, std::string& error_text);
+	bool spawn(const std::vector<std::string>& argv, std::string& error_text);
 }
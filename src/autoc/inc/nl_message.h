@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <linux/netlink.h>
+
+#define NL_BUFFER_SIZE 32768   /* max size of one request or reply */
+
+/* Netlink message builder(nlmsghdr + family header + attributes) */
+class NlMessage {
+public:
+	NlMessage(uint16_t type, uint16_t flags, size_t hdrlen) {
+		_buf.reserve(NL_BUFFER_SIZE);
+		_buf.resize(NLMSG_HDRLEN + NLMSG_ALIGN(hdrlen), 0);
+		struct nlmsghdr* nlh = reinterpret_cast<struct nlmsghdr*>(_buf.data());
+		nlh->nlmsg_type = type;
+		nlh->nlmsg_flags = NLM_F_REQUEST | flags;
+	}
+
+	/* family header(genlmsghdr, ifinfomsg, ifaddrmsg, ...) */
+	template <typename T>
+	T* header() { return reinterpret_cast<T*>(_buf.data() + NLMSG_HDRLEN); }
+
+	void put(uint16_t type, const void* data, size_t len) {
+		size_t offset = _buf.size();
+		_buf.resize(offset + NLA_ALIGN(NLA_HDRLEN + len), 0);
+		struct nlattr* nla = reinterpret_cast<struct nlattr*>(_buf.data() + offset);
+		nla->nla_type = type;
+		nla->nla_len = NLA_HDRLEN + len;
+		std::memcpy(_buf.data() + offset + NLA_HDRLEN, data, len);
+	}
+	void put_u8(uint16_t type, uint8_t value) { put(type, &value, sizeof(value)); }
+	void put_u16(uint16_t type, uint16_t value) { put(type, &value, sizeof(value)); }
+	void put_u32(uint16_t type, uint32_t value) { put(type, &value, sizeof(value)); }
+	void put_str(uint16_t type, const std::string& value) { put(type, value.c_str(), value.length() + 1); }
+
+	size_t nest_start(uint16_t type) {
+		size_t offset = _buf.size();
+		_buf.resize(offset + NLA_HDRLEN, 0);
+		reinterpret_cast<struct nlattr*>(_buf.data() + offset)->nla_type = type | NLA_F_NESTED;
+		return offset;
+	}
+	void nest_end(size_t offset) {
+		reinterpret_cast<struct nlattr*>(_buf.data() + offset)->nla_len = _buf.size() - offset;
+	}
+
+	size_t size() const { return _buf.size(); }
+	std::vector<uint8_t>& buffer() { return _buf; }
+
+private:
+	std::vector<uint8_t> _buf;
+};
+
+/* Walk the attributes in [p, end) */
+inline void nl_for_each_attr(const uint8_t* p, const uint8_t* end,
+		const std::function<void(const struct nlattr*)>& fn) {
+	while (p + NLA_HDRLEN <= end) {
+		const struct nlattr* nla = reinterpret_cast<const struct nlattr*>(p);
+		if (nla->nla_len < NLA_HDRLEN || p + nla->nla_len > end) break;
+		fn(nla);
+		p += NLA_ALIGN(nla->nla_len);
+	}
+}
+
+/* Walk the attributes of a reply, after its family header */
+inline void nl_for_each_attr(const struct nlmsghdr* nlh, size_t hdrlen,
+		const std::function<void(const struct nlattr*)>& fn) {
+	nl_for_each_attr(reinterpret_cast<const uint8_t*>(NLMSG_DATA(nlh)) + NLMSG_ALIGN(hdrlen),
+			reinterpret_cast<const uint8_t*>(nlh) + nlh->nlmsg_len, fn);
+}
+
+/* Walk the attributes nested in an attribute */
+inline void nl_for_each_nested(const struct nlattr* nest, const std::function<void(const struct nlattr*)>& fn) {
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(nest);
+	nl_for_each_attr(p + NLA_HDRLEN, p + nest->nla_len, fn);
+}
+
+inline const void* nl_attr_data(const struct nlattr* nla) {
+	return reinterpret_cast<const uint8_t*>(nla) + NLA_HDRLEN;
+}
+
+inline size_t nl_attr_len(const struct nlattr* nla) {
+	return nla->nla_len - NLA_HDRLEN;
+}
+
+/* Netlink socket doing one request at a time */
+class NlSocket {
+public:
+	NlSocket() {}
+	~NlSocket() { close(); }
+
+	bool open(int protocol, uint32_t groups = 0);   /* groups: multicast groups to listen to */
+	void close();
+	bool isOpen() const { return _sockfd >= 0; }
+	int fd() const { return _sockfd; }
+
+	bool transact(std::vector<uint8_t>& buf,
+			const std::function<void(const struct nlmsghdr*)>& handler = nullptr);
+	bool drain(const std::function<void(const struct nlmsghdr*)>& handler);
+
+private:
+	int _sockfd = -1;
+	uint32_t _seq = 0;
+};
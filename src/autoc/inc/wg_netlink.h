@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "message.h"
+#include "nl_message.h"
+
+/* One peer operation for the wireguard device */
+struct wg_peer_change {
+	enum class Op {
+		SET,                                 // add or update the peer
+		REMOVE                               // remove the peer
+	} op;
+	uint8_t public_key[WG_KEY_LEN_BASE64];   // base64 public key of the peer
+	struct in_addr vpnIP;                    // allowed ip(/32) of the peer
+	struct in_addr epIP;                     // endpoint IP address of the peer
+	uint16_t epPort;                         // endpoint port of the peer
+	uint16_t keepalive;                      // persistent keepalive interval
+};
+
+using wg_peer_change_t = struct wg_peer_change;
+
+/* One peer as it is currently programmed in the wireguard device */
+struct wg_device_peer {
+	uint8_t public_key[WG_KEY_LEN_BASE64];   // base64 public key of the peer
+	struct in_addr vpnIP;                    // first IPv4 allowed ip of the peer
+	uint8_t cidr;                            // prefix length of vpnIP
+	uint32_t allowedIPs;                     // number of allowed ips
+	struct in_addr epIP;                     // IPv4 endpoint(0 if none)
+	uint16_t epPort;                         // endpoint port
+	uint16_t keepalive;                      // persistent keepalive interval
+};
+
+using wg_device_peer_t = struct wg_device_peer;
+
+/* Current state of the wireguard device */
+struct wg_device {
+	uint8_t private_key[WG_KEY_LEN];
+	bool has_private_key;
+	uint16_t listen_port;
+	std::vector<wg_device_peer_t> peers;
+};
+
+using wg_device_t = struct wg_device;
+
+/*
+ * Minimal generic netlink client for the wireguard kernel module
+ * (what "wg show" and "wg set" were forked for).
+ */
+class WgNetlink {
+public:
+	WgNetlink() {}
+	~WgNetlink() { close(); }
+
+	bool open();
+	void close();
+
+	bool get_device(const std::string& ifname, wg_device_t& dev);
+	bool set_device(const std::string& ifname, const uint8_t* private_key, uint16_t listen_port,
+			const std::vector<wg_peer_change_t>& changes);
+
+private:
+	bool resolve_family();
+
+	NlSocket _sock;
+	uint16_t _family = 0;
+};
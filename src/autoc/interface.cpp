@@ -0,0 +1,200 @@
+/*
+ * wg0 interface configuration routines(rtnetlink + wireguard netlink)
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <net/if.h>
+#include <sodium.h>
+#include "inc/client.h"
+#include "inc/rt_netlink.h"
+#include "inc/wg_netlink.h"
+#include "spdlog/spdlog.h"
+
+#define WG_IFNAME           "wg0"
+#define WG_PRIVATE_KEY_FILE "/qrwg/config/privatekey"
+#define WG_KEEPALIVE        25
+
+/**
+ * Read the base64 private key(wg genkey output) of this client
+ */
+static bool load_private_key(uint8_t key[WG_KEY_LEN]) {
+	std::ifstream file(WG_PRIVATE_KEY_FILE);
+	std::string line;
+	if (!file || !std::getline(file, line)) {
+		spdlog::warn("Can't read {}.", WG_PRIVATE_KEY_FILE);
+		return false;
+	}
+	line.erase(line.find_last_not_of(" \t\r\n") + 1);
+
+	bool ok = key_from_base64(key, line.c_str());
+	sodium_memzero(line.data(), line.size());
+	if (!ok) {
+		spdlog::warn("Invalid private key in {}.", WG_PRIVATE_KEY_FILE);
+	}
+	return ok;
+}
+
+/**
+ * Bring wg0 to the wanted state, touching only what differs:
+ * link, address, link state, private key and listen port.
+ * An existing tunnel is left alone, so a reconnect does not drop traffic.
+ */
+bool WgacClient::configure_interface(const struct in_addr& vpnIP, int cidr) {
+	int ifindex = _rtnl.link_index(WG_IFNAME);
+	if (ifindex == 0) {
+		if (!_rtnl.add_wireguard_link(WG_IFNAME)) {
+			return false;
+		}
+		ifindex = _rtnl.link_index(WG_IFNAME);
+		if (ifindex == 0) {
+			return false;
+		}
+		spdlog::info("--- {} is created.", WG_IFNAME);
+	}
+
+	std::vector<ipv4_prefix_t> addrs;
+	if (!_rtnl.get_ipv4_addresses(ifindex, addrs)) {
+		return false;
+	}
+	bool has_addr = false;
+	for (const auto& addr : addrs) {
+		if (addr.addr.s_addr == vpnIP.s_addr && addr.prefixlen == cidr) {
+			has_addr = true;
+		} else if (_rtnl.del_ipv4_address(ifindex, addr)) {
+			spdlog::info("--- stale address {}/{} is removed from {}.", inet_ntoa(addr.addr), addr.prefixlen, WG_IFNAME);
+		}
+	}
+	if (!has_addr) {
+		ipv4_prefix_t prefix {vpnIP, static_cast<uint8_t>(cidr)};
+		if (!_rtnl.add_ipv4_address(ifindex, prefix)) {
+			return false;
+		}
+		spdlog::info("--- address {}/{} is set to {}.", inet_ntoa(vpnIP), cidr, WG_IFNAME);
+	}
+
+	uint32_t flags = 0;
+	if (!_rtnl.get_link_flags(ifindex, flags)) {
+		return false;
+	}
+	if (!(flags & IFF_UP) && !_rtnl.set_link_up(ifindex)) {
+		return false;
+	}
+
+	uint8_t private_key[WG_KEY_LEN];
+	if (!load_private_key(private_key)) {
+		return false;
+	}
+
+	wg_device_t dev {};
+	bool ok_flag = _wgnl.get_device(WG_IFNAME, dev);
+	if (ok_flag) {
+		const bool key_differs = !dev.has_private_key ||
+			sodium_memcmp(dev.private_key, private_key, WG_KEY_LEN) != 0;
+		const bool port_differs = (dev.listen_port != WG_CLIENT_PORT);
+		if (key_differs || port_differs) {
+			ok_flag = _wgnl.set_device(WG_IFNAME, key_differs ? private_key : nullptr,
+					port_differs ? WG_CLIENT_PORT : 0, {});
+		}
+	}
+
+	sodium_memzero(private_key, sizeof(private_key));
+	sodium_memzero(dev.private_key, sizeof(dev.private_key));
+	return ok_flag;
+}
+
+/**
+ * Fallback when netlink is not usable: the ip and wg tools.
+ */
+void WgacClient::configure_interface_with_ip_tool(const struct in_addr& vpnIP, int cidr) {
+	char szInfo[512] = {};
+	int ret = 0;
+
+	snprintf(szInfo, sizeof(szInfo), "ip link add dev %s type wireguard > /dev/null 2>&1", WG_IFNAME);
+	ret = std::system(szInfo);
+	if (ret < 0) {
+		spdlog::warn("<{}> failed(ret={}).", szInfo, ret);
+	}
+
+	snprintf(szInfo, sizeof(szInfo), "ip address replace dev %s %s/%d", WG_IFNAME, inet_ntoa(vpnIP), cidr);
+	ret = std::system(szInfo);
+	if (ret < 0) {
+		spdlog::warn("<{}> failed(ret={}).", szInfo, ret);
+	}
+
+	snprintf(szInfo, sizeof(szInfo), "ip link set up dev %s", WG_IFNAME);
+	ret = std::system(szInfo);
+	if (ret < 0) {
+		spdlog::warn("<{}> failed(ret={}).", szInfo, ret);
+	}
+
+	snprintf(szInfo, sizeof(szInfo), "wg set %s listen-port %d private-key %s",
+			WG_IFNAME, WG_CLIENT_PORT, WG_PRIVATE_KEY_FILE);
+	ret = std::system(szInfo);
+	if (ret < 0) {
+		spdlog::warn("<{}> failed(ret={}).", szInfo, ret);
+	}
+}
+
+/**
+ * Make the server the only peer of wg0. Nothing is sent if it is already there
+ * with the same allowed ip, endpoint and keepalive.
+ */
+bool WgacClient::configure_peer(const message_t* rmsg) {
+	wg_device_t dev {};
+	if (!_wgnl.get_device(WG_IFNAME, dev)) {
+		return false;
+	}
+	sodium_memzero(dev.private_key, sizeof(dev.private_key));
+
+	std::vector<wg_peer_change_t> changes;
+	bool in_sync = false;
+	for (const auto& peer : dev.peers) {
+		if (!std::memcmp(peer.public_key, rmsg->public_key, WG_KEY_LEN_BASE64 - 1)) {
+			in_sync = peer.allowedIPs == 1 && peer.cidr == 32 &&
+				peer.vpnIP.s_addr == rmsg->vpnIP.s_addr &&
+				peer.epIP.s_addr == rmsg->epIP.s_addr && peer.epPort == rmsg->epPort &&
+				peer.keepalive == WG_KEEPALIVE;
+		} else {
+			wg_peer_change_t change {};
+			change.op = wg_peer_change_t::Op::REMOVE;
+			std::memcpy(change.public_key, peer.public_key, WG_KEY_LEN_BASE64);
+			changes.push_back(change);
+		}
+	}
+
+	if (!in_sync) {
+		wg_peer_change_t change {};
+		change.op = wg_peer_change_t::Op::SET;
+		std::memcpy(change.public_key, rmsg->public_key, WG_KEY_LEN_BASE64);
+		change.public_key[WG_KEY_LEN_BASE64 - 1] = '\0';
+		change.vpnIP = rmsg->vpnIP;
+		change.epIP = rmsg->epIP;
+		change.epPort = rmsg->epPort;
+		change.keepalive = WG_KEEPALIVE;
+		changes.push_back(change);
+	}
+
+	if (changes.empty()) {
+		spdlog::info("--- wireguard peer is already up to date.");
+		return true;
+	}
+	return _wgnl.set_device(WG_IFNAME, nullptr, 0, changes);
+}
+
+/**
+ * Remove one peer from wg0
+ */
+bool WgacClient::unconfigure_peer(const message_t* rmsg) {
+	wg_peer_change_t change {};
+	change.op = wg_peer_change_t::Op::REMOVE;
+	std::memcpy(change.public_key, rmsg->public_key, WG_KEY_LEN_BASE64);
+	change.public_key[WG_KEY_LEN_BASE64 - 1] = '\0';
+	return _wgnl.set_device(WG_IFNAME, nullptr, 0, {change});
+}
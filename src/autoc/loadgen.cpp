@@ -0,0 +1,653 @@
+/*
+ * Load generator: virtual clients against a running wg_autod
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * usage: wg_autoc_loadgen --server <ip> [--port 51822] [--sessions N] [--concurrency C]
+ *                         [--rate R] [--think-ms T] [--timeout-ms T] [--threads N] [--json]
+ *                         [--pings N] [--bye-at-ms T]
+ *
+ * Every session is one virtual client(a synthetic MAC address and its own
+ * keypair) going through PREPARE(key exchange) -> HELLO -> PING -> BYE on a
+ * new connection, with the message codec and crypto of wg_autoc. Sessions
+ * are driven by non-blocking event loops(one per thread), at most C open
+ * at a time and at most R started per second. The latency of every stage
+ * and of the whole session is reported as p50/p99/p999.
+ *
+ * Each session holds a vpn address from HELLO to BYE, so a concurrency
+ * larger than the server pool is answered with NOKs.
+ *
+ * --pings repeats the PING stage(keepalive churn on open sessions), and
+ * --bye-at-ms holds every BYE until that time after the start, so sessions
+ * open together leave together(a mass BYE).
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sodium.h>
+#include "inc/client.h"
+#include "inc/common.h"
+#include "inc/parser.h"
+#include "inc/sodium_ae.h"
+#include "spdlog/spdlog.h"
+#include <boost/program_options.hpp>
+
+using steady_clock = std::chrono::steady_clock;
+
+/* stages of one session, STAGE_SESSION is the whole of it */
+enum STAGE { STAGE_PREPARE, STAGE_HELLO, STAGE_PING, STAGE_BYE, STAGE_SESSION, STAGE_MAX };
+
+static const char* stage_names[STAGE_MAX] = {"prepare", "hello", "ping", "bye", "session"};
+
+struct loadgen_options {
+	std::string server {"127.0.0.1"};
+	uint16_t port = 51822;
+	uint32_t sessions = 1000;            // in total
+	uint32_t concurrency = 100;          // sessions open at a time
+	double rate = 0;                     // sessions started per second, 0 = as fast as possible
+	uint32_t think_ms = 0;               // pause between the stages of a session
+	uint32_t timeout_ms = 5000;          // per stage
+	uint32_t threads = 1;
+	uint32_t pings = 1;                  // PING/PONG rounds per session
+	uint32_t bye_at_ms = 0;              // no BYE before this time after the start, 0 = none
+	bool json = false;
+};
+
+using loadgen_options_t = struct loadgen_options;
+
+struct stage_stats {
+	std::vector<uint64_t> ns;            // latency of every successful stage
+	uint64_t failed = 0;                 // NOK, timeout, reset or a bad frame
+	uint64_t nok = 0;                    // of which NOK replies
+};
+
+using stage_stats_t = struct stage_stats;
+
+/* one virtual client */
+struct vclient {
+	uint64_t id;
+	int fd = -1;
+	STAGE stage = STAGE_PREPARE;
+	bool connected = false;
+	bool thinking = false;               // waiting for the deadline to start stage
+	uint32_t pings = 0;                  // PONGs received
+	uint8_t mac_addr[6];
+	std::vector<unsigned char> public_key, secret_key, server_key;
+	char public_key_base64[WG_KEY_LEN_BASE64];
+	struct in_addr vpnIP {}, vpnNetmask {};
+	std::vector<uint8_t> rbuf, wbuf;
+	steady_clock::time_point sessionStart, stageStart, deadline;
+};
+
+using vclient_t = struct vclient;
+
+static volatile sig_atomic_t stopping = 0;
+static steady_clock::time_point run_start;
+
+static void on_signal(int) {
+	stopping = 1;
+}
+
+/*
+ * One event loop and its share of the sessions. Timers(think time and
+ * stage timeouts) are a min-heap of deadlines, stale entries are skipped.
+ */
+class Worker {
+public:
+	Worker(const loadgen_options_t& opt, uint32_t index, uint32_t sessions, uint32_t concurrency, double rate)
+		: _opt(opt), _index(index), _sessions(sessions), _concurrency(concurrency), _rate(rate) {}
+
+	bool run();
+
+	stage_stats_t _stats[STAGE_MAX];
+	uint64_t _ok = 0;
+	uint64_t _handshakes = 0;
+
+private:
+	void startSession(steady_clock::time_point now);
+	void beginStage(vclient_t& vc, STAGE stage, steady_clock::time_point now);
+	void nextStage(vclient_t& vc, STAGE stage, steady_clock::time_point now);
+	void finish(vclient_t& vc, bool ok, bool nok = false);
+	void onEvent(vclient_t& vc, uint32_t events);
+	bool onMessage(vclient_t& vc, const message_t& rmsg);
+	bool nextMessage(vclient_t& vc, message_t& rmsg, bool& bad_frame);
+	bool sendMessage(vclient_t& vc, AUTOCONN type);
+	bool flush(vclient_t& vc);
+	void record(STAGE stage, steady_clock::time_point start, steady_clock::time_point now);
+	void arm(vclient_t& vc, steady_clock::time_point deadline);
+	void watch(vclient_t& vc);
+
+	const loadgen_options_t& _opt;
+	uint32_t _index;
+	uint32_t _sessions, _concurrency;
+	double _rate;
+	uint32_t _started = 0;
+	int _epfd = -1;
+	struct sockaddr_in _serverAddr {};
+	std::unordered_map<uint64_t, std::unique_ptr<vclient_t>> _clients;
+
+	using timer_entry_t = std::pair<steady_clock::time_point, uint64_t>;
+	std::priority_queue<timer_entry_t, std::vector<timer_entry_t>, std::greater<timer_entry_t>> _timers;
+};
+
+bool Worker::run() {
+	_serverAddr.sin_family = AF_INET;
+	_serverAddr.sin_port = htons(_opt.port);
+	if (inet_pton(AF_INET, _opt.server.c_str(), &_serverAddr.sin_addr) != 1) {
+		spdlog::error("Invalid server address({}).", _opt.server);
+		return false;
+	}
+	_epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (_epfd < 0) {
+		spdlog::error("epoll_create1 failed: {}", strerror(errno));
+		return false;
+	}
+
+	const auto interval = std::chrono::duration_cast<steady_clock::duration>(
+			std::chrono::duration<double>(_rate > 0 ? 1.0 / _rate : 0));
+	auto nextStart = steady_clock::now();
+	struct epoll_event events[64];
+
+	while ((_started < _sessions || !_clients.empty()) && !stopping) {
+		auto now = steady_clock::now();
+		while (_started < _sessions && _clients.size() < _concurrency && now >= nextStart) {
+			startSession(now);
+			nextStart += interval;
+			if (_rate <= 0) nextStart = now;
+		}
+
+		/* sleep until the next timer or the next session start */
+		auto wake = now + std::chrono::seconds(1);
+		while (!_timers.empty()) {
+			auto it = _clients.find(_timers.top().second);
+			if (it == _clients.end() || it->second->deadline != _timers.top().first) {
+				_timers.pop();                     /* stale */
+				continue;
+			}
+			wake = std::min(wake, _timers.top().first);
+			break;
+		}
+		if (_started < _sessions && _clients.size() < _concurrency) {
+			wake = std::min(wake, nextStart);
+		}
+		const int timeout_ms = wake > now ? static_cast<int>(
+				std::chrono::ceil<std::chrono::milliseconds>(wake - now).count()) : 0;
+
+		const int n = epoll_wait(_epfd, events, 64, timeout_ms);
+		if (n < 0 && errno != EINTR) {
+			spdlog::error("epoll_wait failed: {}", strerror(errno));
+			break;
+		}
+		for (int i = 0; i < n; i++) {
+			auto it = _clients.find(events[i].data.u64);
+			if (it != _clients.end()) {
+				onEvent(*it->second, events[i].events);
+			}
+		}
+
+		now = steady_clock::now();
+		while (!_timers.empty() && _timers.top().first <= now) {
+			const timer_entry_t timer = _timers.top();
+			_timers.pop();
+			auto it = _clients.find(timer.second);
+			if (it == _clients.end() || it->second->deadline != timer.first) {
+				continue;
+			}
+			vclient_t& vc = *it->second;
+			if (vc.thinking) {
+				vc.thinking = false;
+				beginStage(vc, vc.stage, now);
+			} else {
+				spdlog::debug("session {}: {} timed out.", vc.id, stage_names[vc.stage]);
+				finish(vc, false);
+			}
+		}
+	}
+
+	for (auto& [id, vc] : _clients) {
+		::close(vc->fd);
+	}
+	_clients.clear();
+	::close(_epfd);
+	return true;
+}
+
+/**
+ * A new virtual client: MAC 02:4c:<id>, fresh keypair, non-blocking connect
+ */
+void Worker::startSession(steady_clock::time_point now) {
+	auto vc = std::make_unique<vclient_t>();
+	vc->id = (static_cast<uint64_t>(_index) << 32) | _started++;
+	const uint8_t mac[6] = {0x02, 0x4c, uint8_t(_index), uint8_t(vc->id >> 16),
+		uint8_t(vc->id >> 8), uint8_t(vc->id)};
+	std::memcpy(vc->mac_addr, mac, sizeof(mac));
+
+	vc->public_key.resize(crypto_box_PUBLICKEYBYTES);
+	vc->secret_key.resize(crypto_box_SECRETKEYBYTES);
+	crypto_box_keypair(vc->public_key.data(), vc->secret_key.data());
+	key_to_base64(vc->public_key_base64, vc->public_key.data());
+
+	vc->sessionStart = vc->stageStart = now;
+	vc->stage = STAGE_PREPARE;
+
+	vclient_t& ref = *vc;
+	_clients.emplace(ref.id, std::move(vc));
+
+	ref.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (ref.fd < 0) {
+		spdlog::warn("socket failed: {}", strerror(errno));
+		finish(ref, false);
+		return;
+	}
+	if (connect(ref.fd, (struct sockaddr*)&_serverAddr, sizeof(_serverAddr)) < 0 && errno != EINPROGRESS) {
+		spdlog::debug("session {}: connect failed: {}", ref.id, strerror(errno));
+		finish(ref, false);
+		return;
+	}
+	struct epoll_event ev {};
+	ev.events = EPOLLIN | EPOLLOUT;
+	ev.data.u64 = ref.id;
+	epoll_ctl(_epfd, EPOLL_CTL_ADD, ref.fd, &ev);
+	arm(ref, now + std::chrono::milliseconds(_opt.timeout_ms));
+}
+
+void Worker::arm(vclient_t& vc, steady_clock::time_point deadline) {
+	vc.deadline = deadline;
+	_timers.emplace(deadline, vc.id);
+}
+
+/* EPOLLOUT only while something is left to write */
+void Worker::watch(vclient_t& vc) {
+	struct epoll_event ev {};
+	ev.events = EPOLLIN | ((!vc.connected || !vc.wbuf.empty()) ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+	ev.data.u64 = vc.id;
+	epoll_ctl(_epfd, EPOLL_CTL_MOD, vc.fd, &ev);
+}
+
+void Worker::record(STAGE stage, steady_clock::time_point start, steady_clock::time_point now) {
+	_stats[stage].ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count());
+}
+
+/**
+ * The stage after a reply: right away, or after the think time(BYE: not before bye_at_ms)
+ */
+void Worker::nextStage(vclient_t& vc, STAGE stage, steady_clock::time_point now) {
+	vc.stage = stage;
+	auto start = now + std::chrono::milliseconds(_opt.think_ms);
+	if (stage == STAGE_BYE && _opt.bye_at_ms > 0) {
+		start = std::max(start, run_start + std::chrono::milliseconds(_opt.bye_at_ms));
+	}
+	if (start > now) {
+		vc.thinking = true;
+		arm(vc, start);
+		return;
+	}
+	beginStage(vc, stage, now);
+}
+
+void Worker::beginStage(vclient_t& vc, STAGE stage, steady_clock::time_point now) {
+	static const AUTOCONN request[STAGE_MAX] = {AUTOCONN::PREPARE, AUTOCONN::HELLO, AUTOCONN::PING, AUTOCONN::BYE};
+
+	vc.stage = stage;
+	vc.stageStart = now;
+	if (!sendMessage(vc, request[stage])) {
+		finish(vc, false);
+		return;
+	}
+	arm(vc, now + std::chrono::milliseconds(_opt.timeout_ms));
+}
+
+bool Worker::sendMessage(vclient_t& vc, AUTOCONN type) {
+	message_t smsg {};
+	smsg.type = type;
+	std::memcpy(smsg.mac_addr, vc.mac_addr, sizeof(smsg.mac_addr));
+	if (type != AUTOCONN::HELLO) {
+		smsg.vpnIP = vc.vpnIP;
+		smsg.vpnNetmask = vc.vpnNetmask;
+	}
+	std::memcpy(smsg.public_key, vc.public_key_base64, WG_KEY_LEN_BASE64);
+	inet_pton(AF_INET, "192.0.2.1", &smsg.epIP);
+	smsg.epPort = WG_CLIENT_PORT;
+	std::snprintf(reinterpret_cast<char*>(smsg.allowed_ips), sizeof(smsg.allowed_ips), "%s/32", inet_ntoa(vc.vpnIP));
+
+	const std::string total_s = convert_message2string(reinterpret_cast<unsigned char*>(&smsg), sizeof(message_t));
+#ifdef AUTHENTICATED_ENCRYPTION
+	std::vector<unsigned char> original_message(total_s.begin(), total_s.end());
+	std::vector<unsigned char> encrypted_message = sodium_ae::encrypt_message(original_message,
+			vc.server_key, vc.secret_key);
+	vc.wbuf.insert(vc.wbuf.end(), encrypted_message.begin(), encrypted_message.end());
+#else
+	vc.wbuf.insert(vc.wbuf.end(), total_s.begin(), total_s.end());
+#endif
+	return flush(vc);
+}
+
+bool Worker::flush(vclient_t& vc) {
+	while (!vc.wbuf.empty()) {
+		ssize_t n = ::send(vc.fd, vc.wbuf.data(), vc.wbuf.size(), MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+			if (errno == EINTR) continue;
+			return false;
+		}
+		vc.wbuf.erase(vc.wbuf.begin(), vc.wbuf.begin() + n);
+	}
+	watch(vc);
+	return true;
+}
+
+void Worker::onEvent(vclient_t& vc, uint32_t events) {
+	const uint64_t id = vc.id;                         /* vc is gone once finish()ed */
+	if (!vc.connected && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+		int err = 0;
+		socklen_t len = sizeof(err);
+		if (getsockopt(vc.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+			spdlog::debug("session {}: connect failed: {}", vc.id, strerror(err ? err : errno));
+			finish(vc, false);
+			return;
+		}
+		/* PREPARE: our public key in plain text, the server answers with its own */
+		vc.connected = true;
+		vc.wbuf.insert(vc.wbuf.end(), vc.public_key_base64, vc.public_key_base64 + WG_KEY_LEN_BASE64 - 1);
+		if (!flush(vc)) {
+			finish(vc, false);
+			return;
+		}
+	} else if (events & EPOLLOUT) {
+		if (!flush(vc)) {
+			finish(vc, false);
+			return;
+		}
+	}
+
+	if (!(events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+		return;
+	}
+
+	uint8_t chunk[MAX_PACKET_SIZE];
+	bool closed = false;
+	for (;;) {
+		ssize_t n = ::recv(vc.fd, chunk, sizeof(chunk), 0);
+		if (n > 0) {
+			vc.rbuf.insert(vc.rbuf.end(), chunk, chunk + n);
+			continue;
+		}
+		if (n < 0 && errno == EINTR) continue;
+		closed = (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK));
+		break;
+	}
+
+	const auto now = steady_clock::now();
+	if (vc.stage == STAGE_PREPARE && !vc.thinking) {
+		if (vc.rbuf.size() < WG_KEY_LEN_BASE64 - 1) {
+			if (closed) finish(vc, false);
+			return;
+		}
+		char server_pk_base64[WG_KEY_LEN_BASE64] {};
+		std::memcpy(server_pk_base64, vc.rbuf.data(), WG_KEY_LEN_BASE64 - 1);
+		vc.rbuf.erase(vc.rbuf.begin(), vc.rbuf.begin() + WG_KEY_LEN_BASE64 - 1);
+
+		vc.server_key.resize(crypto_box_PUBLICKEYBYTES);
+		if (!key_from_base64(vc.server_key.data(), server_pk_base64)) {
+			spdlog::debug("session {}: bad server public key.", vc.id);
+			finish(vc, false);
+			return;
+		}
+		record(STAGE_PREPARE, vc.stageStart, now);
+		nextStage(vc, STAGE_HELLO, now);
+		if (_clients.find(id) == _clients.end()) {
+			return;
+		}
+	}
+
+	message_t rmsg;
+	bool bad_frame = false;
+	while (nextMessage(vc, rmsg, bad_frame)) {
+		if (!onMessage(vc, rmsg) || _clients.find(id) == _clients.end()) {
+			return;
+		}
+	}
+	if (bad_frame || closed) {
+		spdlog::debug("session {}: {} in {}.", vc.id, bad_frame ? "bad frame" : "connection closed",
+				stage_names[vc.stage]);
+		finish(vc, false);
+	}
+}
+
+/**
+ * The reply of the current stage. Returns false once the session is finished.
+ */
+bool Worker::onMessage(vclient_t& vc, const message_t& rmsg) {
+	static const AUTOCONN reply[STAGE_MAX] = {AUTOCONN::PREPARE, AUTOCONN::HELLO, AUTOCONN::PONG, AUTOCONN::BYE};
+
+	if (vc.thinking || vc.stage == STAGE_PREPARE) {
+		return true;                                   /* nothing asked, nothing expected */
+	}
+	const auto now = steady_clock::now();
+	const uint64_t id = vc.id;
+	if (rmsg.type != reply[vc.stage]) {
+		spdlog::debug("session {}: unexpected reply({}) in {}.", vc.id, static_cast<int>(rmsg.type),
+				stage_names[vc.stage]);
+		finish(vc, false, rmsg.type == AUTOCONN::NOK);
+		return false;
+	}
+	record(vc.stage, vc.stageStart, now);
+
+	switch (vc.stage) {
+	case STAGE_HELLO:
+		vc.vpnIP = rmsg.vpnIP;
+		vc.vpnNetmask = rmsg.vpnNetmask;
+		nextStage(vc, STAGE_PING, now);
+		break;
+	case STAGE_PING:
+		if (vc.pings++ == 0) _handshakes++;
+		nextStage(vc, vc.pings < _opt.pings ? STAGE_PING : STAGE_BYE, now);
+		break;
+	default:
+		record(STAGE_SESSION, vc.sessionStart, now);
+		finish(vc, true);
+		return false;
+	}
+	return _clients.find(id) != _clients.end();
+}
+
+/**
+ * Cut one message out of the receive buffer, as WgacClient::nextMessage()
+ */
+bool Worker::nextMessage(vclient_t& vc, message_t& rmsg, bool& bad_frame) {
+	bad_frame = false;
+#ifdef AUTHENTICATED_ENCRYPTION
+	while (!vc.rbuf.empty()) {
+		std::vector<unsigned char> encrypted_message;
+		if (!sodium_ae::next_frame(vc.rbuf, encrypted_message, bad_frame)) {
+			return false;
+		}
+
+		bool decrypt_failure = false;
+		std::vector<unsigned char> decrypted_message = sodium_ae::decrypt_message(
+				encrypted_message, vc.server_key, vc.secret_key, decrypt_failure);
+		if (decrypt_failure) {
+			bad_frame = true;
+			return false;
+		}
+		std::string xbuf(decrypted_message.begin(), decrypted_message.end());
+#else
+	static const std::string last_field {"allowedips:="};
+	while (!vc.rbuf.empty()) {
+		auto field = std::search(vc.rbuf.begin(), vc.rbuf.end(), last_field.begin(), last_field.end());
+		auto eol = std::find(field, vc.rbuf.end(), '\n');
+		if (eol == vc.rbuf.end()) {
+			bad_frame = vc.rbuf.size() > MAX_PACKET_SIZE;
+			return false;
+		}
+		std::string xbuf(vc.rbuf.begin(), eol + 1);
+		vc.rbuf.erase(vc.rbuf.begin(), eol + 1);
+#endif
+		std::memset(&rmsg, 0, sizeof(rmsg));
+		if (!parser::parse_new_message_string(xbuf.data(), &rmsg)) {
+			bad_frame = true;
+			return false;
+		}
+		return true;
+	}
+	return false;
+}
+
+void Worker::finish(vclient_t& vc, bool ok, bool nok) {
+	if (ok) {
+		_ok++;
+	} else {
+		_stats[vc.stage].failed++;
+		_stats[STAGE_SESSION].failed++;
+		if (nok) _stats[vc.stage].nok++;
+	}
+	if (vc.fd >= 0) {
+		::close(vc.fd);                                /* also drops it from the epoll set */
+	}
+	const uint64_t id = vc.id;
+	_clients.erase(id);
+}
+
+/* nearest-rank percentile of sorted latencies, in ms */
+static double percentile_ms(const std::vector<uint64_t>& sorted, double q) {
+	if (sorted.empty()) {
+		return 0;
+	}
+	size_t rank = static_cast<size_t>(std::ceil(q * sorted.size()));
+	rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+	return sorted[rank - 1] / 1e6;
+}
+
+/* handshakes: clients that got their vpn address and passed the first PING */
+static void report(const loadgen_options_t& opt, stage_stats_t (&stats)[STAGE_MAX], uint64_t ok,
+		uint64_t handshakes, double elapsed_s) {
+	for (auto& s : stats) {
+		std::sort(s.ns.begin(), s.ns.end());
+	}
+	const double pings = stats[STAGE_PING].ns.size();
+
+	if (opt.json) {
+		printf("{\n  \"loadgen\": \"wg_autoc_loadgen\",\n  \"server\": \"%s:%u\",\n"
+				"  \"sessions\": %u,\n  \"concurrency\": %u,\n  \"rate\": %.1f,\n  \"think_ms\": %u,\n"
+				"  \"threads\": %u,\n  \"pings\": %u,\n  \"bye_at_ms\": %u,\n  \"elapsed_s\": %.3f,\n"
+				"  \"ok\": %lu,\n  \"failed\": %lu,\n  \"sessions_per_sec\": %.1f,\n"
+				"  \"handshakes_per_sec\": %.1f,\n  \"pings_per_sec\": %.1f,\n  \"stages\": {",
+				opt.server.c_str(), opt.port, opt.sessions, opt.concurrency, opt.rate, opt.think_ms,
+				opt.threads, opt.pings, opt.bye_at_ms, elapsed_s, ok, stats[STAGE_SESSION].failed,
+				ok / elapsed_s, handshakes / elapsed_s, pings / elapsed_s);
+		for (int s = 0; s < STAGE_MAX; s++) {
+			const auto& st = stats[s];
+			printf("%s\n    \"%s\": {\"count\": %zu, \"failed\": %lu, \"nok\": %lu, \"p50_ms\": %.3f, "
+					"\"p99_ms\": %.3f, \"p999_ms\": %.3f, \"max_ms\": %.3f}",
+					s ? "," : "", stage_names[s], st.ns.size(), st.failed, st.nok,
+					percentile_ms(st.ns, 0.50), percentile_ms(st.ns, 0.99), percentile_ms(st.ns, 0.999),
+					st.ns.empty() ? 0 : st.ns.back() / 1e6);
+		}
+		printf("\n  }\n}\n");
+		return;
+	}
+
+	printf("%lu/%u sessions ok in %.2f s: %.1f sessions/s, %.1f handshakes/s, %.1f pings/s"
+			"(concurrency %u, %u threads)\n", ok, opt.sessions, elapsed_s, ok / elapsed_s,
+			handshakes / elapsed_s, pings / elapsed_s, opt.concurrency, opt.threads);
+	printf("%-8s %8s %7s %7s %9s %9s %9s %9s\n", "stage", "count", "failed", "nok",
+			"p50_ms", "p99_ms", "p999_ms", "max_ms");
+	for (int s = 0; s < STAGE_MAX; s++) {
+		const auto& st = stats[s];
+		printf("%-8s %8zu %7lu %7lu %9.3f %9.3f %9.3f %9.3f\n", stage_names[s], st.ns.size(), st.failed, st.nok,
+				percentile_ms(st.ns, 0.50), percentile_ms(st.ns, 0.99), percentile_ms(st.ns, 0.999),
+				st.ns.empty() ? 0 : st.ns.back() / 1e6);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	namespace po = boost::program_options;
+	loadgen_options_t opt;
+
+	try {
+		po::options_description desc("Allowed options");
+		desc.add_options()
+			("help", "Print help message")
+			("server", po::value<std::string>(&opt.server), "Server ip address(default 127.0.0.1)")
+			("port", po::value<uint16_t>(&opt.port), "Server port(default 51822)")
+			("sessions", po::value<uint32_t>(&opt.sessions), "Virtual client sessions in total(default 1000)")
+			("concurrency", po::value<uint32_t>(&opt.concurrency), "Sessions open at a time(default 100)")
+			("rate", po::value<double>(&opt.rate), "Sessions started per second(default 0, unlimited)")
+			("think-ms", po::value<uint32_t>(&opt.think_ms), "Pause between the stages of a session(default 0)")
+			("timeout-ms", po::value<uint32_t>(&opt.timeout_ms), "Reply timeout of a stage(default 5000)")
+			("threads", po::value<uint32_t>(&opt.threads), "Event loop threads(default 1)")
+			("pings", po::value<uint32_t>(&opt.pings), "PING rounds per session(default 1)")
+			("bye-at-ms", po::value<uint32_t>(&opt.bye_at_ms), "Hold every BYE until this time after the start(default 0)")
+			("json", "Print the report as JSON")
+			("debug", "Log the failure of every session");
+
+		po::variables_map vm;
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+
+		if (vm.count("help")) {
+			std::cout << desc << std::endl;
+			return EXIT_SUCCESS;
+		}
+		opt.json = vm.count("json") > 0;
+		spdlog::set_level(vm.count("debug") ? spdlog::level::debug : spdlog::level::warn);
+	} catch (po::error& e) {
+		std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (opt.sessions == 0 || opt.concurrency == 0 || opt.threads == 0 || opt.pings == 0) {
+		std::cerr << "ERROR: sessions, concurrency, threads and pings must be positive" << std::endl;
+		return EXIT_FAILURE;
+	}
+	opt.threads = std::min(opt.threads, std::min(opt.sessions, opt.concurrency));
+
+	sodium_ae::initialize_sodium();
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	/* sessions, concurrency and rate split evenly over the threads */
+	std::vector<std::unique_ptr<Worker>> workers;
+	for (uint32_t i = 0; i < opt.threads; i++) {
+		const uint32_t sessions = opt.sessions / opt.threads + (i < opt.sessions % opt.threads);
+		const uint32_t concurrency = opt.concurrency / opt.threads + (i < opt.concurrency % opt.threads);
+		workers.push_back(std::make_unique<Worker>(opt, i, sessions, concurrency, opt.rate / opt.threads));
+	}
+
+	run_start = steady_clock::now();
+	std::vector<std::thread> threads;
+	for (auto& worker : workers) {
+		threads.emplace_back(&Worker::run, worker.get());
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	const double elapsed_s = std::chrono::duration<double>(steady_clock::now() - run_start).count();
+
+	stage_stats_t stats[STAGE_MAX];
+	uint64_t ok = 0, handshakes = 0;
+	for (auto& worker : workers) {
+		ok += worker->_ok;
+		handshakes += worker->_handshakes;
+		for (int s = 0; s < STAGE_MAX; s++) {
+			stats[s].ns.insert(stats[s].ns.end(), worker->_stats[s].ns.begin(), worker->_stats[s].ns.end());
+			stats[s].failed += worker->_stats[s].failed;
+			stats[s].nok += worker->_stats[s].nok;
+		}
+	}
+	report(opt, stats, ok, handshakes, elapsed_s);
+	return ok == opt.sessions ? EXIT_SUCCESS : EXIT_FAILURE;
+}
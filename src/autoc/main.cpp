@@ -6,7 +6,6 @@
  */
 
 #include <iostream>
-#include <signal.h>
 #include "inc/client.h"
 #include "inc/configuration.h"
 #include "inc/sodium_ae.h"
@@ -19,40 +18,6 @@ const std::string prog_name { "wg_autoc" };
 const std::string versionString { "v0.8.90" };
 ////////////////////////////////////////////////////////////
 
-static void sig_exit(int s) {
-	wgaccPtr->send_bye_message();
-	sleep(1);
-
-	spdlog::info("Closing {}...", prog_name);
-	pipe_ret_t finishRet = wgaccPtr->close();
-	if (finishRet.isSuccessful()) {
-		spdlog::info("--- Client closed.");
-	} else {
-		spdlog::error("Failed to close {}.", prog_name);
-	}
-	std::_Exit(EXIT_SUCCESS);
-}
-
-auto last_processed = std::chrono::steady_clock::now();
-const auto interval = std::chrono::milliseconds(1000);
-
-static void sig_usr1(int s) {
-	auto now = std::chrono::steady_clock::now();
-	if (now - last_processed <= interval) {
-		last_processed = now;
-		std::cout << "Too fast SIGUSR1 signal is ignored.\n";
-		return;
-	}
-
-	last_processed = now;
-
-	if (!wgaccPtr->isConnected() || wgaccPtr->isWireguardReady()) {
-		wgaccPtr->setRestart(true);
-	} else {
-		std::cout << "SIGUSR1 signal is ignored.\n";
-	}
-}
-
 static int do_fork() {
 	int status = 0;
 
@@ -98,7 +63,6 @@ static void redirect_fds() {
 int main(int argc, char* argv[]) {
 	bool daemonize = false;
 	namespace po = boost::program_options;
-	unsigned short wgac_server_port {51822};
 
 	//Creates a smart pointer for an instance of the client class.
 	wgaccPtr = std::make_unique<WgacClient>();
@@ -114,7 +78,7 @@ int main(int argc, char* argv[]) {
 			("version", "Show version")
 			("daemon", "Detach from the terminal(run it in background)")
 			("foreground", "Run it in foreground")
-			("server", po::value<std::string>(),"Specify the server ip address")
+			("server", po::value<std::string>(),"Specify the server ip address(es or host names, comma separated)")
 			("config", po::value<std::string>(),"Set path to custom configuration file");
 
 		po::variables_map vm;
@@ -136,19 +100,19 @@ int main(int argc, char* argv[]) {
 			daemonize = true;
 		}
 
-		if (vm.count("server")) {
-			wgaccPtr->setServerIp(vm["server"].as<std::string>());
-		} else {
-			spdlog::error("Server ip addres is not specified.");
-			return EXIT_FAILURE;
-		}
-
 		if (vm.count("config")) {
 			wgaccPtr->getConfig().parse(vm["config"].as<std::string>());
 		} else {
 			spdlog::error("Configuration file is not specified.");
 			return EXIT_FAILURE;
 		}
+
+		if (vm.count("server")) {
+			wgaccPtr->setServerIp(vm["server"].as<std::string>());
+		} else if (!wgaccPtr->getConfig().contains("servers")) {
+			spdlog::error("Server ip addres is not specified.");
+			return EXIT_FAILURE;
+		}
 	} catch (po::error& e) {
 		std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
 		exit(EXIT_FAILURE);
@@ -183,11 +147,6 @@ int main(int argc, char* argv[]) {
 		}
 	}
 
-	::signal(SIGINT, sig_exit);
-	::signal(SIGQUIT, sig_exit);
-	::signal(SIGTERM, sig_exit);
-	::signal(SIGUSR1, sig_usr1);
-
 	// Initialize libsodium
 	sodium_ae::initialize_sodium();
 
@@ -209,51 +168,10 @@ int main(int argc, char* argv[]) {
 		wgaccPtr->setPrepareSecretKey(key);
 	}
 
-	while (1) {
-		// connect client to an wireguard auto connection server
-		bool connected = false;
-		while (!connected) {
-			if (wgaccPtr->getConfig().getint("server_port") >= 1024 &&
-					wgaccPtr->getConfig().getint("server_port") < 65536) {
-				wgac_server_port = wgaccPtr->getConfig().getint("server_port");
-			}
-			pipe_ret_t connectRet = wgaccPtr->connectTo(wgaccPtr->getServerIp(), wgac_server_port);
-			connected = connectRet.isSuccessful();
-			if (connected) {
-				spdlog::info("--- Client connected successfully");
-			} else {
-				spdlog::info("--- Client failed to connect: {}", connectRet.message());
-				sleep(2);
-				spdlog::info("--- Retrying to connect...");
-			}
-		};
-
-		// start PING-PONG protocol(core routine)
-		wgaccPtr->start();
-
-		// Wait until a restart request is coming
-		while (!wgaccPtr->shouldRestart()) {
-			std::this_thread::sleep_for(std::chrono::seconds(1));
-		}
-		wgaccPtr->setRestart(false);
-
-		if (wgaccPtr->isClosed()) {
-			spdlog::info("--- Client is already closed");
-			std::this_thread::sleep_for(std::chrono::seconds(2));
-			spdlog::info("--- OK, Let's reconnect to the AutoConnect server.");
-		} else {
-			wgaccPtr->send_bye_message();
-			std::this_thread::sleep_for(std::chrono::seconds(1));
-			pipe_ret_t finishRet = wgaccPtr->close();
-			if (finishRet.isSuccessful()) {
-				spdlog::info("--- Client is closed");
-				std::this_thread::sleep_for(std::chrono::seconds(2));
-				spdlog::info("--- OK, Let's reconnect to the AutoConnect server.");
-			} else {
-				spdlog::error("Client connection closing is failed.");
-				break;
-			}
-		}
+	// connect to the AutoConnect server and run the protocol until SIGINT/SIGTERM/SIGQUIT.
+	// SIGUSR1 makes it say BYE and connect again.
+	if (!wgaccPtr->run()) {
+		return EXIT_FAILURE;
 	}
 
 	return 0;
@@ -0,0 +1,115 @@
+/*
+ * Network identity of this host: primary interface, MAC and endpoint address.
+ * Looked up once and refreshed on rtnetlink link/address/route events.
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cstring>
+#include <net/if.h>
+#include <sys/epoll.h>
+#include <linux/rtnetlink.h>
+#include "inc/client.h"
+#include "spdlog/spdlog.h"
+
+/**
+ * Primary interface: this_interface in the config, else the interface of the default route.
+ * Endpoint address: this_endpoint_ip in the config, else the first address of the primary interface.
+ */
+bool WgacClient::refresh_netif() {
+	netif_t netif {};
+
+	if (_config.contains("this_interface")) {
+		netif.ifname = _config.getstr("this_interface");
+		netif.ifindex = _rtnl.link_index(netif.ifname);
+	} else if (_rtnl.get_default_route(netif.ifindex)) {
+		char ifname[IF_NAMESIZE] {};
+		if (if_indextoname(netif.ifindex, ifname)) {
+			netif.ifname = ifname;
+		}
+	}
+	if (netif.ifindex == 0) {
+		spdlog::warn("No primary interface found(no default route, set this_interface).");
+	} else if (!_rtnl.get_link_address(netif.ifindex, netif.mac_addr)) {
+		spdlog::warn("Can't get the mac address of {}.", netif.ifname);
+	}
+
+	if (_config.contains("this_endpoint_ip")) {
+		if (inet_pton(AF_INET, _config.getstr("this_endpoint_ip").c_str(), &netif.epIP) != 1) {
+			spdlog::warn("inet_pton(this_endpoint_ip) failed.");
+		}
+	} else if (netif.ifindex != 0) {
+		std::vector<ipv4_prefix_t> addrs;
+		if (_rtnl.get_ipv4_addresses(netif.ifindex, addrs) && !addrs.empty()) {
+			netif.epIP = addrs.front().addr;
+		}
+	}
+	netif.epPort = _config.getint("this_endpoint_port");
+
+	const bool changed = (netif.ifindex != _netif.ifindex || netif.epIP.s_addr != _netif.epIP.s_addr ||
+			std::memcmp(netif.mac_addr, _netif.mac_addr, sizeof(netif.mac_addr)) != 0);
+	_netif = netif;
+	if (changed) {
+		spdlog::info("--- Primary interface {}, macaddr {:02X}-{:02X}-{:02X}-{:02X}-{:02X}-{:02X}, endpoint {}:{}",
+				_netif.ifname.empty() ? "-" : _netif.ifname,
+				_netif.mac_addr[0], _netif.mac_addr[1], _netif.mac_addr[2],
+				_netif.mac_addr[3], _netif.mac_addr[4], _netif.mac_addr[5],
+				inet_ntoa(_netif.epIP), _netif.epPort);
+	}
+	return _netif.ifindex != 0 && _netif.epIP.s_addr != 0;
+}
+
+/**
+ * Listen to link, IPv4 address and IPv4 route changes on the event loop
+ */
+bool WgacClient::open_netif_events() {
+	if (!_rtnlEvents.open(NETLINK_ROUTE, RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV4_ROUTE)) {
+		spdlog::warn("No rtnetlink events, the network identity is not refreshed.");
+		return false;
+	}
+
+	struct epoll_event ev {};
+	ev.events = EPOLLIN;
+	ev.data.fd = _rtnlEvents.fd();
+	epoll_ctl(_epollfd, EPOLL_CTL_ADD, _rtnlEvents.fd(), &ev);
+	return true;
+}
+
+/**
+ * Refresh the cache if an event concerns the primary interface or the default route.
+ * Events of other interfaces(e.g. wg0 being configured) are ignored.
+ */
+void WgacClient::onNetlink() {
+	bool refresh = false;
+	const bool complete = _rtnlEvents.drain([&](const struct nlmsghdr* nlh) {
+		switch (nlh->nlmsg_type) {
+			case RTM_NEWLINK:
+			case RTM_DELLINK: {
+				const struct ifinfomsg* ifi = reinterpret_cast<const struct ifinfomsg*>(NLMSG_DATA(nlh));
+				refresh = refresh || ifi->ifi_index == _netif.ifindex ||
+					(_netif.ifindex == 0 && nlh->nlmsg_type == RTM_NEWLINK);
+				break;
+			}
+			case RTM_NEWADDR:
+			case RTM_DELADDR: {
+				const struct ifaddrmsg* ifa = reinterpret_cast<const struct ifaddrmsg*>(NLMSG_DATA(nlh));
+				refresh = refresh || static_cast<int>(ifa->ifa_index) == _netif.ifindex;
+				break;
+			}
+			case RTM_NEWROUTE:
+			case RTM_DELROUTE: {
+				const struct rtmsg* rtm = reinterpret_cast<const struct rtmsg*>(NLMSG_DATA(nlh));
+				refresh = refresh || (rtm->rtm_dst_len == 0 && rtm->rtm_table == RT_TABLE_MAIN);
+				break;
+			}
+			default:
+				break;
+		}
+	});
+
+	if (refresh || !complete) {
+		spdlog::debug("--- Network change, refreshing the primary interface.");
+		refresh_netif();
+	}
+}
@@ -0,0 +1,120 @@
+/*
+ * Netlink socket routines
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "inc/nl_message.h"
+#include "spdlog/spdlog.h"
+
+bool NlSocket::open(int protocol, uint32_t groups) {
+	if (isOpen()) {
+		return true;
+	}
+
+	_sockfd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol);
+	if (_sockfd < 0) {
+		spdlog::warn("netlink socket failed: {}", strerror(errno));
+		return false;
+	}
+
+	struct sockaddr_nl local {};
+	local.nl_family = AF_NETLINK;
+	local.nl_groups = groups;
+	if (bind(_sockfd, reinterpret_cast<struct sockaddr*>(&local), sizeof(local)) < 0) {
+		spdlog::warn("netlink bind failed: {}", strerror(errno));
+		close();
+		return false;
+	}
+	return true;
+}
+
+void NlSocket::close() {
+	if (_sockfd >= 0) {
+		::close(_sockfd);
+		_sockfd = -1;
+	}
+}
+
+/**
+ * Send one request and wait for its ACK(or the end of a dump). Replies other
+ * than the ACK are passed to the handler.
+ */
+bool NlSocket::transact(std::vector<uint8_t>& buf,
+		const std::function<void(const struct nlmsghdr*)>& handler) {
+	struct nlmsghdr* nlh = reinterpret_cast<struct nlmsghdr*>(buf.data());
+	nlh->nlmsg_len = buf.size();
+	nlh->nlmsg_flags |= NLM_F_ACK;
+	nlh->nlmsg_seq = ++_seq;
+
+	struct sockaddr_nl kernel {};
+	kernel.nl_family = AF_NETLINK;
+	if (sendto(_sockfd, buf.data(), buf.size(), 0,
+				reinterpret_cast<struct sockaddr*>(&kernel), sizeof(kernel)) < 0) {
+		spdlog::warn("netlink sendto failed: {}", strerror(errno));
+		return false;
+	}
+
+	std::vector<uint8_t> rbuf(NL_BUFFER_SIZE);
+	while (1) {
+		ssize_t len = recv(_sockfd, rbuf.data(), rbuf.size(), 0);
+		if (len < 0) {
+			if (errno == EINTR) continue;
+			spdlog::warn("netlink recv failed: {}", strerror(errno));
+			return false;
+		}
+
+		for (struct nlmsghdr* r = reinterpret_cast<struct nlmsghdr*>(rbuf.data());
+				NLMSG_OK(r, len); r = NLMSG_NEXT(r, len)) {
+			if (r->nlmsg_seq != _seq) continue;
+
+			if (r->nlmsg_type == NLMSG_ERROR) {
+				const struct nlmsgerr* err = reinterpret_cast<const struct nlmsgerr*>(NLMSG_DATA(r));
+				if (err->error != 0) {
+					spdlog::debug("netlink request failed: {}", strerror(-err->error));
+					return false;
+				}
+				return true;
+			} else if (r->nlmsg_type == NLMSG_DONE) {
+				int error = 0;
+				if (r->nlmsg_len >= NLMSG_LENGTH(sizeof(error))) {
+					std::memcpy(&error, NLMSG_DATA(r), sizeof(error));
+				}
+				if (error != 0) {
+					spdlog::debug("netlink dump failed: {}", strerror(-error));
+					return false;
+				}
+				return true;
+			} else if (handler) {
+				handler(r);
+			}
+		}
+	}
+}
+
+/**
+ * Read the notifications pending on a socket bound to multicast groups.
+ * Returns false if some were lost(ENOBUFS) or on error, the caller has to resync.
+ */
+bool NlSocket::drain(const std::function<void(const struct nlmsghdr*)>& handler) {
+	std::vector<uint8_t> rbuf(NL_BUFFER_SIZE);
+	while (1) {
+		ssize_t len = recv(_sockfd, rbuf.data(), rbuf.size(), MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+			spdlog::debug("netlink recv failed: {}", strerror(errno));
+			return false;
+		}
+
+		for (struct nlmsghdr* r = reinterpret_cast<struct nlmsghdr*>(rbuf.data());
+				NLMSG_OK(r, len); r = NLMSG_NEXT(r, len)) {
+			handler(r);
+		}
+	}
+}
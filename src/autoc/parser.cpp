@@ -64,9 +64,10 @@ std::vector<std::string> splitString(const std::string& str, const std::string&
  *   publickey:=01234567890123456789012345678901234567890123\n
  *   epip:=192.168.1.1\n
  *   epport:=51280\n
+ *   retryafter:=10\n                 (optional, NOK only)
  *   allowedips:=10.1.1.0/24,192.168.1.0\n
 */
-bool parse_new_message_string(char* rbuf, message_t* rmsg) {
+bool parse_new_message_string(char* rbuf, message_t* rmsg, uint32_t* retry_after) {
 	std::string text = rbuf;
 	std::string delimiter = "\n";
 	std::vector<std::string> msgtokens = splitString(text, delimiter);
@@ -75,6 +76,10 @@ bool parse_new_message_string(char* rbuf, message_t* rmsg) {
 	for (const auto& token : msgtokens) {
 		if (token == "") break;
 		std::vector<std::string> msgFields = splitString(token, ":=");
+		if (msgFields.size() != 2) {
+			flag = false;
+			continue;
+		}
 
 		if (msgFields[0] == "cmd") {
 			if (msgFields[1] == "HELLO") rmsg->type = AUTOCONN::HELLO;				
@@ -83,6 +88,7 @@ bool parse_new_message_string(char* rbuf, message_t* rmsg) {
 			else if (msgFields[1] == "OK") rmsg->type = AUTOCONN::OK;				
 			else if (msgFields[1] == "NOK") rmsg->type = AUTOCONN::NOK;				
 			else if (msgFields[1] == "BYE") rmsg->type = AUTOCONN::BYE;				
+			else if (msgFields[1] == "JOIN") rmsg->type = AUTOCONN::JOIN;
 			else flag = false;
 
 		} else if (msgFields[0] == "macaddr") {
@@ -121,7 +127,11 @@ bool parse_new_message_string(char* rbuf, message_t* rmsg) {
 			int len = msgFields[1].length();
 			const uint8_t* p = reinterpret_cast<const uint8_t*>(msgFields[1].c_str());
 			std::memset(rmsg->public_key, 0, WG_KEY_LEN_BASE64);
-			std::memcpy(rmsg->public_key, p, len);
+			if (len < WG_KEY_LEN_BASE64) {
+				std::memcpy(rmsg->public_key, p, len);
+			} else {
+				flag = false;
+			}
 
 		} else if (msgFields[0] == "epip") {
 			if (inet_pton(AF_INET, msgFields[1].c_str(), &(rmsg->epIP)) <= 0) {
@@ -136,6 +146,14 @@ bool parse_new_message_string(char* rbuf, message_t* rmsg) {
 				flag = false;
 			}
 
+		} else if (msgFields[0] == "retryafter") {
+			uint16_t num;
+			if (stringToUint16(msgFields[1], num)) {
+				if (retry_after) *retry_after = num;
+			} else {
+				flag = false;
+			}
+
 		} else if (msgFields[0] == "allowedips") {
 			int len = msgFields[1].length();
 			const uint8_t* p = reinterpret_cast<const uint8_t*>(msgFields[1].c_str());
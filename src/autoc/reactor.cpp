@@ -0,0 +1,392 @@
+/*
+ * Event loop of the autoconnect client(epoll + timerfd + signalfd)
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cstring>
+#include <algorithm>
+#include <csignal>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sodium.h>
+#include "inc/client.h"
+#include "spdlog/spdlog.h"
+
+#define EPOLL_MAX_EVENTS 8
+
+/**
+ * Create the epoll instance with a timer and the signals as file descriptors.
+ * The signals are blocked, so they are only seen through the signalfd.
+ */
+bool WgacClient::initializeReactor() {
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGQUIT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
+	if (sigprocmask(SIG_BLOCK, &mask, nullptr) < 0) {
+		spdlog::error("sigprocmask failed: {}", strerror(errno));
+		return false;
+	}
+
+	_signalfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	_epollfd = epoll_create1(EPOLL_CLOEXEC);
+	if (_signalfd < 0 || _timerfd < 0 || _epollfd < 0) {
+		spdlog::error("Failed to create the event loop: {}", strerror(errno));
+		closeReactor();
+		return false;
+	}
+
+	struct epoll_event ev {};
+	ev.events = EPOLLIN;
+	ev.data.fd = _signalfd;
+	epoll_ctl(_epollfd, EPOLL_CTL_ADD, _signalfd, &ev);
+	ev.data.fd = _timerfd;
+	epoll_ctl(_epollfd, EPOLL_CTL_ADD, _timerfd, &ev);
+	return true;
+}
+
+void WgacClient::closeReactor() {
+	_rtnlEvents.close();
+	for (int* fd : {&_epollfd, &_timerfd, &_signalfd}) {
+		if (*fd >= 0) {
+			::close(*fd);
+			*fd = -1;
+		}
+	}
+}
+
+/**
+ * One deadline at a time: connect, request reply, retry or reconnect delay
+ */
+void WgacClient::armTimer(uint32_t ms) {
+	struct itimerspec its {};
+	its.it_value.tv_sec = ms / 1000;
+	its.it_value.tv_nsec = (ms % 1000) * 1000000L;
+	if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+		its.it_value.tv_nsec = 1;   /* 0 would disarm it */
+	}
+	timerfd_settime(_timerfd, 0, &its, nullptr);
+}
+
+void WgacClient::disarmTimer() {
+	struct itimerspec its {};
+	timerfd_settime(_timerfd, 0, &its, nullptr);
+}
+
+/**
+ * Wait for EPOLLOUT only while connecting or while something is left to write
+ */
+void WgacClient::updateSocketEvents() {
+	if (_epollfd < 0 || _isClosed) {
+		return;
+	}
+
+	struct epoll_event ev {};
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	if (_session == SESSION::CONNECTING || !_wbuf.empty()) {
+		ev.events |= EPOLLOUT;
+	}
+	ev.data.fd = _sockfd.get();
+	epoll_ctl(_epollfd, EPOLL_CTL_MOD, _sockfd.get(), &ev);
+}
+
+/**
+ * Decorrelated jitter: min(cap, random(base, 3 * previous delay)), so that
+ * clients which failed together do not come back together.
+ * A retry-after hint of the server is a lower bound, with jitter on top of it
+ * (still at most the cap).
+ */
+uint32_t WgacClient::nextBackoff() {
+	uint64_t upper = _backoffMs ? static_cast<uint64_t>(_backoffMs) * 3 : _backoffBaseMs;
+	upper = std::min<uint64_t>(std::max<uint64_t>(upper, _backoffBaseMs), _backoffCapMs);
+	uint32_t delay = _backoffBaseMs + randombytes_uniform(upper - _backoffBaseMs + 1);
+	_backoffMs = delay;
+
+	if (_retryAfterMs > delay) {
+		delay = std::min(_retryAfterMs + randombytes_uniform(_retryAfterMs / 2 + 1), _backoffCapMs);
+	}
+	_retryAfterMs = 0;
+	return delay;
+}
+
+/**
+ * Backoff of a reconnect, held back further once the reconnect budget is spent
+ */
+uint32_t WgacClient::reconnectDelay() {
+	uint32_t delay = nextBackoff();
+	if (_reconnectBudget > 0) {
+		const auto now = std::chrono::steady_clock::now();
+		std::chrono::duration<double, std::milli> elapsed = now - _budgetStamp;
+		_budgetStamp = now;
+		_budgetTokens = std::min<double>(_reconnectBudget, _budgetTokens + elapsed.count() / _backoffCapMs);
+		_budgetTokens -= 1;
+		if (_budgetTokens < 0) {
+			delay = std::max(delay, static_cast<uint32_t>(-_budgetTokens * _backoffCapMs));
+		}
+	}
+	spdlog::info("--- Reconnecting in {} ms.", delay);
+	return delay;
+}
+
+void WgacClient::resetBackoff() {
+	_backoffMs = 0;
+	_retryAfterMs = 0;
+	_retryCount = 0;
+}
+
+/**
+ * Close the connection and schedule the next one
+ */
+void WgacClient::disconnect(int reconnectMs) {
+	closeAttempts();
+	if (!_isClosed) {
+		epoll_ctl(_epollfd, EPOLL_CTL_DEL, _sockfd.get(), nullptr);
+		pipe_ret_t finishRet = close();
+		if (finishRet.isSuccessful()) {
+			spdlog::info("--- Client is closed");
+		}
+	}
+	_session = SESSION::DISCONNECTED;
+
+	if (_terminate || reconnectMs < 0) {
+		disarmTimer();
+	} else if (reconnectMs == 0) {
+		spdlog::info("--- OK, Let's reconnect to the AutoConnect server.");
+		beginConnect();
+	} else {
+		armTimer(reconnectMs);
+	}
+}
+
+/**
+ * SIGUSR1: say BYE and connect again. Ignored while a handshake is in flight.
+ */
+void WgacClient::restart() {
+	const auto now = std::chrono::steady_clock::now();
+	if (now - _lastRestart <= std::chrono::milliseconds(1000)) {
+		_lastRestart = now;
+		spdlog::info("Too fast SIGUSR1 signal is ignored.");
+		return;
+	}
+	_lastRestart = now;
+
+	if (_session == SESSION::DISCONNECTED) {
+		spdlog::info("--- OK, Let's reconnect to the AutoConnect server.");
+		beginConnect();
+	} else if (_session == SESSION::ESTABLISHED) {
+		_reconnect = true;
+		if (send_bye_message()) {
+			_session = SESSION::BYE_WAIT;
+			armTimer(_requestTimeoutMs);
+		} else {
+			disconnect(0);
+		}
+	} else {
+		spdlog::info("SIGUSR1 signal is ignored.");
+	}
+}
+
+void WgacClient::onSignal() {
+	struct signalfd_siginfo info;
+	while (read(_signalfd, &info, sizeof(info)) == sizeof(info)) {
+		if (info.ssi_signo == SIGUSR1) {
+			restart();
+			continue;
+		}
+
+		if (_terminate) continue;
+		spdlog::info("Closing wg_autoc...");
+		_terminate = true;
+
+		/* BYE needs the session key, i.e. the key exchange must be over */
+		const bool can_say_bye = (_session == SESSION::JOIN_WAIT ||
+				_session == SESSION::HELLO_WAIT || _session == SESSION::PING_WAIT ||
+				_session == SESSION::RETRY_WAIT || _session == SESSION::ESTABLISHED);
+		if (can_say_bye && send_bye_message()) {
+			_session = SESSION::BYE_WAIT;
+			armTimer(_requestTimeoutMs);
+		} else if (_session != SESSION::BYE_WAIT) {
+			disconnect(-1);
+		}
+	}
+}
+
+void WgacClient::onTimer() {
+	uint64_t expirations;
+	if (read(_timerfd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+		return;
+	}
+
+	if (_awaitingServerKey && _session != SESSION::DISCONNECTED && _session != SESSION::CONNECTING) {
+		spdlog::error("Server public key reception failed");
+		note_server_failure(_server_ip);
+		disconnect(reconnectDelay());
+		return;
+	}
+
+	switch (_session) {
+		case SESSION::DISCONNECTED:
+			spdlog::info("--- Retrying to connect...");
+			beginConnect();
+			break;
+		case SESSION::CONNECTING:
+			onRaceTimer();
+			break;
+		case SESSION::KEY_EXCHANGE:
+			break;
+		case SESSION::JOIN_WAIT:
+			if (!_joinHello) {
+				/*
+				 * An old server drops the unknown command and stops reading this connection,
+				 * a busy one is just slow: the next connection only uses HELLO/PING.
+				 */
+				spdlog::info("--- No reply to JOIN, HELLO/PING on the next connection.");
+				_joinFallback = true;
+				disconnect(reconnectDelay());
+			} else {
+				request_failed("timeout");
+			}
+			break;
+		case SESSION::HELLO_WAIT:
+		case SESSION::PING_WAIT:
+			request_failed("timeout");
+			break;
+		case SESSION::RETRY_WAIT:
+			send_first_request();
+			break;
+		case SESSION::BYE_WAIT:
+			spdlog::info("<<< Any message NOT arrived.");
+			disconnect(_reconnect ? 0 : -1);
+			break;
+		case SESSION::ESTABLISHED:
+			break;
+	}
+}
+
+void WgacClient::onSocket(uint32_t events) {
+	if ((events & EPOLLOUT) && !flushWrite()) {
+		spdlog::info("<<< send failed: {}", strerror(errno));
+		disconnect(reconnectDelay());
+		return;
+	}
+
+	if (!(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+		return;
+	}
+
+	const bool open = readSocket();
+
+	if (_awaitingServerKey && receive_public_key() && _session == SESSION::KEY_EXCHANGE) {
+		//step#2: Send JOIN(or HELLO-PING) messages
+		send_first_request();
+	}
+
+	message_t rmsg;
+	bool bad_frame = false;
+	while (!_isClosed && !_awaitingServerKey && nextMessage(rmsg, bad_frame)) {
+		handle_message(rmsg);
+	}
+
+	if (_isClosed) {
+		return;
+	}
+	if (bad_frame) {
+		spdlog::warn("<<< Stream from server is out of sync.");
+		disconnect(reconnectDelay());
+	} else if (!open) {
+		/* the server is gone: a BYE in flight is as good as answered */
+		_isConnected = false;
+		if (_session == SESSION::BYE_WAIT) {
+			disconnect(_reconnect ? 0 : -1);
+		} else {
+			note_server_failure(_server_ip);   /* e.g. the server restarted: try the others first */
+			disconnect(reconnectDelay());
+		}
+	}
+}
+
+/**
+ * Event loop: one thread, no sleeps. Every wait has an explicit deadline on the timerfd.
+ */
+bool WgacClient::run() {
+	if (_config.contains("request_timeout_ms") && _config.getint("request_timeout_ms") > 0) {
+		_requestTimeoutMs = _config.getint("request_timeout_ms");
+	}
+	if (_config.contains("connect_timeout_ms") && _config.getint("connect_timeout_ms") > 0) {
+		_connectTimeoutMs = _config.getint("connect_timeout_ms");
+	}
+	if (_config.contains("backoff_base_ms") && _config.getint("backoff_base_ms") > 0) {
+		_backoffBaseMs = _config.getint("backoff_base_ms");
+	}
+	if (_config.contains("backoff_cap_ms") && _config.getint("backoff_cap_ms") > 0) {
+		_backoffCapMs = _config.getint("backoff_cap_ms");
+	}
+	_backoffCapMs = std::max(_backoffCapMs, _backoffBaseMs);
+	if (_config.contains("request_retries") && _config.getint("request_retries") >= 0) {
+		_requestRetries = _config.getint("request_retries");
+	}
+	if (_config.contains("reconnect_budget") && _config.getint("reconnect_budget") >= 0) {
+		_reconnectBudget = _config.getint("reconnect_budget");
+	}
+	_budgetTokens = _reconnectBudget;
+	_budgetStamp = std::chrono::steady_clock::now();
+	if (_config.contains("pin_server_key")) {
+		_pinServerKey = (_config.getint("pin_server_key") != 0);
+	}
+	if (_config.contains("server_key_file")) {
+		_serverKeyFile = _config.getstr("server_key_file");
+	}
+	if (_config.contains("join_handshake")) {
+		_joinSupported = (_config.getint("join_handshake") != 0);
+	}
+
+	load_server_list();
+	if (_servers.empty()) {
+		spdlog::error("No server is specified(--server or servers).");
+		return false;
+	}
+
+	if (!initializeReactor()) {
+		return false;
+	}
+	open_netif_events();
+	refresh_netif();
+
+	beginConnect();
+
+	struct epoll_event events[EPOLL_MAX_EVENTS];
+	while (!(_terminate && _session == SESSION::DISCONNECTED)) {
+		int n = epoll_wait(_epollfd, events, EPOLL_MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			spdlog::error("epoll_wait failed: {}", strerror(errno));
+			break;
+		}
+
+		for (int i = 0; i < n; i++) {
+			const int fd = events[i].data.fd;
+			if (fd == _signalfd) {
+				onSignal();
+			} else if (fd == _timerfd) {
+				onTimer();
+			} else if (fd == _rtnlEvents.fd()) {
+				onNetlink();
+			} else if (!_isClosed && fd == _sockfd.get()) {
+				onSocket(events[i].events);
+			} else if (_session == SESSION::CONNECTING) {
+				onAttempt(fd, events[i].events);
+			}
+		}
+	}
+
+	disconnect(-1);
+	closeReactor();
+	spdlog::info("--- Client closed.");
+	return true;
+}
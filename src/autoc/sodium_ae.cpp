@@ -9,11 +9,13 @@
  */
 
 #include <sodium.h>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 #include <string>
 #include <vector>
 #include "inc/client.h"
+#include "inc/common.h"
 #include "spdlog/spdlog.h"
 
 namespace sodium_ae
@@ -67,7 +69,7 @@ std::vector<unsigned char> encrypt_message(const std::vector<unsigned char>& mes
 	//payload length(4 bytes) | NONCE(24 bytes) | ciphertex + MAC(16 bytes)
 	std::vector<unsigned char> result;
 
-	uint32_t payload_len = sizeof(nonce) + message.size() + crypto_box_MACBYTES;
+	uint32_t payload_len = nonce.size() + message.size() + crypto_box_MACBYTES;
 	uint32_t net_len = htonl(payload_len);
 	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&net_len);
     result.insert(result.end(), bytes, bytes + sizeof(uint32_t));
@@ -77,35 +79,66 @@ std::vector<unsigned char> encrypt_message(const std::vector<unsigned char>& mes
 	return result;
 }
 
-// Decrypt a message
+/*
+ * Size of the frame at the head of a buffer, 0 while it is incomplete.
+ * A payload length out of NONCE + MAC ~ MAX_PACKET_SIZE sets bad_frame:
+ * the stream can't be resynchronized after it.
+ */
+size_t frame_size(const unsigned char* data, size_t size, bool& bad_frame) {
+	bad_frame = false;
+	if (size < sizeof(uint32_t)) {
+		return 0;
+	}
+	uint32_t net_len;
+	std::memcpy(&net_len, data, sizeof(net_len));
+	const uint32_t payload_len = ntohl(net_len);
+	if (payload_len < crypto_box_NONCEBYTES + crypto_box_MACBYTES || payload_len > MAX_PACKET_SIZE) {
+		bad_frame = true;
+		return 0;
+	}
+	if (size < sizeof(uint32_t) + payload_len) {
+		return 0;
+	}
+	return sizeof(uint32_t) + payload_len;
+}
+
+/*
+ * Cut the frame at the head of a receive buffer: the framing of every
+ * reader of the stream(the clients, the fuzz harness).
+ */
+bool next_frame(std::vector<unsigned char>& rbuf, std::vector<unsigned char>& frame, bool& bad_frame) {
+	const size_t frame_len = frame_size(rbuf.data(), rbuf.size(), bad_frame);
+	if (frame_len == 0) {
+		return false;
+	}
+	frame.assign(rbuf.begin(), rbuf.begin() + frame_len);
+	rbuf.erase(rbuf.begin(), rbuf.begin() + frame_len);
+	return true;
+}
+
+// Decrypt a message(one whole frame, bytes behind it are ignored)
 std::vector<unsigned char> decrypt_message(std::vector<unsigned char>& encrypted_message,
                                             const std::vector<unsigned char>& sender_public_key,
                                             const std::vector<unsigned char>& receiver_secret_key,
 											bool& decrypt_failure) {
-	if (encrypted_message.size() < 4 + crypto_box_NONCEBYTES + crypto_box_MACBYTES) {
-		decrypt_failure = true;
-		spdlog::warn("Invalid ciphertext size.");
-		std::cout << "Invalid ciphertext size." << std::endl;
-	}
-
-	uint32_t payload_len = ntohl(*reinterpret_cast<uint32_t*>(encrypted_message.data()));
-	if (encrypted_message.size() < 4 + payload_len) {
+	bool bad_frame = false;
+	const size_t frame_len = frame_size(encrypted_message.data(), encrypted_message.size(), bad_frame);
+	if (frame_len == 0) {
 		decrypt_failure = true;
-		spdlog::warn("received_bytes < 4 + payload_len");
-		std::cout << "received_bytes < 4 + payload_len" << std::endl;
+		spdlog::warn(bad_frame ? "Invalid ciphertext size." : "received_bytes < 4 + payload_len");
+		return {};
 	}
 
-	std::vector<unsigned char> nonce(encrypted_message.begin() + 4, encrypted_message.begin() + 4 + crypto_box_NONCEBYTES);
-	std::vector<unsigned char> ciphertext(encrypted_message.begin() + 4 + crypto_box_NONCEBYTES, encrypted_message.end());
+	const unsigned char* nonce = encrypted_message.data() + sizeof(uint32_t);
+	const unsigned char* ciphertext = nonce + crypto_box_NONCEBYTES;
+	const size_t ciphertext_len = frame_len - sizeof(uint32_t) - crypto_box_NONCEBYTES;
 
-	std::vector<unsigned char> decrypted_message(ciphertext.size() - crypto_box_MACBYTES);
-
-	if (!decrypt_failure) {
-		if (crypto_box_open_easy(decrypted_message.data(), ciphertext.data(), ciphertext.size(), nonce.data(),
-					sender_public_key.data(), receiver_secret_key.data()) != 0) {
-			decrypt_failure = true;
-			spdlog::warn("Message decryption failed.");
-		}
+	std::vector<unsigned char> decrypted_message(ciphertext_len - crypto_box_MACBYTES);
+	if (crypto_box_open_easy(decrypted_message.data(), ciphertext, ciphertext_len, nonce,
+				sender_public_key.data(), receiver_secret_key.data()) != 0) {
+		decrypt_failure = true;
+		spdlog::warn("Message decryption failed.");
+		decrypted_message.clear();
 	}
 	return decrypted_message;
 }
@@ -173,8 +206,8 @@ int test_main() {
 	std::vector<unsigned char> decrypted_message = decrypt_message(encrypted_message, sender_public_key, receiver_secret_key, decrypt_failure);
 
 	// Output the results
-	std::cout << "Original message: " << original_message_str << std::endl;
-	std::cout << "Decrypted message: " << std::string(decrypted_message.begin(), decrypted_message.end()) << std::endl;
+	spdlog::info("Original message: {}", original_message_str);
+	spdlog::info("Decrypted message: {}", std::string(decrypted_message.begin(), decrypted_message.end()));
 
 	return 0;
 }
@@ -0,0 +1,235 @@
+/*
+ * Generic netlink routines for the wireguard kernel module
+ * Let's see : lib/wg-tools/uapi/linux/linux/wireguard.h
+ *
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cstring>
+#include <arpa/inet.h>
+#include <linux/genetlink.h>
+#include <linux/wireguard.h>
+#include "inc/client.h"
+#include "inc/wg_netlink.h"
+#include "spdlog/spdlog.h"
+
+#define WG_NL_PEER_MAX    256     /* upper bound of one encoded peer */
+
+/**
+ * Open a generic netlink socket and resolve the wireguard family id.
+ */
+bool WgNetlink::open() {
+	if (_sock.isOpen() && _family != 0) {
+		return true;
+	}
+	if (!_sock.open(NETLINK_GENERIC)) {
+		return false;
+	}
+	if (!resolve_family()) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void WgNetlink::close() {
+	_sock.close();
+	_family = 0;
+}
+
+/**
+ * CTRL_CMD_GETFAMILY("wireguard") -> family id
+ */
+bool WgNetlink::resolve_family() {
+	NlMessage msg(GENL_ID_CTRL, 0, GENL_HDRLEN);
+	msg.header<struct genlmsghdr>()->cmd = CTRL_CMD_GETFAMILY;
+	msg.header<struct genlmsghdr>()->version = 1;
+	msg.put_str(CTRL_ATTR_FAMILY_NAME, WG_GENL_NAME);
+
+	_family = 0;
+	bool ok = _sock.transact(msg.buffer(), [this](const struct nlmsghdr* nlh) {
+		nl_for_each_attr(nlh, GENL_HDRLEN, [this](const struct nlattr* nla) {
+			if ((nla->nla_type & NLA_TYPE_MASK) == CTRL_ATTR_FAMILY_ID) {
+				std::memcpy(&_family, nl_attr_data(nla), sizeof(_family));
+			}
+		});
+	});
+	if (!ok || _family == 0) {
+		spdlog::debug("wireguard generic netlink family is not available.");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * WG_CMD_GET_DEVICE dump: private key, listen port and peers of the device.
+ * A peer split over several messages is coalesced into one entry.
+ */
+bool WgNetlink::get_device(const std::string& ifname, wg_device_t& dev) {
+	if (!open()) {
+		return false;
+	}
+
+	NlMessage msg(_family, NLM_F_DUMP, GENL_HDRLEN);
+	msg.header<struct genlmsghdr>()->cmd = WG_CMD_GET_DEVICE;
+	msg.header<struct genlmsghdr>()->version = WG_GENL_VERSION;
+	msg.put_str(WGDEVICE_A_IFNAME, ifname);
+
+	dev.has_private_key = false;
+	dev.listen_port = 0;
+	dev.peers.clear();
+	return _sock.transact(msg.buffer(), [&dev](const struct nlmsghdr* nlh) {
+		nl_for_each_attr(nlh, GENL_HDRLEN, [&dev](const struct nlattr* attr) {
+			switch (attr->nla_type & NLA_TYPE_MASK) {
+				case WGDEVICE_A_PRIVATE_KEY:
+					if (nl_attr_len(attr) == WG_KEY_LEN) {
+						std::memcpy(dev.private_key, nl_attr_data(attr), WG_KEY_LEN);
+						dev.has_private_key = true;
+					}
+					break;
+				case WGDEVICE_A_LISTEN_PORT:
+					std::memcpy(&dev.listen_port, nl_attr_data(attr), sizeof(dev.listen_port));
+					break;
+				case WGDEVICE_A_PEERS:
+					nl_for_each_nested(attr, [&dev](const struct nlattr* nest) {
+						wg_device_peer_t peer {};
+						bool has_key = false;
+
+						nl_for_each_nested(nest, [&](const struct nlattr* nla) {
+							switch (nla->nla_type & NLA_TYPE_MASK) {
+								case WGPEER_A_PUBLIC_KEY:
+									if (nl_attr_len(nla) == WG_KEY_LEN) {
+										key_to_base64(reinterpret_cast<char*>(peer.public_key),
+												static_cast<const uint8_t*>(nl_attr_data(nla)));
+										has_key = true;
+									}
+									break;
+								case WGPEER_A_ENDPOINT:
+									if (nl_attr_len(nla) >= sizeof(struct sockaddr_in)) {
+										struct sockaddr_in endpoint {};
+										std::memcpy(&endpoint, nl_attr_data(nla), sizeof(endpoint));
+										if (endpoint.sin_family == AF_INET) {
+											peer.epIP = endpoint.sin_addr;
+											peer.epPort = ntohs(endpoint.sin_port);
+										}
+									}
+									break;
+								case WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL:
+									std::memcpy(&peer.keepalive, nl_attr_data(nla), sizeof(peer.keepalive));
+									break;
+								case WGPEER_A_ALLOWEDIPS:
+									nl_for_each_nested(nla, [&peer](const struct nlattr* aip) {
+										uint16_t family = 0;
+										struct in_addr addr {};
+										uint8_t cidr = 0;
+										nl_for_each_nested(aip, [&](const struct nlattr* a) {
+											switch (a->nla_type & NLA_TYPE_MASK) {
+												case WGALLOWEDIP_A_FAMILY:
+													std::memcpy(&family, nl_attr_data(a), sizeof(family));
+													break;
+												case WGALLOWEDIP_A_IPADDR:
+													if (nl_attr_len(a) >= sizeof(addr))
+														std::memcpy(&addr, nl_attr_data(a), sizeof(addr));
+													break;
+												case WGALLOWEDIP_A_CIDR_MASK:
+													std::memcpy(&cidr, nl_attr_data(a), sizeof(cidr));
+													break;
+											}
+										});
+										if (family == AF_INET && peer.allowedIPs == 0) {
+											peer.vpnIP = addr;
+											peer.cidr = cidr;
+										}
+										peer.allowedIPs++;
+									});
+									break;
+							}
+						});
+
+						if (!has_key) return;
+						if (!dev.peers.empty() &&
+								!std::memcmp(dev.peers.back().public_key, peer.public_key, WG_KEY_LEN_BASE64)) {
+							/* continuation of the previous peer */
+							if (dev.peers.back().allowedIPs == 0) {
+								dev.peers.back().vpnIP = peer.vpnIP;
+								dev.peers.back().cidr = peer.cidr;
+							}
+							dev.peers.back().allowedIPs += peer.allowedIPs;
+						} else {
+							dev.peers.push_back(peer);
+						}
+					});
+					break;
+			}
+		});
+	});
+}
+
+/**
+ * WG_CMD_SET_DEVICE: change only what is given
+ * (private_key == nullptr or listen_port == 0 leaves it as it is).
+ */
+bool WgNetlink::set_device(const std::string& ifname, const uint8_t* private_key, uint16_t listen_port,
+		const std::vector<wg_peer_change_t>& changes) {
+	if (!open()) {
+		return false;
+	}
+
+	NlMessage msg(_family, 0, GENL_HDRLEN);
+	msg.header<struct genlmsghdr>()->cmd = WG_CMD_SET_DEVICE;
+	msg.header<struct genlmsghdr>()->version = WG_GENL_VERSION;
+	msg.put_str(WGDEVICE_A_IFNAME, ifname);
+	if (private_key) {
+		msg.put(WGDEVICE_A_PRIVATE_KEY, private_key, WG_KEY_LEN);
+	}
+	if (listen_port) {
+		msg.put_u16(WGDEVICE_A_LISTEN_PORT, listen_port);
+	}
+
+	if (!changes.empty()) {
+		size_t peers = msg.nest_start(WGDEVICE_A_PEERS);
+		for (const auto& change : changes) {
+			if (msg.size() + WG_NL_PEER_MAX > NL_BUFFER_SIZE) {
+				spdlog::warn("Too many peer changes, the rest is skipped.");
+				break;
+			}
+
+			uint8_t key[WG_KEY_LEN];
+			if (!key_from_base64(key, reinterpret_cast<const char*>(change.public_key))) {
+				spdlog::warn("Invalid peer public key [{}] is skipped.",
+						reinterpret_cast<const char*>(change.public_key));
+				continue;
+			}
+
+			size_t peer = msg.nest_start(0);
+			msg.put(WGPEER_A_PUBLIC_KEY, key, WG_KEY_LEN);
+			if (change.op == wg_peer_change_t::Op::REMOVE) {
+				msg.put_u32(WGPEER_A_FLAGS, WGPEER_F_REMOVE_ME);
+			} else {
+				msg.put_u32(WGPEER_A_FLAGS, WGPEER_F_REPLACE_ALLOWEDIPS);
+				if (change.epIP.s_addr != 0) {
+					struct sockaddr_in endpoint {};
+					endpoint.sin_family = AF_INET;
+					endpoint.sin_addr = change.epIP;
+					endpoint.sin_port = htons(change.epPort);
+					msg.put(WGPEER_A_ENDPOINT, &endpoint, sizeof(endpoint));
+				}
+				msg.put_u16(WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL, change.keepalive);
+
+				size_t allowedips = msg.nest_start(WGPEER_A_ALLOWEDIPS);
+				size_t allowedip = msg.nest_start(0);
+				msg.put_u16(WGALLOWEDIP_A_FAMILY, AF_INET);
+				msg.put(WGALLOWEDIP_A_IPADDR, &change.vpnIP, sizeof(change.vpnIP));
+				msg.put_u8(WGALLOWEDIP_A_CIDR_MASK, 32);
+				msg.nest_end(allowedip);
+				msg.nest_end(allowedips);
+			}
+			msg.nest_end(peer);
+		}
+		msg.nest_end(peers);
+	}
+
+	return _sock.transact(msg.buffer());
+}
@@ -0,0 +1,144 @@
+/*
+ * Heap allocation accounting of the server(opt-in global operator new/delete hooks)
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "inc/alloc_stats.h"
+
+#ifdef WGAC_ALLOC_STATS
+#include <atomic>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include "inc/logging.h"
+
+/*
+ * Plain thread_local integers: no constructor and no allocation of their own,
+ * so they are usable from operator new in any thread at any time.
+ */
+static thread_local uint64_t thread_allocs = 0;
+static thread_local uint64_t thread_bytes = 0;
+
+static void* counted_alloc(std::size_t size) {
+	thread_allocs++;
+	thread_bytes += size;
+	return std::malloc(size ? size : 1);
+}
+
+static void* counted_aligned_alloc(std::size_t size, std::align_val_t align) {
+	thread_allocs++;
+	thread_bytes += size;
+	void* p = nullptr;
+	const std::size_t alignment = std::max(static_cast<std::size_t>(align), sizeof(void*));
+	return posix_memalign(&p, alignment, size ? size : 1) == 0 ? p : nullptr;
+}
+
+void* operator new(std::size_t size) {
+	void* p = counted_alloc(size);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](std::size_t size) {
+	void* p = counted_alloc(size);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	return counted_alloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return counted_alloc(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+	void* p = counted_aligned_alloc(size, align);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](std::size_t size, std::align_val_t align) {
+	void* p = counted_aligned_alloc(size, align);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+namespace alloc_stats
+{
+struct TopicCounters {
+	std::atomic<uint64_t> messages {0};
+	std::atomic<uint64_t> allocs {0};
+	std::atomic<uint64_t> bytes {0};
+};
+
+static TopicCounters topics[logging::TOPIC_MAX];
+
+alloc_counts_t thread_counts() {
+	return {thread_allocs, thread_bytes};
+}
+
+void record(size_t topic, const alloc_counts_t& delta) {
+	if (topic >= logging::TOPIC_MAX) {
+		return;
+	}
+	topics[topic].messages.fetch_add(1, std::memory_order_relaxed);
+	topics[topic].allocs.fetch_add(delta.allocs, std::memory_order_relaxed);
+	topics[topic].bytes.fetch_add(delta.bytes, std::memory_order_relaxed);
+}
+
+void snapshot(std::vector<topic_allocs_t>& out) {
+	for (size_t t = 0; t < logging::TOPIC_MAX; t++) {
+		const uint64_t messages = topics[t].messages.load(std::memory_order_relaxed);
+		if (messages > 0) {
+			out.push_back({logging::topic_name(t), messages,
+					topics[t].allocs.load(std::memory_order_relaxed),
+					topics[t].bytes.load(std::memory_order_relaxed)});
+		}
+	}
+}
+
+std::string render() {
+	std::vector<topic_allocs_t> snap;
+	snapshot(snap);
+
+	std::string out;
+	char line[256];
+	out += "# HELP wgac_alloc_messages_total Messages measured by the allocation accounting.\n"
+		"# TYPE wgac_alloc_messages_total counter\n";
+	for (const auto& t : snap) {
+		snprintf(line, sizeof(line), "wgac_alloc_messages_total{type=\"%s\"} %lu\n", t.topic, t.messages);
+		out += line;
+	}
+	out += "# HELP wgac_alloc_allocations_total Heap allocations while handling messages.\n"
+		"# TYPE wgac_alloc_allocations_total counter\n";
+	for (const auto& t : snap) {
+		snprintf(line, sizeof(line), "wgac_alloc_allocations_total{type=\"%s\"} %lu\n", t.topic, t.allocs);
+		out += line;
+	}
+	out += "# HELP wgac_alloc_bytes_total Heap bytes allocated while handling messages.\n"
+		"# TYPE wgac_alloc_bytes_total counter\n";
+	for (const auto& t : snap) {
+		snprintf(line, sizeof(line), "wgac_alloc_bytes_total{type=\"%s\"} %lu\n", t.topic, t.bytes);
+		out += line;
+	}
+	return out;
+}
+
+}
+#endif
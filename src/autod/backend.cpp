@@ -0,0 +1,582 @@
+/*
+ * Wireguard and redis backends of the server: the real ones and in-memory fakes
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <sodium.h>
+#include "inc/backend.h"
+#include "inc/server.h"
+#include "inc/common.h"
+#include "inc/vtysh.h"
+#include "inc/rt_netlink.h"
+#include "inc/logging.h"
+#include "spdlog/spdlog.h"
+#include <hiredis/hiredis.h>
+
+#define WG_TOOL_PEERS_PER_EXEC 32
+
+/*
+ * wireguard kernel module: interfaces with ip/ifconfig/wg, peers with generic
+ * netlink(the wg tool as a fallback) or vtysh. The apply thread writes and
+ * the reconciler reads, each on its own netlink socket.
+ */
+class KernelWireguard : public WireguardBackend {
+public:
+	const char* name() const override { return "kernel"; }
+	bool load_keypair(char pubkey[WG_KEY_LEN_BASE64], char privkey[WG_KEY_LEN_BASE64]) override;
+	void init_interface(const std::string& ifname, struct in_addr address, struct in_addr netmask,
+			uint16_t listenPort) override;
+	void set_address(const std::string& ifname, struct in_addr address, struct in_addr netmask) override;
+	bool set_peers(const std::string& ifname, const std::vector<wg_peer_change_t>& changes,
+			bool peerRoutes) override;
+	bool get_peers(const std::string& ifname, std::vector<wg_device_peer_t>& peers) override;
+
+private:
+	bool apply_with_wg_tool(const std::string& ifname, const std::vector<wg_peer_change_t>& changes);
+	void update_routes(const std::string& ifname, const std::vector<wg_peer_change_t>& changes);
+
+	std::mutex _setMtx;            /* protects _setNetlink and _rtnl */
+	WgNetlink _setNetlink;
+	RtNetlink _rtnl;               /* /32 routes when peers are spread over several interfaces */
+	std::mutex _getMtx;            /* protects _getNetlink */
+	WgNetlink _getNetlink;
+};
+
+bool KernelWireguard::load_keypair(char pubkey[WG_KEY_LEN_BASE64], char privkey[WG_KEY_LEN_BASE64]) {
+	return initialize_curve25519(pubkey, privkey);
+}
+
+void KernelWireguard::init_interface(const std::string& ifname, struct in_addr address, struct in_addr netmask,
+		uint16_t listenPort) {
+	char szInfo[512] = {};
+	std::string cmd {};
+	std::string error_text;
+	std::vector<std::string> output_list;
+	bool exec_result;
+
+	//TBD: this command should be executed at booting script
+	snprintf(szInfo, sizeof(szInfo), "ip link add dev %s type wireguard > /dev/null 2>&1", ifname.c_str());
+	cmd = szInfo;
+	exec_result = common::exec(cmd, output_list, error_text);
+	if (exec_result) {
+		spdlog::debug("--- wireguard init [{}]", szInfo);
+	} else {
+		spdlog::warn("{}", error_text);
+	}
+
+	set_address(ifname, address, netmask);
+
+	snprintf(szInfo, sizeof(szInfo), "ip link set up dev %s", ifname.c_str());
+	cmd = szInfo;
+	exec_result = common::exec(cmd, output_list, error_text);
+	if (exec_result) {
+		spdlog::debug("--- wireguard init [{}]", szInfo);
+	} else {
+		spdlog::warn("{}", error_text);
+	}
+
+	//Note: you must not encrypt the /qrwg/config/privatekey file
+	snprintf(szInfo, sizeof(szInfo),
+		"wg set %s listen-port %d private-key /qrwg/config/privatekey",
+		ifname.c_str(), listenPort);
+	cmd = szInfo;
+	exec_result = common::exec(cmd, output_list, error_text);
+	if (exec_result) {
+		spdlog::debug("--- wireguard init [{}]", szInfo);
+	} else {
+		spdlog::warn("{}", error_text);
+	}
+}
+
+void KernelWireguard::set_address(const std::string& ifname, struct in_addr address, struct in_addr netmask) {
+	char szInfo[512] = {};
+	std::string error_text;
+	std::vector<std::string> output_list;
+
+	char address_str[16], netmask_str[16];
+	snprintf(address_str, sizeof(address_str), "%s", inet_ntoa(address));
+	snprintf(netmask_str, sizeof(netmask_str), "%s", inet_ntoa(netmask));
+	snprintf(szInfo, sizeof(szInfo),
+		"ifconfig %s %s netmask %s > /dev/null 2>&1",
+		ifname.c_str(), address_str, netmask_str);
+	std::string cmd = szInfo;
+	if (common::exec(cmd, output_list, error_text)) {
+		spdlog::debug("--- wireguard init [{}]", szInfo);
+	} else {
+		spdlog::warn("{}", error_text);
+	}
+}
+
+bool KernelWireguard::set_peers(const std::string& ifname, const std::vector<wg_peer_change_t>& changes,
+		bool peerRoutes) {
+#ifdef VTYSH
+	(void)ifname;
+	(void)peerRoutes;
+	char szInfo[512] {};
+	std::vector<std::string> cmds;
+	cmds.reserve(changes.size());
+	for (const auto& change : changes) {
+		if (change.op == wg_peer_change_t::Op::REMOVE) {
+			snprintf(szInfo, sizeof(szInfo), "no wg peer %s", change.public_key);
+		} else {
+			char vpnip_str[32] {}, epip_str[32] {};
+			snprintf(vpnip_str, sizeof(vpnip_str), "%s", inet_ntoa(change.vpnIP));
+			snprintf(epip_str, sizeof(epip_str), "%s", inet_ntoa(change.epIP));
+			snprintf(szInfo, sizeof(szInfo),
+					"wg peer %s allowed-ips %s/32 endpoint %s:%d persistent-keepalive %d",
+					change.public_key, vpnip_str, epip_str, change.epPort, change.keepalive);
+		}
+		cmds.push_back(szInfo);
+		spdlog::debug("--- wireguard rule [{}]", szInfo);
+	}
+
+	/* one vtysh invocation for the whole batch(its result), the config write is debounced */
+	return vtyshell::runCommands(cmds, true);
+#else
+	std::lock_guard<std::mutex> lock(_setMtx);
+	bool ok_flag = true;
+	if (!_setNetlink.set_peers(ifname, changes)) {
+		spdlog::debug("netlink is not usable, falling back to the wg tool.");
+		ok_flag = apply_with_wg_tool(ifname, changes);
+	}
+	if (ok_flag && peerRoutes) {
+		update_routes(ifname, changes);
+	}
+	return ok_flag;
+#endif
+}
+
+bool KernelWireguard::get_peers(const std::string& ifname, std::vector<wg_device_peer_t>& peers) {
+	std::lock_guard<std::mutex> lock(_getMtx);
+	return _getNetlink.get_peers(ifname, peers);
+}
+
+/**
+ * With several interfaces only wg0 owns the vpn subnet route,
+ * so every peer gets a /32 route towards the interface it lives on.
+ */
+void KernelWireguard::update_routes(const std::string& ifname, const std::vector<wg_peer_change_t>& changes) {
+	const int ifindex = _rtnl.link_index(ifname);
+	if (ifindex == 0) {
+		spdlog::warn("{} does not exist, peer routes are not set.", ifname);
+		return;
+	}
+
+	for (const auto& change : changes) {
+		if (change.vpnIP.s_addr == 0) continue;
+
+		ipv4_prefix_t prefix {change.vpnIP, 32};
+		if (change.op == wg_peer_change_t::Op::REMOVE) {
+			/* the route may already point to another interface or be gone */
+			_rtnl.del_ipv4_route(ifindex, prefix);
+		} else if (!_rtnl.add_ipv4_route(ifindex, prefix)) {
+			spdlog::warn("Can't set the route {}/32 dev {}.", inet_ntoa(change.vpnIP), ifname);
+		}
+	}
+}
+
+/**
+ * Fallback: one "wg set" invocation for several peers
+ */
+bool KernelWireguard::apply_with_wg_tool(const std::string& ifname, const std::vector<wg_peer_change_t>& changes) {
+	bool ok_flag = true;
+
+	for (size_t i = 0; i < changes.size(); i += WG_TOOL_PEERS_PER_EXEC) {
+		std::string cmd = "wg set " + ifname;
+		for (size_t j = i; j < changes.size() && j < i + WG_TOOL_PEERS_PER_EXEC; j++) {
+			const wg_peer_change_t& change = changes[j];
+			char szInfo[256] {};
+			if (change.op == wg_peer_change_t::Op::REMOVE) {
+				snprintf(szInfo, sizeof(szInfo), " peer %s remove", change.public_key);
+			} else {
+				char vpnip_str[32] {}, epip_str[32] {};
+				snprintf(vpnip_str, sizeof(vpnip_str), "%s", inet_ntoa(change.vpnIP));
+				snprintf(epip_str, sizeof(epip_str), "%s", inet_ntoa(change.epIP));
+				snprintf(szInfo, sizeof(szInfo),
+						" peer %s allowed-ips %s/32 endpoint %s:%d persistent-keepalive %d",
+						change.public_key, vpnip_str, epip_str, change.epPort, change.keepalive);
+			}
+			cmd += szInfo;
+		}
+
+		std::string error_text;
+		std::vector<std::string> output_list;
+		if (common::exec(cmd, output_list, error_text)) {
+			spdlog::debug("--- wireguard rule [{}]", cmd);
+		} else {
+			spdlog::warn("{}", error_text);
+			ok_flag = false;
+		}
+	}
+	return ok_flag;
+}
+
+/*
+ * In-memory wireguard device: the peers of every interface as set_peers()
+ * left them, so the reconciler reads back what was applied.
+ */
+class FakeWireguard : public WireguardBackend {
+public:
+	explicit FakeWireguard(uint32_t latencyUs) : _latency(latencyUs) {}
+
+	const char* name() const override { return "fake"; }
+	bool load_keypair(char pubkey[WG_KEY_LEN_BASE64], char privkey[WG_KEY_LEN_BASE64]) override;
+	void init_interface(const std::string& ifname, struct in_addr address, struct in_addr netmask,
+			uint16_t listenPort) override;
+	void set_address(const std::string& ifname, struct in_addr address, struct in_addr netmask) override;
+	bool set_peers(const std::string& ifname, const std::vector<wg_peer_change_t>& changes,
+			bool peerRoutes) override;
+	bool get_peers(const std::string& ifname, std::vector<wg_device_peer_t>& peers) override;
+
+	std::string describe();
+
+private:
+	struct Interface {
+		struct in_addr address {};
+		struct in_addr netmask {};
+		uint16_t listenPort = 0;
+		std::map<std::string, wg_device_peer_t> peers;   /* key: base64 public key */
+	};
+
+	std::chrono::microseconds _latency;
+	std::mutex _mtx;               /* protects everything below */
+	std::map<std::string, Interface> _interfaces;
+	uint64_t _setCalls = 0, _peersSet = 0, _peersRemoved = 0, _routes = 0, _getCalls = 0;
+};
+
+bool FakeWireguard::load_keypair(char pubkey[WG_KEY_LEN_BASE64], char privkey[WG_KEY_LEN_BASE64]) {
+	uint8_t pk[crypto_box_PUBLICKEYBYTES], sk[crypto_box_SECRETKEYBYTES];
+	crypto_box_keypair(pk, sk);
+	key_to_base64(pubkey, pk);
+	key_to_base64(privkey, sk);
+	sodium_memzero(sk, sizeof(sk));
+	spdlog::info("--- fake wireguard backend: ephemeral server keypair.");
+	return true;
+}
+
+void FakeWireguard::init_interface(const std::string& ifname, struct in_addr address, struct in_addr netmask,
+		uint16_t listenPort) {
+	std::lock_guard<std::mutex> lock(_mtx);
+	Interface& dev = _interfaces[ifname];
+	dev.address = address;
+	dev.netmask = netmask;
+	dev.listenPort = listenPort;
+}
+
+void FakeWireguard::set_address(const std::string& ifname, struct in_addr address, struct in_addr netmask) {
+	std::lock_guard<std::mutex> lock(_mtx);
+	Interface& dev = _interfaces[ifname];
+	dev.address = address;
+	dev.netmask = netmask;
+}
+
+bool FakeWireguard::set_peers(const std::string& ifname, const std::vector<wg_peer_change_t>& changes,
+		bool peerRoutes) {
+	if (_latency.count() > 0) {
+		std::this_thread::sleep_for(_latency);
+	}
+
+	std::lock_guard<std::mutex> lock(_mtx);
+	Interface& dev = _interfaces[ifname];
+	_setCalls++;
+	for (const auto& change : changes) {
+		std::string key(reinterpret_cast<const char*>(change.public_key));
+		if (change.op == wg_peer_change_t::Op::REMOVE) {
+			dev.peers.erase(key);
+			_peersRemoved++;
+		} else {
+			wg_device_peer_t& peer = dev.peers[key];
+			std::memcpy(peer.public_key, change.public_key, WG_KEY_LEN_BASE64);
+			peer.vpnIP = change.vpnIP;
+			peer.cidr = 32;
+			peer.allowedIPs = 1;
+			_peersSet++;
+		}
+		if (peerRoutes && change.vpnIP.s_addr != 0) {
+			_routes++;
+		}
+	}
+	return true;
+}
+
+bool FakeWireguard::get_peers(const std::string& ifname, std::vector<wg_device_peer_t>& peers) {
+	if (_latency.count() > 0) {
+		std::this_thread::sleep_for(_latency);
+	}
+
+	std::lock_guard<std::mutex> lock(_mtx);
+	_getCalls++;
+	peers.clear();
+	auto it = _interfaces.find(ifname);
+	if (it == _interfaces.end()) {
+		return true;
+	}
+	peers.reserve(it->second.peers.size());
+	for (const auto& [key, peer] : it->second.peers) {
+		peers.push_back(peer);
+	}
+	return true;
+}
+
+std::string FakeWireguard::describe() {
+	std::lock_guard<std::mutex> lock(_mtx);
+	size_t peers = 0;
+	for (const auto& [ifname, dev] : _interfaces) {
+		peers += dev.peers.size();
+	}
+	return "wireguard=fake latency_us=" + std::to_string(_latency.count()) +
+		" interfaces=" + std::to_string(_interfaces.size()) + " peers=" + std::to_string(peers) +
+		" set_calls=" + std::to_string(_setCalls) + " peers_set=" + std::to_string(_peersSet) +
+		" peers_removed=" + std::to_string(_peersRemoved) + " routes=" + std::to_string(_routes) +
+		" get_calls=" + std::to_string(_getCalls) + "\n";
+}
+
+#ifdef REDIS
+const unsigned int redis_port { 6379 };
+const std::string redis_host  { "127.0.0.1" };
+
+/*
+ * redis-server on localhost, one connection per command
+ */
+class RealRedis : public RedisBackend {
+public:
+	const char* name() const override { return "redis"; }
+	bool set(const std::string& key, const std::string& value) override;
+	bool del(const std::string& key) override;
+	bool get(const std::string& key, std::string& value) override;
+
+private:
+	redisContext* connect();
+	redisReply* command(redisContext* redis_context, redisReply* reply);
+};
+
+redisContext* RealRedis::connect() {
+	struct timeval timeout      = { 1, 500000 }; // 1.5 seconds
+	redisContext* redis_context = redisConnectWithTimeout(redis_host.c_str(), redis_port, timeout);
+	if (redis_context->err) {
+		LOG_SAMPLED(logging::TOPIC_REDIS, error, "Redis connection error: {}", redis_context->errstr);
+		LOG_SAMPLED(logging::TOPIC_REDIS, error, "Could not initiate connection to Redis.");
+		redisFree(redis_context);
+		return nullptr;
+	}
+
+	// We should check connection with ping because redis do not check connection
+	redisReply* reply = (redisReply*)redisCommand(redis_context, "PING");
+	if (reply) {
+		freeReplyObject(reply);
+	} else {
+		LOG_SAMPLED(logging::TOPIC_REDIS, error, "Could not initiate connection to Redis.");
+		redisFree(redis_context);
+		return nullptr;
+	}
+
+	return redis_context;
+}
+
+redisReply* RealRedis::command(redisContext* redis_context, redisReply* reply) {
+	// If we store data correctly ...
+	if (!reply) {
+		LOG_SAMPLED(logging::TOPIC_REDIS, error, "redisCommand() is failed: {}.", redis_context->errstr);
+
+		// Handle redis server restart corectly
+		if (redis_context->err == 1 or redis_context->err == 3) {
+			// Connection refused
+			LOG_SAMPLED(logging::TOPIC_REDIS, error, "Unfortunately we can't store data in Redis because server reject connection");
+		}
+	}
+	return reply;
+}
+
+bool RealRedis::set(const std::string& key, const std::string& value) {
+	redisContext* redis_context = connect();
+	if (!redis_context) {
+		return false;
+	}
+	redisReply* reply = command(redis_context,
+			(redisReply*)redisCommand(redis_context, "SET %s %s", key.c_str(), value.c_str()));
+	if (reply) {
+		freeReplyObject(reply);
+	}
+	redisFree(redis_context);
+	return reply != nullptr;
+}
+
+bool RealRedis::del(const std::string& key) {
+	redisContext* redis_context = connect();
+	if (!redis_context) {
+		return false;
+	}
+	redisReply* reply = command(redis_context, (redisReply*)redisCommand(redis_context, "DEL %s", key.c_str()));
+	if (reply) {
+		freeReplyObject(reply);
+	}
+	redisFree(redis_context);
+	return reply != nullptr;
+}
+
+bool RealRedis::get(const std::string& key, std::string& value) {
+	value.clear();
+	redisContext* redis_context = connect();
+	if (!redis_context) {
+		return false;
+	}
+	redisReply* reply = command(redis_context, (redisReply*)redisCommand(redis_context, "GET %s", key.c_str()));
+	if (reply) {
+		if (reply->str) {
+			value = reply->str;
+		}
+		freeReplyObject(reply);
+	}
+	redisFree(redis_context);
+	return reply != nullptr;
+}
+#endif
+
+/*
+ * In-memory key/value store in place of redis-server
+ */
+class FakeRedis : public RedisBackend {
+public:
+	explicit FakeRedis(uint32_t latencyUs) : _latency(latencyUs) {}
+
+	const char* name() const override { return "fake"; }
+	bool set(const std::string& key, const std::string& value) override;
+	bool del(const std::string& key) override;
+	bool get(const std::string& key, std::string& value) override;
+
+	std::string describe();
+
+private:
+	void delay() {
+		if (_latency.count() > 0) {
+			std::this_thread::sleep_for(_latency);
+		}
+	}
+
+	std::chrono::microseconds _latency;
+	std::mutex _mtx;               /* protects everything below */
+	std::unordered_map<std::string, std::string> _keys;
+	uint64_t _sets = 0, _dels = 0, _gets = 0;
+};
+
+bool FakeRedis::set(const std::string& key, const std::string& value) {
+	delay();
+	std::lock_guard<std::mutex> lock(_mtx);
+	_keys[key] = value;
+	_sets++;
+	return true;
+}
+
+bool FakeRedis::del(const std::string& key) {
+	delay();
+	std::lock_guard<std::mutex> lock(_mtx);
+	_keys.erase(key);
+	_dels++;
+	return true;
+}
+
+bool FakeRedis::get(const std::string& key, std::string& value) {
+	delay();
+	std::lock_guard<std::mutex> lock(_mtx);
+	auto it = _keys.find(key);
+	value = (it != _keys.end()) ? it->second : std::string();
+	_gets++;
+	return true;
+}
+
+std::string FakeRedis::describe() {
+	std::lock_guard<std::mutex> lock(_mtx);
+	return "redis=fake latency_us=" + std::to_string(_latency.count()) +
+		" keys=" + std::to_string(_keys.size()) + " set=" + std::to_string(_sets) +
+		" del=" + std::to_string(_dels) + " get=" + std::to_string(_gets) + "\n";
+}
+
+namespace backend
+{
+static std::unique_ptr<WireguardBackend> wg;
+static std::unique_ptr<RedisBackend> store;
+static FakeWireguard* fake_wg = nullptr;
+static FakeRedis* fake_store = nullptr;
+
+static uint32_t latency_us(Config& config, const std::string& key) {
+	const int us = config.contains(key) ? config.getint(key) : 0;
+	return us > 0 ? us : 0;
+}
+
+void select(Config& config) {
+	const std::string wg_name = config.contains("wireguard_backend") ? config.getstr("wireguard_backend") : "kernel";
+	if (wg_name == "fake") {
+		auto fake = std::make_unique<FakeWireguard>(latency_us(config, "fake_wireguard_latency_us"));
+		fake_wg = fake.get();
+		wg = std::move(fake);
+	} else {
+		if (wg_name != "kernel") {
+			spdlog::warn("wireguard_backend({}) is unknown, kernel is used.", wg_name);
+		}
+		fake_wg = nullptr;
+		wg = std::make_unique<KernelWireguard>();
+	}
+
+#ifdef REDIS
+	const std::string redis_name = config.contains("redis_backend") ? config.getstr("redis_backend") : "redis";
+#else
+	const std::string redis_name = "fake";   /* nothing is stored without REDIS */
+#endif
+	if (redis_name == "fake") {
+		auto fake = std::make_unique<FakeRedis>(latency_us(config, "fake_redis_latency_us"));
+		fake_store = fake.get();
+		store = std::move(fake);
+	} else {
+#ifdef REDIS
+		if (redis_name != "redis") {
+			spdlog::warn("redis_backend({}) is unknown, redis is used.", redis_name);
+		}
+		fake_store = nullptr;
+		store = std::make_unique<RealRedis>();
+#endif
+	}
+
+	spdlog::info("--- backends: wireguard {}, redis {}", wg->name(), store->name());
+}
+
+WireguardBackend& wireguard() {
+	if (!wg) {
+		wg = std::make_unique<KernelWireguard>();
+	}
+	return *wg;
+}
+
+RedisBackend& redis() {
+	if (!store) {
+#ifdef REDIS
+		store = std::make_unique<RealRedis>();
+#else
+		auto fake = std::make_unique<FakeRedis>(0);
+		fake_store = fake.get();
+		store = std::move(fake);
+#endif
+	}
+	return *store;
+}
+
+std::string describe() {
+	std::string out = fake_wg ? fake_wg->describe() : "wireguard=" + std::string(wireguard().name()) + "\n";
+	out += fake_store ? fake_store->describe() : "redis=" + std::string(redis().name()) + "\n";
+	return out;
+}
+
+}
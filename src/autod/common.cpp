@@ -16,30 +16,29 @@
 #include "inc/file_descriptor.h"
 #include "inc/common.h"
 
-#include <sys/select.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <spawn.h>
 
-#define SELECT_FAILED -1
-#define SELECT_TIMEOUT 0
+extern char** environ;
+
+#define POLL_FAILED -1
+#define POLL_TIMEOUT 0
 
 namespace fd_wait
 {
 
 /**
  * monitor file descriptor and wait for I/O operation
+ * (poll: select() can't take descriptors above FD_SETSIZE, 1024)
  */
 Result waitFor(const FileDescriptor& fileDescriptor, uint32_t timeoutSeconds) {
-	struct timeval tv;
-	tv.tv_sec = timeoutSeconds;
-	tv.tv_usec = 0;
-	fd_set fds;
-
-	FD_ZERO(&fds);
-	FD_SET(fileDescriptor.get(), &fds);
-	const int selectRet = select(fileDescriptor.get() + 1, &fds, nullptr, nullptr, &tv);
+	struct pollfd pfd {fileDescriptor.get(), POLLIN, 0};
+	const int pollRet = poll(&pfd, 1, static_cast<int>(timeoutSeconds * 1000));
 
-	if (selectRet == SELECT_FAILED) {
+	if (pollRet == POLL_FAILED) {
 		return Result::FAILURE;
-	} else if (selectRet == SELECT_TIMEOUT) {
+	} else if (pollRet == POLL_TIMEOUT) {
 		return Result::TIMEOUT;
 	}
 	return Result::SUCCESS;
@@ -104,4 +103,43 @@ bool exec(const std::string& cmd, std::vector<std::string>& output_list, std::st
 	return true;
 }
 
+/**
+ * Run a program with argv(no shell involved) and wait for it
+ * Return true if it exited with 0
+ */
+bool spawn(const std::vector<std::string>& argv, std::string& error_text) {
+	if (argv.empty()) {
+		error_text = "empty argv";
+		return false;
+	}
+
+	std::vector<char*> args;
+	args.reserve(argv.size() + 1);
+	for (const auto& arg : argv) {
+		args.push_back(const_cast<char*>(arg.c_str()));
+	}
+	args.push_back(nullptr);
+
+	pid_t pid;
+	int ret = posix_spawn(&pid, args[0], nullptr, nullptr, args.data(), environ);
+	if (ret != 0) {
+		error_text = "posix_spawn(" + argv[0] + ") failed: " + strerror(ret);
+		return false;
+	}
+
+	int status = 0;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			error_text = "waitpid failed: " + std::string(strerror(errno));
+			return false;
+		}
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		error_text = argv[0] + " exited abnormally(status " + std::to_string(status) + ")";
+		return false;
+	}
+	return true;
+}
+
 }
@@ -0,0 +1,359 @@
+/*
+ * Local control socket of the server: paged dumps of clients, peers and pools
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "inc/control.h"
+#include "inc/server.h"
+#include "inc/metrics.h"
+#include "inc/logging.h"
+#include "inc/trace.h"
+#include "inc/alloc_stats.h"
+#include "inc/backend.h"
+#include "spdlog/spdlog.h"
+
+#define CONTROL_PAGE_SIZE     100
+#define CONTROL_PAGE_MAX      1000
+#define CONTROL_LINE_MAX      256
+
+namespace control
+{
+static const auto started = std::chrono::steady_clock::now();
+
+static std::string mac_string(const uint8_t* mac) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+	return buf;
+}
+
+static std::string ip_string(struct in_addr addr) {
+	char buf[INET_ADDRSTRLEN];
+	return inet_ntop(AF_INET, &addr, buf, sizeof(buf)) ? buf : "-";
+}
+
+static std::string page_header(size_t total, size_t offset, size_t count) {
+	return "OK total=" + std::to_string(total) + " offset=" + std::to_string(offset) +
+		" count=" + std::to_string(count);
+}
+
+static std::string dump_clients(size_t offset, size_t limit) {
+	std::vector<client_info_t> page;
+	const size_t total = wgacsPtr->snapshot_clients(offset, limit, page);
+
+	std::string out = page_header(total, offset, page.size()) + "\n";
+	for (const auto& client : page) {
+		out += "ip=" + client.ip + " fd=" + std::to_string(client.fd) +
+			" connected=" + std::to_string(client.connected) + " age_s=" + std::to_string(client.age_s) + "\n";
+	}
+	return out;
+}
+
+static std::string dump_peers(size_t offset, size_t limit) {
+	std::vector<peer_table_t> page;
+	const size_t total = wgacsPtr->snapshot_peers(offset, limit, page);
+
+	const time_t now = time(nullptr);
+	std::string out = page_header(total, offset, page.size()) + "\n";
+	for (const auto& peer : page) {
+		out += "mac=" + mac_string(peer.mac_addr) + " vpnip=" + ip_string(peer.vpnIP) +
+			" public_key=" + (peer.public_key[0] ? reinterpret_cast<const char*>(peer.public_key) : "-") +
+			" endpoint=" + ip_string(peer.epIP) + ":" + std::to_string(peer.epPort) +
+			" wireguard=" + std::to_string(peer.wireguard_enabled) +
+			" idle_s=" + std::to_string(peer.time ? now - peer.time : 0) + "\n";
+	}
+	return out;
+}
+
+static std::string dump_pool(size_t offset, size_t limit) {
+	size_t used, size;
+	wgacsPtr->getVipTable().get_usage(used, size);
+	std::vector<std::pair<std::string, vip_entry_t>> page;
+	const size_t total = wgacsPtr->getVipTable().snapshot_bindings(offset, limit, page);
+
+	std::string out = page_header(total, offset, page.size()) +
+		" used=" + std::to_string(used) + " size=" + std::to_string(size) + "\n";
+	for (const auto& [mac, vip] : page) {
+		struct in_addr addr;
+		addr.s_addr = vip.vpnIP;
+		out += "mac=" + mac + " vpnip=" + ip_string(addr) + " used=" + std::to_string(vip.used) + "\n";
+	}
+	return out;
+}
+
+static std::string dump_queues() {
+	const wg_apply_stats_t stats = wgacsPtr->getPeerQueue().getStats();
+	std::string out = "OK\n";
+	out += "wg_pending=" + std::to_string(wgacsPtr->getPeerQueue().pending()) +
+		" wg_queued=" + std::to_string(stats.queued) +
+		" wg_applied=" + std::to_string(stats.applied) +
+		" wg_failed=" + std::to_string(stats.failed) +
+		" wg_batches=" + std::to_string(stats.batches) +
+		" wg_queue_latency_max_us=" + std::to_string(stats.queue_latency_max) +
+		" wg_apply_latency_max_us=" + std::to_string(stats.apply_latency_max) + "\n";
+
+	size_t queued, overrun;
+	if (logging::get_queue_stats(queued, overrun)) {
+		out += "log_queued=" + std::to_string(queued) + " log_overrun=" + std::to_string(overrun) + "\n";
+	}
+	return out;
+}
+
+static std::string dump_allocs() {
+	if (!alloc_stats::enabled) {
+		return "ERR allocation accounting is not compiled in(WGAC_ALLOC_STATS)\n";
+	}
+
+	std::vector<topic_allocs_t> topics;
+	alloc_stats::snapshot(topics);
+	std::string out = "OK\n";
+	char line[256];
+	for (const auto& t : topics) {
+		snprintf(line, sizeof(line), "type=\"%s\" messages=%lu allocs=%lu bytes=%lu "
+				"allocs_per_message=%.1f bytes_per_message=%.0f\n",
+				t.topic, t.messages, t.allocs, t.bytes,
+				static_cast<double>(t.allocs) / t.messages, static_cast<double>(t.bytes) / t.messages);
+		out += line;
+	}
+	return out;
+}
+
+static std::string dump_stats() {
+	std::vector<peer_table_t> peers;
+	size_t used, size;
+	const size_t nclients = wgacsPtr->connected_clients();
+	const size_t npeers = wgacsPtr->snapshot_peers(0, 0, peers);
+	wgacsPtr->getVipTable().get_usage(used, size);
+
+	return "OK\nuptime_s=" + std::to_string(std::chrono::duration_cast<std::chrono::seconds>(
+				std::chrono::steady_clock::now() - started).count()) +
+		" config_generation=" + std::to_string(settings::get().generation) +
+		" clients=" + std::to_string(nclients) + " peers=" + std::to_string(npeers) +
+		" pool_used=" + std::to_string(used) + " pool_size=" + std::to_string(size) +
+		" wg_interfaces=" + std::to_string(wgacsPtr->wg_interfaces()) + "\n";
+}
+
+std::string execute(const std::string& line) {
+	std::istringstream in(line);
+	std::string command;
+	in >> command;
+
+	/* trace_dump_path only: a client must not pick a file for the daemon to write */
+	if (command == "trace") {
+		const long count = trace::dump();
+		if (count < 0) {
+			return "ERR trace is not written\n\n";
+		}
+		return "OK events=" + std::to_string(count) + "\n\n";
+	}
+
+	size_t offset = 0, limit = CONTROL_PAGE_SIZE;
+	std::string arg;
+	try {
+		if (in >> arg) offset = std::stoul(arg);
+		if (in >> arg) limit = std::min<size_t>(std::stoul(arg), CONTROL_PAGE_MAX);
+	} catch (const std::exception&) {
+		return "ERR invalid offset or limit: " + arg + "\n\n";
+	}
+
+	std::string reply;
+	if (command == "clients") {
+		reply = dump_clients(offset, limit);
+	} else if (command == "peers") {
+		reply = dump_peers(offset, limit);
+	} else if (command == "pool") {
+		reply = dump_pool(offset, limit);
+	} else if (command == "queues") {
+		reply = dump_queues();
+	} else if (command == "stats") {
+		reply = dump_stats();
+	} else if (command == "allocs") {
+		reply = dump_allocs();
+	} else if (command == "backends") {
+		reply = "OK\n" + backend::describe();
+	} else if (command == "metrics") {
+		reply = "OK\n" + metrics::render();
+	} else if (command == "help") {
+		reply = "OK\nclients [offset [limit]]\npeers [offset [limit]]\npool [offset [limit]]\n"
+			"queues\nstats\nallocs\nbackends\nmetrics\ntrace\nhelp\n";
+	} else {
+		reply = "ERR unknown command: " + command + "\n";
+	}
+	return reply + "\n";
+}
+
+/*
+ * Serves one connection at a time: replies are built from snapshots and
+ * are quick, a client idle for a second is dropped.
+ */
+class ControlServer {
+public:
+	~ControlServer() { stop(); }
+
+	bool start(const std::string& path);
+	void stop();
+
+private:
+	void serve();
+	void handle(int fd);
+
+	std::string _path;
+	std::thread _thread;
+	int _listenfd = -1;
+	int _pipefd[2] = {-1, -1};
+	std::atomic<bool> _running {false};
+};
+
+bool ControlServer::start(const std::string& path) {
+	if (_running) {
+		return true;
+	}
+
+	struct sockaddr_un sun {};
+	sun.sun_family = AF_UNIX;
+	if (path.empty() || path.length() >= sizeof(sun.sun_path)) {
+		spdlog::warn("control_socket({}) is not a valid path.", path);
+		return false;
+	}
+	std::memcpy(sun.sun_path, path.c_str(), path.length() + 1);
+
+	/* a socket left behind by a killed daemon */
+	struct stat st;
+	if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+		::unlink(path.c_str());
+	}
+
+	/* created owner-only(the daemon runs with umask 0): never reachable by other users */
+	_listenfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	int bound = -1;
+	if (_listenfd >= 0) {
+		const mode_t mask = umask(S_IRWXG | S_IRWXO);
+		bound = bind(_listenfd, (struct sockaddr*)&sun, sizeof(sun));
+		umask(mask);
+	}
+	if (bound < 0 ||
+			listen(_listenfd, 8) < 0 ||
+			pipe2(_pipefd, O_NONBLOCK | O_CLOEXEC) < 0) {
+		spdlog::warn("Control socket {} is not started: {}", path, strerror(errno));
+		stop();
+		return false;
+	}
+
+	_path = path;
+	_running = true;
+	_thread = std::thread(&ControlServer::serve, this);
+	spdlog::info("--- Control socket is {}", path);
+	return true;
+}
+
+void ControlServer::stop() {
+	if (_running.exchange(false) && _pipefd[1] >= 0) {
+		const char c = 'Q';
+		[[maybe_unused]] ssize_t n = write(_pipefd[1], &c, 1);
+	}
+	if (_thread.joinable()) {
+		_thread.join();
+	}
+	for (int* fd : {&_listenfd, &_pipefd[0], &_pipefd[1]}) {
+		if (*fd >= 0) {
+			::close(*fd);
+			*fd = -1;
+		}
+	}
+	if (!_path.empty()) {
+		::unlink(_path.c_str());
+		_path.clear();
+	}
+}
+
+void ControlServer::serve() {
+	struct pollfd fds[2] = {{_listenfd, POLLIN, 0}, {_pipefd[0], POLLIN, 0}};
+	while (_running) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) continue;
+			spdlog::warn("Control socket failed: {}", strerror(errno));
+			break;
+		}
+		if (fds[1].revents & POLLIN) {
+			break;
+		}
+		if (fds[0].revents & POLLIN) {
+			int fd = accept4(_listenfd, nullptr, nullptr, SOCK_CLOEXEC);
+			if (fd >= 0) {
+				handle(fd);
+				::close(fd);
+			}
+		}
+	}
+}
+
+/**
+ * Commands of one connection, until it is closed or idle
+ */
+void ControlServer::handle(int fd) {
+	struct timeval tv {1, 0};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	std::string buf;
+	char chunk[CONTROL_LINE_MAX];
+	while (_running) {
+		size_t eol;
+		while ((eol = buf.find('\n')) != std::string::npos) {
+			std::string line = buf.substr(0, eol);
+			buf.erase(0, eol + 1);
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+			if (line.empty()) {
+				continue;
+			}
+			if (line == "quit") {
+				return;
+			}
+
+			const std::string reply = execute(line);
+			for (size_t sent = 0; sent < reply.size();) {
+				ssize_t n = ::send(fd, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+				if (n <= 0) return;
+				sent += n;
+			}
+		}
+		if (buf.size() > CONTROL_LINE_MAX) {
+			return;
+		}
+
+		ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+		if (n <= 0) {
+			return;
+		}
+		buf.append(chunk, n);
+	}
+}
+
+static ControlServer server;
+
+bool start(const std::string& path) {
+	return server.start(path);
+}
+
+void stop() {
+	server.stop();
+}
+
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Heap allocation accounting(cmake -DWGAC_ALLOC_STATS=ON): the global
+ * operator new/delete count the allocations of every thread, and the
+ * receive threads charge them to the logging topic(message type) they
+ * handled. Without WGAC_ALLOC_STATS nothing is hooked and the functions
+ * below are empty.
+ */
+struct alloc_counts {
+	uint64_t allocs;
+	uint64_t bytes;
+};
+
+using alloc_counts_t = struct alloc_counts;
+
+/* allocations charged to one topic */
+struct topic_allocs {
+	const char* topic;
+	uint64_t messages;
+	uint64_t allocs;
+	uint64_t bytes;
+};
+
+using topic_allocs_t = struct topic_allocs;
+
+namespace alloc_stats
+{
+#ifdef WGAC_ALLOC_STATS
+	constexpr bool enabled = true;
+
+	alloc_counts_t thread_counts();          /* of the calling thread, since it started */
+	void record(size_t topic, const alloc_counts_t& delta);
+	void snapshot(std::vector<topic_allocs_t>& topics);   /* topics with messages only */
+	std::string render();                    /* prometheus text */
+#else
+	constexpr bool enabled = false;
+
+	inline alloc_counts_t thread_counts() { return {}; }
+	inline void record(size_t, const alloc_counts_t&) {}
+	inline void snapshot(std::vector<topic_allocs_t>&) {}
+	inline std::string render() { return {}; }
+#endif
+
+	/* allocations of the calling thread from its construction to finish() */
+	class Scope {
+	public:
+		Scope() : _start(thread_counts()) {}
+		void finish(size_t topic) {
+			if constexpr (enabled) {
+				const alloc_counts_t now = thread_counts();
+				record(topic, {now.allocs - _start.allocs, now.bytes - _start.bytes});
+			}
+		}
+
+	private:
+		alloc_counts_t _start;
+	};
+}
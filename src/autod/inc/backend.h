@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <netinet/in.h>
+#include "wg_netlink.h"
+#include "configuration.h"
+
+/*
+ * Backends of the server, selected once at startup:
+ *
+ *   wireguard_backend = kernel | fake    wireguard interfaces, peers and the server key
+ *   redis_backend = redis | fake         peer records(REDIS builds)
+ *   fake_wireguard_latency_us = 0        added to every fake set_peers()/get_peers()
+ *   fake_redis_latency_us = 0            added to every fake redis command
+ *
+ * The kernel and redis backends need root, the wireguard module, the wg/ip
+ * tools(or vtysh) and a redis-server. The fake ones keep the device and the
+ * records in memory and count every operation, so wg_autod runs on any box
+ * without privileges for load tests, and the latency models a slow backend.
+ * The fake wireguard backend uses an ephemeral server keypair instead of
+ * /qrwg/config/privatekey.
+ */
+class WireguardBackend {
+public:
+	virtual ~WireguardBackend() {}
+
+	virtual const char* name() const = 0;
+	/* curve25519 keypair of the server in base64(also the wireguard private key) */
+	virtual bool load_keypair(char pubkey[WG_KEY_LEN_BASE64], char privkey[WG_KEY_LEN_BASE64]) = 0;
+	virtual void init_interface(const std::string& ifname, struct in_addr address, struct in_addr netmask,
+			uint16_t listenPort) = 0;
+	virtual void set_address(const std::string& ifname, struct in_addr address, struct in_addr netmask) = 0;
+	/* one batch of one interface, removals ahead of the sets; peerRoutes: a /32 route per peer */
+	virtual bool set_peers(const std::string& ifname, const std::vector<wg_peer_change_t>& changes,
+			bool peerRoutes) = 0;
+	virtual bool get_peers(const std::string& ifname, std::vector<wg_device_peer_t>& peers) = 0;
+};
+
+class RedisBackend {
+public:
+	virtual ~RedisBackend() {}
+
+	virtual const char* name() const = 0;
+	virtual bool set(const std::string& key, const std::string& value) = 0;
+	virtual bool del(const std::string& key) = 0;
+	/* value is empty if the key does not exist */
+	virtual bool get(const std::string& key, std::string& value) = 0;
+};
+
+namespace backend
+{
+	/* before any other thread is started; unknown names keep the real backends */
+	void select(Config& config);
+
+	WireguardBackend& wireguard();
+	RedisBackend& redis();
+
+	/* names and recorded operations, for the "backends" control command */
+	std::string describe();
+}
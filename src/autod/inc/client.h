@@ -12,6 +12,7 @@
 #include <functional>
 #include <mutex>
 #include <atomic>
+#include <chrono>
 
 #include "pipe_ret_t.h"
 #include "client_event.h"
@@ -29,6 +30,9 @@ public:
 	void setEventsHandler(const client_event_handler_t& eventHandler) { _eventHandlerCallback = eventHandler; }
 	void publishEvent(ClientEvent clientEvent, const message_t& msg);
 	bool isConnected() const { return _isConnected; }
+	int getFd() const { return _sockfd.get(); }
+	std::chrono::steady_clock::time_point getAcceptedAt() const { return _acceptedAt; }
+	uint64_t getSession() const { return _session; }   /* trace id of the connection */
 	void setConnected(bool flag) { _isConnected = flag; }
 
 	/* for <PREPARE> stage */
@@ -39,6 +43,7 @@ public:
 
 	void startListen();
 	void send(const char* msg, size_t msg_len) const;
+	void send(const std::vector<std::string>& msgs) const;
 	void close();
 	void print() const;
 
@@ -49,6 +54,8 @@ private:
 	FileDescriptor _sockfd;
 	std::string _ip = "";
 	std::atomic<bool> _isConnected;
+	std::chrono::steady_clock::time_point _acceptedAt {std::chrono::steady_clock::now()};
+	uint64_t _session = 0;
 #ifdef LEGACY_CODE
 	std::thread* _receiveThread = nullptr;
 #else
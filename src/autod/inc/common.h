@@ -21,4 +21,5 @@ namespace common
 {
 	std::string get_mac_addr_string(const message_t& rmsg);
 	bool exec(const std::string& cmd, std::vector<std::string>& output_list, std::string& error_text);
+	bool spawn(const std::vector<std::string>& argv, std::string& error_text);
 }
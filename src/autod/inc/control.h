@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <string>
+
+/*
+ * Local control socket(unix domain, stream) of the server.
+ * One command per line, the reply is a status line, one record per line
+ * and an empty line:
+ *
+ *   clients [offset [limit]]    connected clients
+ *   peers [offset [limit]]      peer table
+ *   pool [offset [limit]]       vpn ip pool usage and bindings
+ *   queues                      wireguard apply queue and log queue
+ *   stats                       runtime summary
+ *   backends                    wireguard/redis backends, operations of the fake ones
+ *   metrics                     prometheus text of the metrics registry
+ *   help
+ *
+ *   OK total=2 offset=0 count=2
+ *   ip=192.0.2.10 fd=12 connected=1 age_s=35
+ *   ip=192.0.2.11 fd=13 connected=1 age_s=4
+ *
+ * A reply is built from snapshots, the server locks are held only to copy them.
+ */
+namespace control
+{
+	bool start(const std::string& path);
+	void stop();
+
+	/* the reply to one command line, also used without a socket */
+	std::string execute(const std::string& line);
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "message.h"
+#include "configuration.h"
+#include "spdlog/spdlog.h"
+
+/*
+ * Logging of the server: spdlog writes through a bounded queue on a
+ * background thread, so a slow stdout never stalls a message handler.
+ * Lines of the message hot path are limited per topic(message type, ...),
+ * the lines over the limit are counted and reported in one line later.
+ */
+namespace logging
+{
+	enum Topic : uint8_t {
+		TOPIC_MESSAGE = 0,                   // + AUTOCONN type(HELLO..JOIN)
+		TOPIC_OTHER_MESSAGE = 12,            // PREPARE, unknown types
+		TOPIC_KEY_EXCHANGE,
+		TOPIC_REDIS,
+		TOPIC_MAX
+	};
+
+	/* async default logger, call it after fork() */
+	bool initialize(Config& config);
+	void shutdown();                         /* writes out the queued lines */
+
+	/* lines waiting in the queue and lines dropped by a full queue, false: synchronous */
+	bool get_queue_stats(size_t& queued, size_t& overrun);
+
+	size_t topic(AUTOCONN type);
+	const char* topic_name(size_t topic);    /* static string */
+	bool sample(size_t topic);               /* false: over log_rate_limit in this second */
+}
+
+#define LOG_SAMPLED(topic, level, ...) \
+	do { \
+		if (logging::sample(topic)) { \
+			spdlog::level(__VA_ARGS__); \
+		} \
+	} while (0)
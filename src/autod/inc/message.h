@@ -21,7 +21,8 @@ enum class AUTOCONN {
 	SEND_VPN_INFORMATION           = 7,
 	SEND_VPN_INFORMATION_AGAIN     = 8,
 	START_VPN                      = 9,
-	START_VPN_AGAIN                = 10
+	START_VPN_AGAIN                = 10,
+	JOIN                           = 11   //HELLO + PING in one round trip
 };
 
 #define WG_KEY_LEN 32
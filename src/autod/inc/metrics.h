@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <string>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+
+/*
+ * Metrics registry of the server: per-stage latency histograms, event counters
+ * and gauges, exported in prometheus text format over a loopback http port.
+ * Every thread writes its own slot without locks, a scrape sums the slots.
+ */
+namespace metrics
+{
+	enum class Stage : uint8_t {
+		ACCEPT,          // accepted socket to its receive thread started
+		KEY_EXCHANGE,    // client public key received to server public key sent
+		DECRYPT,
+		PARSE,
+		HANDLER,         // one message handled, replies and redis included
+		REDIS_COMMAND,   // one redis command, connection included
+		WG_APPLY,        // one batch programmed into the wireguard device
+		SEND,            // encrypt and send of a reply
+		MAX
+	};
+
+	enum class Counter : uint8_t {
+		ACCEPTED,
+		KEY_EXCHANGE_FAILED,
+		DECRYPT_FAILED,
+		PARSE_FAILED,
+		JOIN_REJECTED,
+		MAX
+	};
+
+	void observe(Stage stage, std::chrono::steady_clock::duration elapsed);
+	void increment(Counter counter, uint64_t n = 1);
+
+	/* a gauge is read when it is scraped, read() must not block for long */
+	void addGauge(const std::string& name, const std::string& help, std::function<double()> read);
+
+	/* all metrics in prometheus text format(version 0.0.4) */
+	std::string render();
+
+	/* GET /metrics on address:port */
+	bool startServer(const std::string& address, uint16_t port);
+	void stopServer();
+
+	/* observes the time from its construction to the end of the scope */
+	class StageTimer {
+	public:
+		explicit StageTimer(Stage stage) : _stage(stage), _start(std::chrono::steady_clock::now()) {}
+		~StageTimer() { observe(_stage, std::chrono::steady_clock::now() - _start); }
+		StageTimer(const StageTimer&) = delete;
+		StageTimer& operator=(const StageTimer&) = delete;
+
+	private:
+		Stage _stage;
+		std::chrono::steady_clock::time_point _start;
+	};
+}
@@ -6,9 +6,11 @@
 
 #pragma once
 
+#include <cstdint>
 #include "message.h"
 
 namespace parser
 {
-	bool parse_new_message_string(char* rbuf, message_t* rmsg);
+	/* retry_after: seconds of the retry-after hint of a NOK, untouched if absent */
+	bool parse_new_message_string(char* rbuf, message_t* rmsg, uint32_t* retry_after = nullptr);
 }
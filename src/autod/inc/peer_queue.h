@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include "wg_netlink.h"
+
+/* completion metrics of the apply thread(latencies in microseconds) */
+struct wg_apply_stats {
+	uint64_t queued;              // changes handed to the queue
+	uint64_t applied;             // changes programmed successfully
+	uint64_t failed;              // changes in failed batches
+	uint64_t batches;             // batches applied
+	uint64_t queue_latency_sum;   // enqueue -> start of apply
+	uint64_t queue_latency_max;
+	uint64_t apply_latency_sum;   // duration of one batch
+	uint64_t apply_latency_max;
+};
+
+using wg_apply_stats_t = struct wg_apply_stats;
+
+/*
+ * Peer-change queue: message handlers push add/update/remove operations into a
+ * lock-free MPSC queue and return at once. A dedicated apply thread drains it,
+ * coalesces the changes per public key and programs the wireguard device in
+ * batches, when either the size or the time threshold is reached.
+ */
+class PeerChangeQueue {
+public:
+	PeerChangeQueue();
+	~PeerChangeQueue();
+
+	void start(const std::vector<std::string>& ifnames, size_t maxBatch, uint32_t intervalMs);
+	void stop();
+	void enqueue(const wg_peer_change_t& change);
+	size_t pending() const { return _pendingCount.load(std::memory_order_relaxed); }
+	wg_apply_stats_t getStats();
+
+private:
+	struct Node {
+		std::atomic<Node*> next {nullptr};
+		wg_peer_change_t change {};
+		std::chrono::steady_clock::time_point queued;
+		uint64_t session;             // trace session of the enqueuing handler
+	};
+
+	struct Pending {
+		wg_peer_change_t change;
+		std::chrono::steady_clock::time_point queued;   // oldest change coalesced into this one
+		uint64_t session;                               // of the latest change
+	};
+	using PendingMap = std::unordered_map<std::string, Pending>;  /* key: base64 public key + interface */
+
+	/* Vyukov intrusive MPSC queue: producers only touch _head, the apply thread only _tail */
+	void push(Node* node);
+	bool pop(wg_peer_change_t& change, std::chrono::steady_clock::time_point& queued, uint64_t& session);
+	bool empty() const;
+
+	void applyTask();
+	size_t drain(PendingMap& pending, std::chrono::steady_clock::time_point& firstQueued);
+	void flush(PendingMap& pending);
+	bool apply(const std::vector<wg_peer_change_t>& batch);
+
+	std::vector<std::string> _ifnames {"wg0"};
+	size_t _maxBatch = 64;
+	std::chrono::milliseconds _interval {50};
+
+	std::atomic<Node*> _head;
+	Node* _tail;
+	Node _stub;
+	std::atomic<size_t> _pendingCount {0};
+	std::atomic<uint64_t> _queuedTotal {0};
+
+	std::mutex _sleepMtx;          /* only used to park the idle apply thread */
+	std::condition_variable _cond;
+	std::atomic<bool> _idle {false};
+
+	std::unique_ptr<std::thread> _applyThread;
+	std::atomic<bool> _stopApplyTask {false};
+
+	std::mutex _statsMtx;          /* protects _stats */
+	wg_apply_stats_t _stats {};
+};
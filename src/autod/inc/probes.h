@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+/*
+ * USDT probes(sys/sdt.h) of wg_autod and wg_autoc, provider "wgac".
+ * A probe is a single nop in the code plus an ELF note, so they stay in the
+ * release builds and bpftrace/perf attach to them at run time, e.g.
+ *
+ *   bpftrace -e 'usdt:./wg_autod:wgac:message { @[arg1] = count(); }'
+ *   perf probe -x ./wg_autod sdt_wgac:decrypt_fail
+ *
+ * wg_autod:
+ *   accept(fd, session)                  key_exchange_done(session, ns)
+ *   decrypt_ok(session, bytes)           decrypt_fail(session, bytes)
+ *   message(session, AUTOCONN type)      vip_alloc(vpnip(network order), index)
+ *   redis_start(command)                 redis_end(command, ok)
+ *   wg_apply_start(changes)              wg_apply_end(changes, ok)
+ * wg_autoc:
+ *   key_exchange_done(pinned)
+ *   decrypt_ok(bytes)                    decrypt_fail(bytes)
+ *   message(SESSION state, AUTOCONN type)
+ *
+ * Built with WGAC_USDT(cmake -DWGAC_USDT=ON, the default when sys/sdt.h is
+ * installed), otherwise the probes are not compiled at all.
+ */
+#ifdef WGAC_USDT
+#include <sys/sdt.h>
+
+#define WGAC_PROBE1(name, a1)         DTRACE_PROBE1(wgac, name, a1)
+#define WGAC_PROBE2(name, a1, a2)     DTRACE_PROBE2(wgac, name, a1, a2)
+#else
+#define WGAC_PROBE1(name, a1)         do { (void)sizeof(a1); } while (0)
+#define WGAC_PROBE2(name, a1, a2)     do { (void)sizeof(a1); (void)sizeof(a2); } while (0)
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include "wg_netlink.h"
+
+/*
+ * Desired-state reconciler: compares the peer table with the peers actually
+ * programmed in the wireguard device and queues only the difference.
+ * Keys touched since the last pass(dirty set) are checked every interval,
+ * the whole table only every full interval. A peer found on another
+ * interface than the one it is assigned to is removed from there.
+ */
+class PeerReconciler {
+public:
+	PeerReconciler() {}
+	~PeerReconciler() { stop(); }
+
+	void start(const std::vector<std::string>& ifnames, uint32_t intervalSec, uint32_t fullIntervalSec);
+	void stop();
+	void markDirty(const uint8_t* public_key);
+
+private:
+	void reconcileTask();
+	void reconcile(bool full);
+	void diff_interface(uint16_t shard, std::vector<wg_peer_change_t>& desired,
+			std::vector<wg_device_peer_t>& current, std::vector<wg_peer_change_t>& delta);
+	bool same_peer(const wg_peer_change_t& desired, const wg_device_peer_t& current);
+
+	std::vector<std::string> _ifnames {"wg0"};
+	std::chrono::seconds _interval {10};
+	std::chrono::seconds _fullInterval {300};
+
+	std::unordered_set<std::string> _dirty;   /* base64 public keys */
+	std::mutex _mtx;                          /* protects _dirty */
+	std::condition_variable _cond;
+
+	std::unique_ptr<std::thread> _reconcileThread;
+	std::atomic<bool> _stopReconcileTask {false};
+};
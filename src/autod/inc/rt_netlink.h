@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <netinet/in.h>
+#include "nl_message.h"
+
+/* One IPv4 address of an interface */
+struct ipv4_prefix {
+	struct in_addr addr;                     // local address
+	uint8_t prefixlen;                       // cidr
+};
+
+using ipv4_prefix_t = struct ipv4_prefix;
+
+/*
+ * Minimal rtnetlink client: link creation, link state, IPv4 addresses and
+ * routes, i.e. what "ip link", "ip address" and "ip route" were forked for.
+ */
+class RtNetlink {
+public:
+	RtNetlink() {}
+	~RtNetlink() { _sock.close(); }
+
+	int link_index(const std::string& ifname);
+	bool add_wireguard_link(const std::string& ifname);
+	bool get_link_flags(int ifindex, uint32_t& flags);
+	bool set_link_up(int ifindex);
+	bool get_link_address(int ifindex, uint8_t addr[6]);
+	bool get_default_route(int& ifindex);
+
+	bool get_ipv4_addresses(int ifindex, std::vector<ipv4_prefix_t>& addrs);
+	bool add_ipv4_address(int ifindex, const ipv4_prefix_t& prefix);
+	bool del_ipv4_address(int ifindex, const ipv4_prefix_t& prefix);
+
+	bool add_ipv4_route(int ifindex, const ipv4_prefix_t& prefix);
+	bool del_ipv4_route(int ifindex, const ipv4_prefix_t& prefix);
+
+private:
+	bool open() { return _sock.open(NETLINK_ROUTE); }
+	bool change_ipv4_address(uint16_t type, uint16_t flags, int ifindex, const ipv4_prefix_t& prefix);
+	bool change_ipv4_route(uint16_t type, uint16_t flags, int ifindex, const ipv4_prefix_t& prefix);
+
+	NlSocket _sock;
+};
@@ -9,6 +9,7 @@
 
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -22,6 +23,7 @@
 #include <errno.h>
 #include <iostream>
 #include <mutex>
+#include <chrono>
 #include "client.h"
 #include "server_observer.h"
 #include "pipe_ret_t.h"
@@ -29,7 +31,22 @@
 #include "message.h"
 #include "peer_tbl.h"
 #include "vip_pool.h"
+#include "peer_queue.h"
+#include "reconciler.h"
 #include "configuration.h"
+#include "settings.h"
+
+#define WG_INTERFACES_MAX 64
+
+/* one connected client, as dumped on the control socket */
+struct client_info {
+	std::string ip;
+	int fd;
+	bool connected;
+	uint64_t age_s;                          // seconds since accept
+};
+
+using client_info_t = struct client_info;
 
 class WgacServer {
 public:
@@ -54,25 +71,49 @@ public:
 	bool send_PREPARE(const Client& client, const message_t& smsg);
 	bool send_HELLO(const Client& client, const message_t& smsg);
 	bool send_PONG(const Client& client, const message_t& smsg);
+	bool send_JOIN(const Client& client, const message_t& hello, const message_t& pong);
 	bool send_BYE(const Client& client, const message_t& smsg);
 	bool send_OK(const Client& client, const message_t& smsg);
-	bool send_NOK(const Client& client);
+	bool send_NOK(const Client& client, uint32_t retryAfter = 0);
 
 #ifndef VTYSH
 	void init_wireguard();
+	void set_wireguard_address(size_t shard, const server_settings_t& conf);
 #endif
 	void setup_wireguard(const message_t& rmsg);
-	void remove_wireguard(const uint8_t* public_key);
+	void remove_wireguard(const uint8_t* public_key, struct in_addr vpnIP = in_addr {});
+
+	/* peers are spread over wg0..wgN-1 */
+	void init_shards();
+	size_t wg_interfaces() const { return _wgInterfaces; }
+	const std::string& wg_ifname(size_t shard) const { return _wgIfnames[shard]; }
+	uint16_t wg_shard(const uint8_t* public_key) const;
+	uint16_t wg_listen_port(size_t shard) const;
+
+	/* JOIN rate limit, rejected clients get a retry-after hint in NOK */
+	bool admit_join();
+
+	/* gauges and the prometheus endpoint(metrics_port) */
+	void init_metrics();
+
+	/* side effects of a config reload */
+	void apply_settings(const server_settings_t& prev, const server_settings_t& next);
 
 	bool shouldTerminate();
 	void setTerminate(bool flag);
+	/* async-signal-safe: wakes up accept() in the main loop */
+	void wakeAccept();
 
 	std::shared_ptr<peer_table_t> get_peer_table(const message_t& rmsg);
 	bool add_peer_table(const message_t& rmsg);
 	bool update_peer_table(const message_t& rmsg);
 	bool remove_peer_table(const message_t& rmsg);
+	void enable_peer_table(const message_t& rmsg);
+	std::vector<wg_peer_change_t> get_desired_peers();
+	bool get_desired_peer(const std::string& public_key, wg_peer_change_t& change);
 
 	VipTable& getVipTable() { return _viptable; }
+	PeerChangeQueue& getPeerQueue() { return _peerQueue; }
 	Config& getConfig() { return _config; }
 
 	std::mutex& getMutex() { return _clientsMtx; }
@@ -80,8 +121,16 @@ public:
 	pipe_ret_t close();
 	void printClients();
 
+	/* a page of clients/peers for the control socket, the locks are held only to copy it */
+	size_t snapshot_clients(size_t offset, size_t limit, std::vector<client_info_t>& page);
+	size_t snapshot_peers(size_t offset, size_t limit, std::vector<peer_table_t>& page);
+	/* clients still connected(disconnected ones wait for the dead clients remover) */
+	size_t connected_clients();
+
 private:
 	void handleClientMsg(Client& client, const message_t& rmsg);
+	bool prepare_hello(const message_t& rmsg, message_t& smsg);
+	bool prepare_pong(const message_t& rmsg, message_t& smsg);
 	void handleClientDisconnected(const std::string&, const message_t& rmsg);
 	pipe_ret_t waitForClient(uint32_t timeout);
 	void clientEventHandler(Client&, ClientEvent, const message_t& msg);
@@ -106,15 +155,29 @@ private:
 	std::vector<unsigned char> _prepare_secret_key;
 
 	std::map<std::string, std::shared_ptr<peer_table_t>> _peers;
+	std::unordered_map<std::string, std::string> _peerKeys;  /* public key -> mac */
+	std::mutex _peersMtx;                                   /* protects _peers, _peerKeys */
 	VipTable _viptable;
+	PeerChangeQueue _peerQueue;
+	PeerReconciler _reconciler;
+	size_t _wgInterfaces = 1;
+	uint16_t _wgListenPort = 51820;          /* listen port of wg0 */
+	std::vector<std::string> _wgIfnames {"wg0"};
+	double _joinTokens = 0;
+	std::chrono::steady_clock::time_point _joinStamp;
+	std::mutex _joinMtx;                     /* protects _joinTokens, _joinStamp */
 	Config _config;
 
-	bool _flagTerminate;
+	std::atomic<bool> _flagTerminate;
 };
 
+/* wire format of a reply(retryAfter: NOK only) */
+std::string convert_message2string(const message_t& msg, size_t size, uint32_t retryAfter = 0);
+
 /////////////////////////////////////////////////////////////////
 extern std::unique_ptr<WgacServer> wgacsPtr;
 extern "C" {
 	bool initialize_curve25519(char *pubkey, char *privkey);
 	bool key_from_base64(uint8_t key[WG_KEY_LEN], const char *base64);
+	void key_to_base64(char base64[WG_KEY_LEN_BASE64], const uint8_t key[WG_KEY_LEN]);
 }
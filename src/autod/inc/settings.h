@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <netinet/in.h>
+#include "message.h"
+#include "configuration.h"
+
+/*
+ * Typed snapshot of server.conf. It is built once per (re)load and never
+ * changed after it is published, so readers need no lock.
+ */
+struct server_settings {
+	uint64_t generation;                     // 1: startup, +1 per reload
+	uint16_t server_port;
+	struct in_addr this_vpn_ip;
+	struct in_addr this_vpn_netmask;
+	uint8_t this_public_key[WG_KEY_LEN_BASE64];  // base64, nul terminated
+	struct in_addr this_endpoint_ip;
+	uint16_t this_endpoint_port;
+	uint8_t this_allowed_ips[256];           // nul terminated, as in message_t
+	struct in_addr vpnip_range_begin;
+	struct in_addr vpnip_range_end;
+	int join_rate_limit;                     // JOINs per second, 0: no limit
+	uint32_t nok_retry_after_s;
+};
+
+using server_settings_t = struct server_settings;
+
+namespace settings
+{
+	/* current snapshot: one atomic load, valid until the process exits */
+	const server_settings_t& get();
+
+	/* build a snapshot from a parsed config and publish it */
+	bool load(Config& config);
+
+	/* the public key derived from the private key replaces this_public_key, in every later snapshot too */
+	void set_public_key(const std::string& pubkey);
+
+	/* reload on SIGHUP(requestReload) or when the file is rewritten */
+	void startWatcher(const std::string& path,
+			std::function<void(const server_settings_t& prev, const server_settings_t& next)> onReload);
+	void stopWatcher();
+	void requestReload();                    /* async-signal-safe */
+}
@@ -17,6 +17,10 @@ namespace sodium_ae
 	std::vector<unsigned char> encrypt_message(const std::vector<unsigned char>& message,
 		const std::vector<unsigned char>& receiver_public_key,
 		const std::vector<unsigned char>& sender_secret_key);
+	/* length-prefixed frame at the head of data: its size, 0 if incomplete or bad_frame */
+	size_t frame_size(const unsigned char* data, size_t size, bool& bad_frame);
+	/* the frame at the head of a receive buffer moved into frame, false if incomplete or bad_frame */
+	bool next_frame(std::vector<unsigned char>& rbuf, std::vector<unsigned char>& frame, bool& bad_frame);
 	std::vector<unsigned char> decrypt_message(std::vector<unsigned char>& encrypted_message,
 		const std::vector<unsigned char>& sender_public_key,
 		const std::vector<unsigned char>& receiver_secret_key,
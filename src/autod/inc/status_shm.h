@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "message.h"
+
+/*
+ * Status segment of the server in /dev/shm(status_shm_path), for local
+ * readers like wgac_ui and monitoring agents: mmap() it read-only and call
+ * wgac_status_read(). The server rewrites it every status_interval_ms.
+ *
+ *   wgac_status_header | wgac_status_peer[peer_capacity]
+ *
+ * A seqlock makes every read a consistent snapshot: seq is odd while the
+ * server writes, a reader retries when seq was odd or has changed.
+ * Readers must check magic and version, and use header_size and
+ * peer_record_size as strides, so fields can be appended later.
+ */
+#define WGAC_STATUS_MAGIC    0x43414757u   /* "WGAC" */
+#define WGAC_STATUS_VERSION  1
+
+struct wgac_status_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seq;                            // seqlock: odd while being written
+	uint32_t header_size;                    // offset of the first peer record
+	uint32_t peer_record_size;
+	uint32_t peer_capacity;                  // peer records in the segment
+	int32_t pid;
+	uint32_t reserved;
+	int64_t started;                         // unix time of the server start
+	int64_t updated_ns;                      // CLOCK_REALTIME of the last update
+	uint64_t config_generation;
+	uint32_t clients;                        // connected clients
+	uint32_t peers;                          // peers in the peer table
+	uint32_t peer_count;                     // valid peer records(<= peer_capacity)
+	uint32_t pool_used;
+	uint32_t pool_size;
+	uint32_t wg_pending;                     // changes waiting for the wireguard apply thread
+};
+
+using wgac_status_header_t = struct wgac_status_header;
+
+struct wgac_status_peer {
+	int64_t last_seen;                       // unix time of the last message
+	uint8_t mac_addr[6];
+	uint8_t wireguard_enabled;
+	uint8_t reserved;
+	uint32_t vpnIP;                          // network byte order
+	uint32_t epIP;                           // network byte order
+	uint16_t epPort;
+	uint16_t reserved2;
+	uint8_t public_key[WG_KEY_LEN_BASE64];   // base64, nul terminated
+	uint8_t pad[7];
+};
+
+using wgac_status_peer_t = struct wgac_status_peer;
+
+static_assert(sizeof(wgac_status_header_t) == 80, "status header layout");
+static_assert(sizeof(wgac_status_peer_t) == 80, "status peer layout");
+
+/**
+ * Copy a consistent snapshot out of a mapped segment(no syscalls, no locks).
+ * Returns false if the segment is not valid or keeps changing.
+ */
+inline bool wgac_status_read(const void* base, wgac_status_header_t& head,
+		wgac_status_peer_t* peers, uint32_t max_peers, int retries = 1000) {
+	const wgac_status_header_t* shm = static_cast<const wgac_status_header_t*>(base);
+	if (shm->magic != WGAC_STATUS_MAGIC || shm->version != WGAC_STATUS_VERSION) {
+		return false;
+	}
+
+	for (int i = 0; i < retries; i++) {
+		const uint32_t seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			continue;
+		}
+		std::memcpy(&head, shm, sizeof(head));
+		const uint32_t count = head.peer_count < max_peers ? head.peer_count : max_peers;
+		const uint8_t* records = static_cast<const uint8_t*>(base) + head.header_size;
+		for (uint32_t n = 0; n < count; n++) {
+			std::memcpy(&peers[n], records + n * head.peer_record_size, sizeof(wgac_status_peer_t));
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == seq) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* the writer side, in wg_autod */
+namespace status_shm
+{
+	bool start(const std::string& path, uint32_t intervalMs, uint32_t peerCapacity);
+	void stop();
+}
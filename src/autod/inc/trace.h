@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+/*
+ * Session timeline of the server. Every accepted connection gets a session
+ * id, the stages of a session are recorded as spans in a ring buffer of the
+ * thread running them, and the rings are dumped in chrome trace-event json
+ * (chrome://tracing, ui.perfetto.dev) on SIGUSR2 or the control "trace" command.
+ */
+namespace trace
+{
+	/* trace_ring_size spans per thread(0: tracing off), SIGUSR2 dumps to path */
+	void start(size_t ringSize, const std::string& path);
+	void stop();
+	bool enabled();
+
+	uint64_t newSession();
+	void setSession(uint64_t session);       /* session of the calling thread */
+	uint64_t currentSession();
+	void setThreadName(const std::string& name);
+
+	/* name must be a string literal(or live as long as the process) */
+	void record(const char* name, uint64_t session, std::chrono::steady_clock::time_point start,
+			std::chrono::steady_clock::time_point end, uint64_t arg = 0);
+
+	/* to the path given to start(), returns the number of spans written, -1 on error */
+	long dump();
+	void requestDump();                      /* async-signal-safe */
+
+	/* records the time from its construction to the end of the scope */
+	class Span {
+	public:
+		explicit Span(const char* name, uint64_t arg = 0) :
+			Span(name, currentSession(), arg) {}
+		Span(const char* name, uint64_t session, uint64_t arg) :
+			_name(name), _session(session), _arg(arg), _start(std::chrono::steady_clock::now()) {}
+		~Span() { record(_name, _session, _start, std::chrono::steady_clock::now(), _arg); }
+		Span(const Span&) = delete;
+		Span& operator=(const Span&) = delete;
+
+	private:
+		const char* _name;
+		uint64_t _session;
+		uint64_t _arg;
+		std::chrono::steady_clock::time_point _start;
+	};
+}
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include "configuration.h"
@@ -34,6 +35,8 @@ public:
 	std::shared_ptr<vip_entry_t> add_address_binding(const message_t& rmsg);
 	bool update_address_binding(const message_t& rmsg);
 	bool remove_address_binding(const message_t& rmsg);
+	void get_usage(size_t& used, size_t& size);
+	size_t snapshot_bindings(size_t offset, size_t limit, std::vector<std::pair<std::string, vip_entry_t>>& page);
 
 	uint32_t byteArrayToIpAddress(const uint8_t ipBytes0, const uint8_t ipBytes1,
 			const uint8_t ipBytes2, const uint8_t ipBytes3);
@@ -43,4 +46,5 @@ private:
 	std::vector<vip_entry_t> _vip_pool_table;
 	struct pool_indexes _vip_pool_index;
 	std::map<std::string, std::shared_ptr<vip_entry_t>> _vip_used_table;
+	std::mutex _mtx;                         /* a config reload rebuilds the pool */
 };
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2025 Chunghan Yi <chunghan.yi@gmail.com>
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
  *
  * SPDX-License-Identifier: MIT
  */
@@ -8,6 +8,7 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 
 namespace vtyshell
 {
@@ -30,6 +31,14 @@ namespace vtyshell
 
 	void initializeVtyshMap();
 	std::vector<std::string> split(std::string s, std::string delimiter);
+
+	/* command batcher: queued commands run in one vtysh invocation, "write" is debounced.
+	 * runCommand(s) wait for that invocation and return its result. */
+	void startBatcher(uint32_t writeIntervalMs);
+	void stopBatcher();
 	bool runCommand(const char* buf);
+	bool runCommands(const std::vector<std::string>& cmds, bool write = false);
+	void requestWrite();
+
 	bool doAction(std::string& s);
 }
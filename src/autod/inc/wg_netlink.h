@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "message.h"
+#include "nl_message.h"
+
+/* One pending peer operation for the wireguard device */
+struct wg_peer_change {
+	enum class Op {
+		SET,                                 // add or update the peer
+		REMOVE                               // remove the peer
+	} op;
+	uint8_t public_key[WG_KEY_LEN_BASE64];   // base64 public key of the peer
+	struct in_addr vpnIP;                    // allowed ip(/32) of the peer
+	struct in_addr epIP;                     // endpoint IP address of the peer
+	uint16_t epPort;                         // endpoint port of the peer
+	uint16_t keepalive;                      // persistent keepalive interval
+	uint16_t shard;                          // index of the wireguard interface(wg<shard>)
+};
+
+using wg_peer_change_t = struct wg_peer_change;
+
+/* One peer as it is currently programmed in the wireguard device */
+struct wg_device_peer {
+	uint8_t public_key[WG_KEY_LEN_BASE64];   // base64 public key of the peer
+	struct in_addr vpnIP;                    // first IPv4 allowed ip of the peer
+	uint8_t cidr;                            // prefix length of vpnIP
+	uint32_t allowedIPs;                     // number of allowed ips
+};
+
+using wg_device_peer_t = struct wg_device_peer;
+
+/*
+ * Minimal generic netlink client for the wireguard kernel module.
+ * Several peers are packed into one WG_CMD_SET_DEVICE message, so that
+ * a burst of peer changes costs a few syscalls instead of a fork per peer.
+ */
+class WgNetlink {
+public:
+	WgNetlink() {}
+	~WgNetlink() { close(); }
+
+	bool open();
+	void close();
+	bool isOpen() const { return _sock.isOpen() && _family != 0; }
+
+	bool set_peers(const std::string& ifname, const std::vector<wg_peer_change_t>& changes);
+	bool get_peers(const std::string& ifname, std::vector<wg_device_peer_t>& peers);
+
+private:
+	bool resolve_family();
+
+	NlSocket _sock;
+	uint16_t _family = 0;
+};
@@ -0,0 +1,134 @@
+/*
+ * Asynchronous and rate limited logging of the server
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <atomic>
+#include <chrono>
+#include "inc/logging.h"
+#include "spdlog/async.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#define LOG_QUEUE_SIZE  8192
+#define LOG_RATE_LIMIT  20     /* lines per second per topic */
+
+namespace logging
+{
+static const char* topic_names[TOPIC_MAX] = {
+	"HELLO", "PING", "PONG", "OK", "NOK", "BYE", "EXIST",
+	"SEND_VPN_INFORMATION", "SEND_VPN_INFORMATION_AGAIN", "START_VPN", "START_VPN_AGAIN", "JOIN",
+	"other message", "key exchange", "redis"
+};
+
+/*
+ * One second window per topic. The first line of a new window reports the
+ * lines dropped in the previous ones.
+ */
+class LogSampler {
+public:
+	void setLimit(uint32_t limit) { _limit = limit; }
+	bool sample(size_t topic);
+
+private:
+	std::atomic<int64_t> _window[TOPIC_MAX] {};
+	std::atomic<uint32_t> _count[TOPIC_MAX] {};
+	std::atomic<uint32_t> _dropped[TOPIC_MAX] {};
+	uint32_t _limit = LOG_RATE_LIMIT;        /* 0: no limit */
+};
+
+bool LogSampler::sample(size_t topic) {
+	if (_limit == 0 || topic >= TOPIC_MAX) {
+		return true;
+	}
+
+	const int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	int64_t window = _window[topic].load(std::memory_order_relaxed);
+	if (window != now && _window[topic].compare_exchange_strong(window, now)) {
+		_count[topic].store(0, std::memory_order_relaxed);
+		uint32_t dropped = _dropped[topic].exchange(0);
+		if (dropped > 0) {
+			spdlog::info("--- {} log lines of {} were dropped(log_rate_limit {}/s).",
+					dropped, topic_names[topic], _limit);
+		}
+	}
+
+	if (_count[topic].fetch_add(1, std::memory_order_relaxed) < _limit) {
+		return true;
+	}
+	_dropped[topic].fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+static LogSampler sampler;
+
+/**
+ * Replace the default logger by an async one.
+ *   log_queue_size: lines the queue holds
+ *   log_overflow: drop_oldest(default) or block, when the queue is full
+ *   log_rate_limit: lines per second per topic(0: no limit)
+ */
+bool initialize(Config& config) {
+	size_t queueSize = LOG_QUEUE_SIZE;
+	auto policy = spdlog::async_overflow_policy::overrun_oldest;
+	try {
+		if (config.contains("log_queue_size") && config.getint("log_queue_size") > 0) {
+			queueSize = config.getint("log_queue_size");
+		}
+		if (config.contains("log_overflow") && config.getstr("log_overflow") == "block") {
+			policy = spdlog::async_overflow_policy::block;
+		}
+		if (config.contains("log_rate_limit") && config.getint("log_rate_limit") >= 0) {
+			sampler.setLimit(config.getint("log_rate_limit"));
+		}
+	} catch (const std::exception& e) {
+		spdlog::warn("Invalid logging setting({}), the defaults are used.", e.what());
+	}
+
+	try {
+		spdlog::init_thread_pool(queueSize, 1);
+		auto sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+		auto logger = std::make_shared<spdlog::async_logger>("", sink,
+				spdlog::thread_pool(), policy);
+		logger->set_level(spdlog::default_logger()->level());
+		spdlog::set_default_logger(logger);
+	} catch (const spdlog::spdlog_ex& e) {
+		spdlog::warn("Async logger is not available({}), logging stays synchronous.", e.what());
+		return false;
+	}
+	return true;
+}
+
+void shutdown() {
+	spdlog::shutdown();
+}
+
+bool get_queue_stats(size_t& queued, size_t& overrun) {
+	auto pool = spdlog::thread_pool();
+	if (!pool) {
+		return false;
+	}
+	queued = pool->queue_size();
+	overrun = pool->overrun_counter();
+	return true;
+}
+
+size_t topic(AUTOCONN type) {
+	const int t = static_cast<int>(type);
+	if (t >= static_cast<int>(AUTOCONN::HELLO) && t <= static_cast<int>(AUTOCONN::JOIN)) {
+		return TOPIC_MESSAGE + t;
+	}
+	return TOPIC_OTHER_MESSAGE;
+}
+
+const char* topic_name(size_t topic) {
+	return topic < TOPIC_MAX ? topic_names[topic] : "unknown";
+}
+
+bool sample(size_t topic) {
+	return sampler.sample(topic);
+}
+
+}
@@ -13,6 +13,13 @@
 #include "inc/common.h"
 #include "inc/vtysh.h"
 #include "inc/configuration.h"
+#include "inc/settings.h"
+#include "inc/metrics.h"
+#include "inc/logging.h"
+#include "inc/control.h"
+#include "inc/status_shm.h"
+#include "inc/trace.h"
+#include "inc/backend.h"
 #include "inc/sodium_ae.h"
 #include "spdlog/spdlog.h"
 #include <boost/program_options.hpp>
@@ -23,17 +30,25 @@ const std::string prog_name { "wg_autod" };
 const std::string versionString { "v0.8.90" }; 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Async-signal-safe only: the handler may run on any thread(also one that the
+ * shutdown joins), so it just raises flags. The main loop does the shutdown.
+ */
 static void sig_handler(int sig) {
 	switch (sig) {
 		case SIGINT:
 		case SIGTERM:
 		case SIGQUIT:
-			spdlog::info(">>> Received signal {}, exiting...", sig);
 			if (wgacsPtr) {
 				wgacsPtr->setTerminate(true);
-				wgacsPtr->close();
+				wgacsPtr->wakeAccept();
 			}
-			std::_Exit(EXIT_SUCCESS);
+			break;
+		case SIGHUP:
+			settings::requestReload();
+			break;
+		case SIGUSR2:
+			trace::requestDump();
 			break;
 		default:
 			break;
@@ -86,12 +101,15 @@ void acceptClients() {
 	try {
 		std::string clientIP = wgacsPtr->acceptClient(0);
 	} catch (const std::runtime_error &error) {
-		spdlog::error("Accepting client failed: {}", error.what());
+		if (!wgacsPtr->shouldTerminate()) {
+			spdlog::error("Accepting client failed: {}", error.what());
+		}
 	}
 }
 
 int main(int argc, char* argv[]) {
 	bool daemonize {false};
+	std::string config_path;
 	namespace po = boost::program_options;
 	unsigned short wgac_server_port {51822};
 
@@ -131,9 +149,20 @@ int main(int argc, char* argv[]) {
 		}
 
 		if (vm.count("config")) {
-			if (wgacsPtr->getConfig().parse(vm["config"].as<std::string>()) == false) {
+			config_path = vm["config"].as<std::string>();
+			if (wgacsPtr->getConfig().parse(config_path) == false) {
 				return EXIT_FAILURE;
 			}
+			if (!settings::load(wgacsPtr->getConfig())) {
+				spdlog::error("Configuration file {} is not valid.", config_path);
+				return EXIT_FAILURE;
+			}
+			/* a daemon runs in /, so reloads need the absolute path */
+			char* abs_path = realpath(config_path.c_str(), nullptr);
+			if (abs_path) {
+				config_path = abs_path;
+				free(abs_path);
+			}
 		} else {
 			spdlog::error("Configuration file is not specified.");
 			return EXIT_FAILURE;
@@ -172,15 +201,37 @@ int main(int argc, char* argv[]) {
 		}
 	}
 
+	// Async logging: its thread must be started after fork()
+	logging::initialize(wgacsPtr->getConfig());
+
+	// Wireguard and redis backends(kernel/redis, or in-memory fakes for load tests)
+	backend::select(wgacsPtr->getConfig());
+
+	// Session spans, dumped as a chrome trace on SIGUSR2(trace_ring_size = 0: disabled)
+	int ring_size = wgacsPtr->getConfig().contains("trace_ring_size") ?
+		wgacsPtr->getConfig().getint("trace_ring_size") : 256;
+	trace::start(ring_size > 0 ? ring_size : 0, wgacsPtr->getConfig().contains("trace_dump_path") ?
+			wgacsPtr->getConfig().getstr("trace_dump_path") : "/tmp/wg_autod.trace.json");
+	trace::setThreadName("accept");
+
 	::signal(SIGINT, sig_handler);
 	::signal(SIGQUIT, sig_handler);
 	::signal(SIGTERM, sig_handler);
+	::signal(SIGHUP, sig_handler);
+	::signal(SIGUSR2, sig_handler);
+
+	// Initialize the wireguard interface list(wg0..wgN-1)
+	wgacsPtr->init_shards();
 
 	// Initialize VPN IP table
 	wgacsPtr->getVipTable().initialize_viptable();
 
 	// Initialize vtysh map table
 	vtyshell::initializeVtyshMap();
+#ifdef VTYSH
+	vtyshell::startBatcher(wgacsPtr->getConfig().contains("vtysh_write_interval_ms") ?
+			wgacsPtr->getConfig().getint("vtysh_write_interval_ms") : 1000);
+#endif
 
 	// Initialize libsodium
 	sodium_ae::initialize_sodium();
@@ -188,12 +239,13 @@ int main(int argc, char* argv[]) {
 	// Initialize curve25519 keypair(private/public keys)
 	char pubkey_base64[WG_KEY_LEN_BASE64] {};
 	char privkey_base64[WG_KEY_LEN_BASE64] {};
-	if (!initialize_curve25519(pubkey_base64, privkey_base64)) {
+	if (!backend::wireguard().load_keypair(pubkey_base64, privkey_base64)) {
 		spdlog::warn("Failed to get curve25519 keypair.");
 	} else {
 		spdlog::debug("WireGuard public key => {}", pubkey_base64);
 		std::string s(pubkey_base64);
 		wgacsPtr->getConfig().setstr("this_public_key", s);
+		settings::set_public_key(s);
 
 		//After decoding in base64 to obtain 32 bytes, store them in the class private area.
 		uint8_t key[WG_KEY_LEN];
@@ -208,10 +260,7 @@ int main(int argc, char* argv[]) {
 #endif
 	}
 
-	if (wgacsPtr->getConfig().getint("server_port") >= 1024 &&
-		wgacsPtr->getConfig().getint("server_port") < 65536) {
-		wgac_server_port = wgacsPtr->getConfig().getint("server_port");	
-	}
+	wgac_server_port = settings::get().server_port;
 	spdlog::info("Starting the {}(tcp port {})...", prog_name, wgac_server_port);
 	pipe_ret_t startRet = wgacsPtr->start(wgac_server_port);
 	if (!startRet.isSuccessful()) {
@@ -220,12 +269,47 @@ int main(int argc, char* argv[]) {
 		return EXIT_FAILURE;
 	}
 
+	// Gauges and the prometheus endpoint
+	wgacsPtr->init_metrics();
+
+	// Control socket for live introspection(control_socket = "": disabled)
+	std::string control_path = wgacsPtr->getConfig().contains("control_socket") ?
+		wgacsPtr->getConfig().getstr("control_socket") : "/var/run/wg_autod.sock";
+	if (!control_path.empty()) {
+		control::start(control_path);
+	}
+
+	// Status segment for local readers(status_shm_path = "": disabled)
+	Config& config = wgacsPtr->getConfig();
+	std::string status_path = config.contains("status_shm_path") ?
+		config.getstr("status_shm_path") : "/dev/shm/wg_autod.status";
+	if (!status_path.empty()) {
+		int interval = config.contains("status_interval_ms") ? config.getint("status_interval_ms") : 100;
+		int capacity = config.contains("status_peers_max") ? config.getint("status_peers_max") : 4096;
+		status_shm::start(status_path, interval > 0 ? interval : 100, capacity > 0 ? capacity : 4096);
+	}
+
+	// Reload the config on SIGHUP or when the file is rewritten
+	settings::startWatcher(config_path, [](const server_settings_t& prev, const server_settings_t& next) {
+		wgacsPtr->apply_settings(prev, next);
+	});
+
 	while (!wgacsPtr->shouldTerminate()) {
 		acceptClients();
 	}
+	spdlog::info(">>> Termination requested, exiting...");
 
+	settings::stopWatcher();
+	status_shm::stop();
+	control::stop();
+	metrics::stopServer();
 	wgacsPtr->close();
+#ifdef VTYSH
+	vtyshell::stopBatcher();
+#endif
+	trace::stop();
 	spdlog::info("The {} is stopped.", prog_name);
+	logging::shutdown();
 
 	return EXIT_SUCCESS;
 }
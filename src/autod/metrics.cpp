@@ -0,0 +1,355 @@
+/*
+ * Metrics registry and prometheus endpoint of the server
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <atomic>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "inc/metrics.h"
+#include "inc/alloc_stats.h"
+#include "spdlog/spdlog.h"
+
+/*
+ * HDR style buckets: 4 linear sub-buckets per power of two, from 1us to ~15s.
+ * The upper bound of a bucket is at most 25% above the values it holds.
+ */
+#define BUCKET_SUBS       4
+#define BUCKET_EXPONENTS  24
+#define BUCKETS           (BUCKET_SUBS * BUCKET_EXPONENTS)
+
+namespace metrics
+{
+static constexpr size_t STAGES = static_cast<size_t>(Stage::MAX);
+static constexpr size_t COUNTERS = static_cast<size_t>(Counter::MAX);
+
+static const char* stage_names[STAGES] = {
+	"accept", "key_exchange", "decrypt", "parse", "handler", "redis", "wg_apply", "send"
+};
+
+static const struct {
+	const char* name;
+	const char* help;
+} counter_names[COUNTERS] = {
+	{"wgac_connections_accepted_total", "Client connections accepted."},
+	{"wgac_key_exchange_failures_total", "Connections closed during the public key exchange."},
+	{"wgac_decrypt_failures_total", "Messages failing authenticated decryption."},
+	{"wgac_parse_failures_total", "Messages failing to parse."},
+	{"wgac_join_rejected_total", "JOIN requests over join_rate_limit."},
+};
+
+/* the metrics of one thread: written by that thread only, read by scrapes */
+struct Slot {
+	std::atomic<uint64_t> buckets[STAGES][BUCKETS + 1];   // +1: over the last bound
+	std::atomic<uint64_t> sum_ns[STAGES];
+	std::atomic<uint64_t> counters[COUNTERS];
+	std::atomic<bool> inUse {true};
+};
+
+static inline void slot_add(std::atomic<uint64_t>& value, uint64_t n) {
+	/* single writer: no read-modify-write instruction needed */
+	value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+class MetricsRegistry {
+public:
+	MetricsRegistry();
+	~MetricsRegistry() { stopServer(); }
+
+	void observe(Stage stage, uint64_t ns);
+	void increment(Counter counter, uint64_t n);
+	void addGauge(const std::string& name, const std::string& help, std::function<double()> read);
+	std::string render();
+	bool startServer(const std::string& address, uint16_t port);
+	void stopServer();
+
+private:
+	struct Gauge {
+		std::string name;
+		std::string help;
+		std::function<double()> read;
+	};
+
+	Slot* slot();
+	void serve();
+	void handle(int fd);
+
+	uint64_t _bounds[BUCKETS];               /* upper bounds in ns */
+	std::mutex _mtx;                         /* protects _slots, _gauges */
+	std::vector<Slot*> _slots;               /* never freed: a slot outlives its thread */
+	std::vector<Gauge> _gauges;
+
+	std::thread _thread;
+	int _listenfd = -1;
+	int _pipefd[2] = {-1, -1};
+	std::atomic<bool> _running {false};
+};
+
+MetricsRegistry::MetricsRegistry() {
+	for (size_t e = 0; e < BUCKET_EXPONENTS; e++) {
+		for (size_t s = 0; s < BUCKET_SUBS; s++) {
+			_bounds[e * BUCKET_SUBS + s] = (1000ULL << e) * (BUCKET_SUBS + s) / BUCKET_SUBS;
+		}
+	}
+}
+
+/**
+ * Slot of the calling thread. A slot released by an exited thread is reused,
+ * so the per connection threads don't make the list grow.
+ */
+Slot* MetricsRegistry::slot() {
+	struct SlotRef {
+		Slot* slot = nullptr;
+		~SlotRef() {
+			if (slot) slot->inUse.store(false, std::memory_order_release);
+		}
+	};
+	thread_local SlotRef ref;
+
+	if (ref.slot == nullptr) {
+		std::lock_guard<std::mutex> lock(_mtx);
+		for (Slot* s : _slots) {
+			bool expected = false;
+			if (s->inUse.compare_exchange_strong(expected, true)) {
+				ref.slot = s;
+				break;
+			}
+		}
+		if (ref.slot == nullptr) {
+			ref.slot = new Slot();
+			_slots.push_back(ref.slot);
+		}
+	}
+	return ref.slot;
+}
+
+void MetricsRegistry::observe(Stage stage, uint64_t ns) {
+	const size_t i = static_cast<size_t>(stage);
+	const size_t bucket = std::lower_bound(_bounds, _bounds + BUCKETS, ns) - _bounds;
+	Slot* s = slot();
+	slot_add(s->buckets[i][bucket], 1);
+	slot_add(s->sum_ns[i], ns);
+}
+
+void MetricsRegistry::increment(Counter counter, uint64_t n) {
+	slot_add(slot()->counters[static_cast<size_t>(counter)], n);
+}
+
+void MetricsRegistry::addGauge(const std::string& name, const std::string& help, std::function<double()> read) {
+	std::lock_guard<std::mutex> lock(_mtx);
+	_gauges.push_back(Gauge {name, help, std::move(read)});
+}
+
+std::string MetricsRegistry::render() {
+	uint64_t buckets[STAGES][BUCKETS + 1] {};
+	uint64_t sum_ns[STAGES] {};
+	uint64_t counters[COUNTERS] {};
+	std::vector<Gauge> gauges;
+	{
+		std::lock_guard<std::mutex> lock(_mtx);
+		for (const Slot* s : _slots) {
+			for (size_t i = 0; i < STAGES; i++) {
+				for (size_t b = 0; b <= BUCKETS; b++) {
+					buckets[i][b] += s->buckets[i][b].load(std::memory_order_relaxed);
+				}
+				sum_ns[i] += s->sum_ns[i].load(std::memory_order_relaxed);
+			}
+			for (size_t c = 0; c < COUNTERS; c++) {
+				counters[c] += s->counters[c].load(std::memory_order_relaxed);
+			}
+		}
+		gauges = _gauges;   /* read outside the lock, a gauge may take other locks */
+	}
+
+	std::string out;
+	char line[256];
+	out.reserve(64 * 1024);
+
+	out += "# HELP wgac_stage_duration_seconds Latency of the request stages.\n";
+	out += "# TYPE wgac_stage_duration_seconds histogram\n";
+	for (size_t i = 0; i < STAGES; i++) {
+		uint64_t count = 0;
+		for (size_t b = 0; b < BUCKETS; b++) {
+			count += buckets[i][b];
+			snprintf(line, sizeof(line), "wgac_stage_duration_seconds_bucket{stage=\"%s\",le=\"%.9g\"} %lu\n",
+					stage_names[i], _bounds[b] / 1e9, count);
+			out += line;
+		}
+		count += buckets[i][BUCKETS];
+		snprintf(line, sizeof(line), "wgac_stage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %lu\n"
+				"wgac_stage_duration_seconds_sum{stage=\"%s\"} %.9g\n"
+				"wgac_stage_duration_seconds_count{stage=\"%s\"} %lu\n",
+				stage_names[i], count, stage_names[i], sum_ns[i] / 1e9, stage_names[i], count);
+		out += line;
+	}
+
+	for (size_t c = 0; c < COUNTERS; c++) {
+		snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n%s %lu\n",
+				counter_names[c].name, counter_names[c].help,
+				counter_names[c].name, counter_names[c].name, counters[c]);
+		out += line;
+	}
+
+	for (const auto& gauge : gauges) {
+		snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s gauge\n%s %.9g\n",
+				gauge.name.c_str(), gauge.help.c_str(),
+				gauge.name.c_str(), gauge.name.c_str(), gauge.read());
+		out += line;
+	}
+
+	if constexpr (alloc_stats::enabled) {
+		out += alloc_stats::render();
+	}
+	return out;
+}
+
+bool MetricsRegistry::startServer(const std::string& address, uint16_t port) {
+	if (_running) {
+		return true;
+	}
+
+	struct sockaddr_in sin {};
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	if (inet_pton(AF_INET, address.c_str(), &sin.sin_addr) != 1) {
+		spdlog::warn("metrics_address({}) is not an IPv4 address.", address);
+		return false;
+	}
+
+	_listenfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	const int option = 1;
+	if (_listenfd < 0 ||
+			setsockopt(_listenfd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option)) < 0 ||
+			bind(_listenfd, (struct sockaddr*)&sin, sizeof(sin)) < 0 ||
+			listen(_listenfd, 8) < 0 ||
+			pipe2(_pipefd, O_NONBLOCK | O_CLOEXEC) < 0) {
+		spdlog::warn("Metrics endpoint {}:{} is not started: {}", address, port, strerror(errno));
+		stopServer();
+		return false;
+	}
+
+	_running = true;
+	_thread = std::thread(&MetricsRegistry::serve, this);
+	spdlog::info("--- Metrics are served on http://{}:{}/metrics", address, port);
+	return true;
+}
+
+void MetricsRegistry::stopServer() {
+	if (_running.exchange(false) && _pipefd[1] >= 0) {
+		const char c = 'Q';
+		[[maybe_unused]] ssize_t n = write(_pipefd[1], &c, 1);
+	}
+	if (_thread.joinable()) {
+		_thread.join();
+	}
+	for (int* fd : {&_listenfd, &_pipefd[0], &_pipefd[1]}) {
+		if (*fd >= 0) {
+			::close(*fd);
+			*fd = -1;
+		}
+	}
+}
+
+/**
+ * Thread routine: one scrape at a time, scrapers are few and the answer is quick
+ */
+void MetricsRegistry::serve() {
+	struct pollfd fds[2] = {{_listenfd, POLLIN, 0}, {_pipefd[0], POLLIN, 0}};
+	while (_running) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) continue;
+			spdlog::warn("Metrics endpoint failed: {}", strerror(errno));
+			break;
+		}
+		if (fds[1].revents & POLLIN) {
+			break;
+		}
+		if (fds[0].revents & POLLIN) {
+			int fd = accept4(_listenfd, nullptr, nullptr, SOCK_CLOEXEC);
+			if (fd >= 0) {
+				handle(fd);
+				::close(fd);
+			}
+		}
+	}
+}
+
+void MetricsRegistry::handle(int fd) {
+	struct timeval tv {1, 0};   /* a stuck scraper must not block the next one for long */
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	char request[2048];
+	size_t len = 0;
+	while (len < sizeof(request) - 1) {
+		ssize_t n = ::recv(fd, request + len, sizeof(request) - 1 - len, 0);
+		if (n <= 0) break;
+		len += n;
+		request[len] = '\0';
+		if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+	}
+	request[len] = '\0';
+
+	std::string status, body;
+	if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0) {
+		status = "200 OK";
+		body = render();
+	} else if (strncmp(request, "GET ", 4) == 0) {
+		status = "404 Not Found";
+		body = "Not Found\n";
+	} else {
+		status = "405 Method Not Allowed";
+		body = "Method Not Allowed\n";
+	}
+
+	std::string response = "HTTP/1.1 " + status + "\r\n"
+		"Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+		"Content-Length: " + std::to_string(body.size()) + "\r\n"
+		"Connection: close\r\n\r\n" + body;
+	for (size_t sent = 0; sent < response.size();) {
+		ssize_t n = ::send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+		if (n <= 0) break;
+		sent += n;
+	}
+}
+
+static MetricsRegistry registry;
+
+void observe(Stage stage, std::chrono::steady_clock::duration elapsed) {
+	registry.observe(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+void increment(Counter counter, uint64_t n) {
+	registry.increment(counter, n);
+}
+
+void addGauge(const std::string& name, const std::string& help, std::function<double()> read) {
+	registry.addGauge(name, help, std::move(read));
+}
+
+std::string render() {
+	return registry.render();
+}
+
+bool startServer(const std::string& address, uint16_t port) {
+	return registry.startServer(address, port);
+}
+
+void stopServer() {
+	registry.stopServer();
+}
+
+}
@@ -0,0 +1,283 @@
+/*
+ * Peer-change queue routines(asynchronous, batched wireguard peer programming)
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <arpa/inet.h>
+#include "inc/peer_queue.h"
+#include "inc/backend.h"
+#include "inc/metrics.h"
+#include "inc/trace.h"
+#include "inc/probes.h"
+#include "spdlog/spdlog.h"
+
+using steady_clock = std::chrono::steady_clock;
+
+PeerChangeQueue::PeerChangeQueue() : _head(&_stub), _tail(&_stub) {
+}
+
+PeerChangeQueue::~PeerChangeQueue() {
+	stop();
+
+	/* nothing is left after stop(), except when the thread was never started */
+	wg_peer_change_t change;
+	steady_clock::time_point queued;
+	uint64_t session;
+	while (pop(change, queued, session)) {
+	}
+	if (_tail != &_stub) {
+		delete _tail;
+	}
+}
+
+/**
+ * Start the apply thread
+ */
+void PeerChangeQueue::start(const std::vector<std::string>& ifnames, size_t maxBatch, uint32_t intervalMs) {
+	_ifnames = ifnames;
+	_maxBatch = (maxBatch > 0) ? maxBatch : 1;
+	_interval = std::chrono::milliseconds(intervalMs);
+	_stopApplyTask = false;
+
+	if (!_applyThread) {
+		_applyThread = std::make_unique<std::thread>(&PeerChangeQueue::applyTask, this);
+	}
+	spdlog::debug("--- peer-change queue started({} interface(s), batch {}, interval {}ms)",
+			_ifnames.size(), _maxBatch, intervalMs);
+}
+
+/**
+ * Stop the apply thread. It applies whatever is still queued before it exits.
+ */
+void PeerChangeQueue::stop() {
+	if (_applyThread) {
+		{
+			std::lock_guard<std::mutex> lock(_sleepMtx);
+			_stopApplyTask = true;
+		}
+		_cond.notify_all();
+		if (_applyThread->joinable()) {
+			_applyThread->join();
+		}
+		_applyThread.reset();
+
+		wg_apply_stats_t stats = getStats();
+		spdlog::info("--- peer-change queue stopped({} queued, {} applied, {} failed in {} batches).",
+				stats.queued, stats.applied, stats.failed, stats.batches);
+	}
+}
+
+/**
+ * Queue a peer change. Never blocks: the caller(message handler) returns at once
+ * and the apply thread programs the device later.
+ */
+void PeerChangeQueue::enqueue(const wg_peer_change_t& change) {
+	Node* node = new Node;
+	node->change = change;
+	node->queued = steady_clock::now();
+	node->session = trace::currentSession();
+
+	_pendingCount.fetch_add(1, std::memory_order_relaxed);
+	_queuedTotal.fetch_add(1, std::memory_order_relaxed);
+	push(node);
+
+	/* wake the apply thread only when it is parked */
+	if (_idle.load()) {
+		std::lock_guard<std::mutex> lock(_sleepMtx);
+		_cond.notify_one();
+	}
+}
+
+wg_apply_stats_t PeerChangeQueue::getStats() {
+	std::lock_guard<std::mutex> lock(_statsMtx);
+	wg_apply_stats_t stats = _stats;
+	stats.queued = _queuedTotal.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void PeerChangeQueue::push(Node* node) {
+	node->next.store(nullptr, std::memory_order_relaxed);
+	Node* prev = _head.exchange(node);
+	prev->next.store(node);
+}
+
+/**
+ * Called by the apply thread only. The last node popped stays as the new stub.
+ */
+bool PeerChangeQueue::pop(wg_peer_change_t& change, steady_clock::time_point& queued, uint64_t& session) {
+	Node* tail = _tail;
+	Node* next = tail->next.load(std::memory_order_acquire);
+	if (next == nullptr) {
+		return false;
+	}
+
+	change = next->change;
+	queued = next->queued;
+	session = next->session;
+	_tail = next;
+	if (tail != &_stub) {
+		delete tail;
+	}
+	return true;
+}
+
+bool PeerChangeQueue::empty() const {
+	return _tail->next.load() == nullptr;
+}
+
+/**
+ * Move queued changes into the coalescing map. A later change for the same
+ * public key on the same interface replaces the earlier one.
+ * Returns the number of changes taken.
+ */
+size_t PeerChangeQueue::drain(PendingMap& pending, steady_clock::time_point& firstQueued) {
+	size_t count = 0;
+	wg_peer_change_t change;
+	steady_clock::time_point queued;
+	uint64_t session;
+
+	while (pending.size() < _maxBatch && pop(change, queued, session)) {
+		if (pending.empty()) {
+			firstQueued = queued;
+		}
+		std::string key(reinterpret_cast<const char*>(change.public_key));
+		key += ':' + std::to_string(change.shard);
+		auto [it, inserted] = pending.try_emplace(key, Pending {change, queued, session});
+		if (!inserted) {
+			it->second.change = change;
+			it->second.session = session;
+		}
+		count++;
+	}
+	return count;
+}
+
+/**
+ * Thread routine: apply a batch when it is full or its oldest change gets older than the interval
+ */
+void PeerChangeQueue::applyTask() {
+	PendingMap pending;
+	steady_clock::time_point firstQueued;
+	size_t taken = 0;
+	trace::setThreadName("wg apply");
+
+	while (true) {
+		taken += drain(pending, firstQueued);
+		const bool stopping = _stopApplyTask.load();
+
+		if (!pending.empty() &&
+				(stopping || pending.size() >= _maxBatch || steady_clock::now() >= firstQueued + _interval)) {
+			flush(pending);
+			_pendingCount.fetch_sub(taken, std::memory_order_relaxed);
+			taken = 0;
+			continue;
+		}
+
+		if (stopping) {
+			if (empty()) break;
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_sleepMtx);
+		_idle.store(true);
+		if (empty() && !_stopApplyTask) {
+			if (pending.empty()) {
+				_cond.wait(lock);
+			} else {
+				_cond.wait_until(lock, firstQueued + _interval);
+			}
+		}
+		_idle.store(false);
+	}
+}
+
+/**
+ * Apply the coalesced changes(removals first) at once and record the metrics
+ */
+void PeerChangeQueue::flush(PendingMap& pending) {
+	std::vector<wg_peer_change_t> batch;
+	batch.reserve(pending.size());
+
+	const auto start = steady_clock::now();
+	uint64_t queueLatencySum = 0, queueLatencyMax = 0;
+	for (const auto& [key, entry] : pending) {
+		batch.push_back(entry.change);
+		uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(start - entry.queued).count();
+		queueLatencySum += us;
+		queueLatencyMax = std::max(queueLatencyMax, us);
+		trace::record("wg_queue", entry.session, entry.queued, start);
+	}
+	pending.clear();
+
+	std::stable_partition(batch.begin(), batch.end(), [](const wg_peer_change_t& c) {
+		return c.op == wg_peer_change_t::Op::REMOVE;
+	});
+
+	WGAC_PROBE1(wg_apply_start, batch.size());
+	const bool ok_flag = apply(batch);
+	WGAC_PROBE2(wg_apply_end, batch.size(), ok_flag);
+	const auto end = steady_clock::now();
+	metrics::observe(metrics::Stage::WG_APPLY, end - start);
+	trace::record("wg_apply", 0, start, end, batch.size());
+	const uint64_t applyLatency = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+	{
+		std::lock_guard<std::mutex> lock(_statsMtx);
+		_stats.batches++;
+		if (ok_flag) {
+			_stats.applied += batch.size();
+		} else {
+			_stats.failed += batch.size();
+		}
+		_stats.queue_latency_sum += queueLatencySum;
+		_stats.queue_latency_max = std::max(_stats.queue_latency_max, queueLatencyMax);
+		_stats.apply_latency_sum += applyLatency;
+		_stats.apply_latency_max = std::max(_stats.apply_latency_max, applyLatency);
+	}
+
+	spdlog::debug("--- wireguard batch of {}: queue latency max {}us, apply latency {}us",
+			batch.size(), queueLatencyMax, applyLatency);
+}
+
+/**
+ * Program a batch into the wireguard backend, one call per interface
+ */
+bool PeerChangeQueue::apply(const std::vector<wg_peer_change_t>& batch) {
+	bool ok_flag = true;
+	size_t removed = std::count_if(batch.begin(), batch.end(), [](const wg_peer_change_t& c) {
+		return c.op == wg_peer_change_t::Op::REMOVE;
+	});
+
+	/* removals stay ahead of the sets */
+	std::vector<std::vector<wg_peer_change_t>> shards(_ifnames.size());
+	for (const auto& change : batch) {
+		if (change.shard < shards.size()) {
+			shards[change.shard].push_back(change);
+		} else {
+			spdlog::warn("Peer change for unknown interface wg{} is dropped.", change.shard);
+			ok_flag = false;
+		}
+	}
+	for (size_t shard = 0; shard < shards.size(); shard++) {
+		if (!shards[shard].empty() &&
+				!backend::wireguard().set_peers(_ifnames[shard], shards[shard], _ifnames.size() > 1)) {
+			ok_flag = false;
+		}
+	}
+
+	if (ok_flag) {
+		spdlog::info("--- OK, wireguard batch is applied({} set, {} removed).",
+				batch.size() - removed, removed);
+	} else {
+		spdlog::warn("--- NOK, wireguard batch is failed({} set, {} removed).",
+				batch.size() - removed, removed);
+	}
+	return ok_flag;
+}
@@ -15,20 +15,16 @@
 #include "inc/message.h"
 #include "inc/common.h"
 #include "inc/peer_tbl.h"
+#include "inc/metrics.h"
+#include "inc/trace.h"
+#include "inc/probes.h"
+#include "inc/logging.h"
+#include "inc/backend.h"
 #include "spdlog/spdlog.h"
-#include <hiredis/hiredis.h>
 
 //#define DEBUG
 
 #ifdef REDIS
-const unsigned int redis_port { 6379 };
-const std::string redis_host  { "127.0.0.1" };
-
-redisContext* redis_init_connection();
-void store_data_in_redis(std::string key_name, std::string value_details);
-void remove_data_in_redis(std::string key_name);
-void get_data_in_redis(std::string key_name);
-
 std::string trimstr(const std::string& s) {
 	constexpr const char* whitespace{ " \t\r\n\v\f" };
 
@@ -40,118 +36,47 @@ std::string trimstr(const std::string& s) {
 }
 
 void store_data_in_redis(std::string key_name, std::string value_details) {
-	redisReply* reply           = nullptr;
-	redisContext* redis_context = redis_init_connection();
-
-	if (!redis_context) {
-		spdlog::error("Could not initiate connection to Redis.");
-		return;
-	}
-
-	reply = (redisReply*)redisCommand(redis_context, "SET %s %s", key_name.c_str(), value_details.c_str());
+	metrics::StageTimer timer(metrics::Stage::REDIS_COMMAND);
+	trace::Span span("redis");
 
-	// If we store data correctly ...
-	if (!reply) {
-		spdlog::error("redisCommand() is failed: {}.", redis_context->errstr);
-
-		// Handle redis server restart corectly
-		if (redis_context->err == 1 or redis_context->err == 3) {
-			// Connection refused
-			spdlog::error("Unfortunately we can't store data in Redis because server reject connection");
-		}
-	} else {
-		freeReplyObject(reply);
-	}
-
-	redisFree(redis_context);
+	WGAC_PROBE1(redis_start, "SET");
+	const bool ok_flag = backend::redis().set(key_name, value_details);
+	WGAC_PROBE2(redis_end, "SET", ok_flag);
 }
 
 void remove_data_in_redis(std::string key_name) {
-	redisReply* reply           = nullptr;
-	redisContext* redis_context = redis_init_connection();
-
-	if (!redis_context) {
-		spdlog::error("Could not initiate connection to Redis.");
-		return;
-	}
-
-	reply = (redisReply*)redisCommand(redis_context, "DEL %s", key_name.c_str());
+	metrics::StageTimer timer(metrics::Stage::REDIS_COMMAND);
+	trace::Span span("redis");
 
-	// If we store data correctly ...
-	if (!reply) {
-		spdlog::error("redisCommand() is failed: {}.", redis_context->errstr);
-
-		// Handle redis server restart corectly
-		if (redis_context->err == 1 or redis_context->err == 3) {
-			// Connection refused
-			spdlog::error("Unfortunately we can't store data in Redis because server reject connection");
-		}
-	} else {
-		freeReplyObject(reply);
-	}
-
-	redisFree(redis_context);
+	WGAC_PROBE1(redis_start, "DEL");
+	const bool ok_flag = backend::redis().del(key_name);
+	WGAC_PROBE2(redis_end, "DEL", ok_flag);
 }
 
 void get_data_in_redis(std::string key_name) {
-	redisReply* reply           = nullptr;
-	redisContext* redis_context = redis_init_connection();
-
-	if (!redis_context) {
-		spdlog::error("Could not initiate connection to Redis.");
-		return;
-	}
-
-	reply = (redisReply*)redisCommand(redis_context, "GET %s", key_name.c_str());
-
-	// If we store data correctly ...
-	if (!reply) {
-		spdlog::error("redisCommand() is failed: {}.", redis_context->errstr);
-
-		// Handle redis server restart corectly
-		if (redis_context->err == 1 or redis_context->err == 3) {
-			// Connection refused
-			spdlog::error("Unfortunately we can't store data in Redis because server reject connection");
-		}
-	} else {
-		if (reply->str) {
-			spdlog::info("### reply->str -----> [{}]", reply->str);
-			std::string line {reply->str}, word {};
-			std::stringstream ss {line};
-			while (std::getline(ss, word, ' ')) {
-				if (word.empty()) continue;
-				spdlog::info("### value field: [{}]", trimstr(word).c_str());
-			}
+	metrics::StageTimer timer(metrics::Stage::REDIS_COMMAND);
+	trace::Span span("redis");
+	std::string value;
+
+	WGAC_PROBE1(redis_start, "GET");
+	const bool ok_flag = backend::redis().get(key_name, value);
+	WGAC_PROBE2(redis_end, "GET", ok_flag);
+
+	if (!value.empty()) {
+		spdlog::info("### reply->str -----> [{}]", value);
+		std::string word {};
+		std::stringstream ss {value};
+		while (std::getline(ss, word, ' ')) {
+			if (word.empty()) continue;
+			spdlog::info("### value field: [{}]", trimstr(word).c_str());
 		}
-
-		freeReplyObject(reply);
 	}
-
-	redisFree(redis_context);
-}
-
-redisContext* redis_init_connection() {
-	struct timeval timeout      = { 1, 500000 }; // 1.5 seconds
-	redisContext* redis_context = redisConnectWithTimeout(redis_host.c_str(), redis_port, timeout);
-	if (redis_context->err) {
-		spdlog::error("Redis connection error: {}", redis_context->errstr);
-		return nullptr;
-	}
-
-	// We should check connection with ping because redis do not check connection
-	redisReply* reply = (redisReply*)redisCommand(redis_context, "PING");
-	if (reply) {
-		freeReplyObject(reply);
-	} else {
-		return nullptr;
-	}
-
-	return redis_context;
 }
 #endif
 
 /**
  * Get a peer(remote client) from the rclient table
+ * (caller holds _peersMtx)
  */
 std::shared_ptr<peer_table_t> WgacServer::get_peer_table(const message_t& rmsg) {
 	std::string macstr = common::get_mac_addr_string(rmsg);
@@ -170,12 +95,15 @@ std::shared_ptr<peer_table_t> WgacServer::get_peer_table(const message_t& rmsg)
 bool WgacServer::add_peer_table(const message_t& rmsg) {
 	std::string macstr = common::get_mac_addr_string(rmsg);
 
+	std::unique_lock<std::mutex> lock(_peersMtx);
 	std::shared_ptr<peer_table_t> peer = get_peer_table(rmsg);
 	if (peer == nullptr) {
 		std::shared_ptr<peer_table_t> peer = std::make_shared<peer_table_t>();
 		if (peer) {
 			std::memcpy(peer->mac_addr, rmsg.mac_addr, 6);
+			peer->time = time(nullptr);
 			_peers.insert(std::make_pair(macstr, peer));
+			lock.unlock();
 
 #ifdef REDIS
 			char macbuf[32], vpnIP_str[16], vpnNetmask_str[16], xbuf[512];
@@ -206,6 +134,7 @@ bool WgacServer::add_peer_table(const message_t& rmsg) {
 			return false;
 		}
 	} else {
+		peer->time = time(nullptr);
 		return true;
 	}
 }
@@ -216,23 +145,40 @@ bool WgacServer::add_peer_table(const message_t& rmsg) {
 bool WgacServer::update_peer_table(const message_t& rmsg) {
 	std::string macstr = common::get_mac_addr_string(rmsg);
 
+	std::unique_lock<std::mutex> lock(_peersMtx);
 	std::shared_ptr<peer_table_t> peer = get_peer_table(rmsg);
 	if (peer) {
 		std::memcpy(peer->mac_addr, rmsg.mac_addr, 6);
+		struct in_addr old_vpnIP = peer->vpnIP;
 		peer->vpnIP.s_addr = rmsg.vpnIP.s_addr;
 		peer->vpnNetmask.s_addr = rmsg.vpnNetmask.s_addr;
 
 		/* if peer's public key is changed, let's remove old wireguard peer entry info. */
 		//spdlog::info("peer->public_key: [{}].", peer->public_key);
+		uint8_t old_key[WG_KEY_LEN_BASE64] {};
 		if (memcmp(peer->public_key, rmsg.public_key, WG_KEY_LEN_BASE64)) {
-			if (strlen(reinterpret_cast<const char*>(peer->public_key)) == WG_KEY_LEN_BASE64-1) 
-				remove_wireguard(peer->public_key);
+			if (strlen(reinterpret_cast<const char*>(peer->public_key)) == WG_KEY_LEN_BASE64-1) {
+				std::memcpy(old_key, peer->public_key, WG_KEY_LEN_BASE64);
+				auto it = _peerKeys.find(reinterpret_cast<const char*>(old_key));
+				if (it != _peerKeys.end() && it->second == macstr) {
+					_peerKeys.erase(it);
+				}
+			}
+			peer->wireguard_enabled = 0;
 		}
 		std::memcpy(peer->public_key, rmsg.public_key, WG_KEY_LEN_BASE64);
+		peer->public_key[WG_KEY_LEN_BASE64 - 1] = '\0';
+		_peerKeys[reinterpret_cast<const char*>(peer->public_key)] = macstr;
 
 		peer->epIP.s_addr = rmsg.epIP.s_addr;
 		peer->epPort = rmsg.epPort;
 		std::memcpy(peer->allowed_ips, rmsg.allowed_ips, 256);
+		peer->time = time(nullptr);
+		lock.unlock();
+
+		if (old_key[0] != '\0') {
+			remove_wireguard(old_key, old_vpnIP);
+		}
 
 #ifdef REDIS
 		char macbuf[32], vpnIP_str[16], vpnNetmask_str[16], xbuf[512];
@@ -270,12 +216,18 @@ bool WgacServer::update_peer_table(const message_t& rmsg) {
 bool WgacServer::remove_peer_table(const message_t& rmsg) {
 	std::string macstr = common::get_mac_addr_string(rmsg);
 
+	std::unique_lock<std::mutex> lock(_peersMtx);
 	auto it = _peers.find(macstr);
 	if (it != _peers.end()) {
 		if (it->second) {
+			auto kt = _peerKeys.find(reinterpret_cast<const char*>(it->second->public_key));
+			if (kt != _peerKeys.end() && kt->second == macstr) {
+				_peerKeys.erase(kt);
+			}
 			(it->second).reset();
 		}
 		_peers.erase(macstr);
+		lock.unlock();
 
 #ifdef REDIS
 		char macbuf[32];
@@ -298,3 +250,62 @@ bool WgacServer::remove_peer_table(const message_t& rmsg) {
 		return false;
 	}
 }
+
+/**
+ * Mark a peer as programmed into wireguard(desired state for the reconciler)
+ */
+void WgacServer::enable_peer_table(const message_t& rmsg) {
+	std::lock_guard<std::mutex> lock(_peersMtx);
+	std::shared_ptr<peer_table_t> peer = get_peer_table(rmsg);
+	if (peer) {
+		peer->wireguard_enabled = 1;
+	}
+}
+
+static void fill_peer_change(const peer_table_t& peer, wg_peer_change_t& change) {
+	change.op = wg_peer_change_t::Op::SET;
+	std::memcpy(change.public_key, peer.public_key, WG_KEY_LEN_BASE64);
+	change.public_key[WG_KEY_LEN_BASE64 - 1] = '\0';
+	change.vpnIP = peer.vpnIP;
+	change.epIP = peer.epIP;
+	change.epPort = peer.epPort;
+	change.keepalive = 25;
+	change.shard = wgacsPtr->wg_shard(change.public_key);
+}
+
+/**
+ * Snapshot of every wireguard-enabled peer in the rclient table
+ */
+std::vector<wg_peer_change_t> WgacServer::get_desired_peers() {
+	std::vector<wg_peer_change_t> desired;
+	std::lock_guard<std::mutex> lock(_peersMtx);
+
+	desired.reserve(_peers.size());
+	for (const auto& [macstr, peer] : _peers) {
+		if (peer && peer->wireguard_enabled) {
+			wg_peer_change_t change {};
+			fill_peer_change(*peer, change);
+			desired.push_back(change);
+		}
+	}
+	return desired;
+}
+
+/**
+ * Look up the desired state of one public key
+ * Return false if the key should not be present in wireguard
+ */
+bool WgacServer::get_desired_peer(const std::string& public_key, wg_peer_change_t& change) {
+	std::lock_guard<std::mutex> lock(_peersMtx);
+
+	auto kt = _peerKeys.find(public_key);
+	if (kt == _peerKeys.end()) {
+		return false;
+	}
+	auto it = _peers.find(kt->second);
+	if (it == _peers.end() || !it->second || !it->second->wireguard_enabled) {
+		return false;
+	}
+	fill_peer_change(*it->second, change);
+	return true;
+}
@@ -0,0 +1,210 @@
+/*
+ * Desired-state reconciliation between the peer table and the wireguard device
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include "inc/server.h"
+#include "inc/reconciler.h"
+#include "inc/backend.h"
+#include "spdlog/spdlog.h"
+
+/**
+ * Start the reconciler thread
+ */
+void PeerReconciler::start(const std::vector<std::string>& ifnames, uint32_t intervalSec, uint32_t fullIntervalSec) {
+	_ifnames = ifnames;
+	_interval = std::chrono::seconds(intervalSec);
+	_fullInterval = std::chrono::seconds(fullIntervalSec);
+	_stopReconcileTask = false;
+
+	if (!_reconcileThread) {
+		_reconcileThread = std::make_unique<std::thread>(&PeerReconciler::reconcileTask, this);
+	}
+	spdlog::debug("--- reconciler started(interval {}s, full {}s)", intervalSec, fullIntervalSec);
+}
+
+void PeerReconciler::stop() {
+	if (_reconcileThread) {
+		{
+			std::lock_guard<std::mutex> lock(_mtx);
+			_stopReconcileTask = true;
+		}
+		_cond.notify_all();
+		if (_reconcileThread->joinable()) {
+			_reconcileThread->join();
+		}
+		_reconcileThread.reset();
+	}
+}
+
+/**
+ * Remember a public key whose state has to be verified in the next pass
+ */
+void PeerReconciler::markDirty(const uint8_t* public_key) {
+	std::lock_guard<std::mutex> lock(_mtx);
+	_dirty.emplace(reinterpret_cast<const char*>(public_key));
+}
+
+/**
+ * Thread routine: the first full pass runs only after one full interval,
+ * so that clients have a chance to come back after a restart.
+ */
+void PeerReconciler::reconcileTask() {
+	auto nextFull = std::chrono::steady_clock::now() + _fullInterval;
+
+	std::unique_lock<std::mutex> lock(_mtx);
+	while (!_stopReconcileTask) {
+		_cond.wait_for(lock, _interval, [this] { return _stopReconcileTask.load(); });
+		if (_stopReconcileTask) break;
+
+		const bool full = (std::chrono::steady_clock::now() >= nextFull);
+		if (!full && _dirty.empty()) continue;
+
+		lock.unlock();
+		reconcile(full);
+		if (full) {
+			nextFull = std::chrono::steady_clock::now() + _fullInterval;
+		}
+		lock.lock();
+	}
+}
+
+/**
+ * Endpoints are not compared, since wireguard updates them itself when a peer roams.
+ */
+bool PeerReconciler::same_peer(const wg_peer_change_t& desired, const wg_device_peer_t& current) {
+	return current.allowedIPs == 1 && current.cidr == 32 &&
+		current.vpnIP.s_addr == desired.vpnIP.s_addr;
+}
+
+static wg_peer_change_t removal(uint16_t shard, const wg_device_peer_t& peer) {
+	wg_peer_change_t change {};
+	change.op = wg_peer_change_t::Op::REMOVE;
+	std::memcpy(change.public_key, peer.public_key, WG_KEY_LEN_BASE64);
+	change.vpnIP = (peer.allowedIPs > 0) ? peer.vpnIP : in_addr {};
+	change.shard = shard;
+	return change;
+}
+
+/**
+ * Sorted merge of the peers wanted on one interface against its dump
+ */
+void PeerReconciler::diff_interface(uint16_t shard, std::vector<wg_peer_change_t>& desired,
+		std::vector<wg_device_peer_t>& current, std::vector<wg_peer_change_t>& delta) {
+	std::sort(desired.begin(), desired.end(), [](const auto& a, const auto& b) {
+		return std::memcmp(a.public_key, b.public_key, WG_KEY_LEN_BASE64) < 0;
+	});
+	std::sort(current.begin(), current.end(), [](const auto& a, const auto& b) {
+		return std::memcmp(a.public_key, b.public_key, WG_KEY_LEN_BASE64) < 0;
+	});
+
+	size_t i = 0, j = 0;
+	while (i < desired.size() || j < current.size()) {
+		int cmp;
+		if (i == desired.size()) cmp = 1;
+		else if (j == current.size()) cmp = -1;
+		else cmp = std::memcmp(desired[i].public_key, current[j].public_key, WG_KEY_LEN_BASE64);
+
+		if (cmp < 0) {
+			delta.push_back(desired[i++]);
+		} else if (cmp > 0) {
+			delta.push_back(removal(shard, current[j++]));
+		} else {
+			if (!same_peer(desired[i], current[j])) {
+				delta.push_back(desired[i]);
+			}
+			i++;
+			j++;
+		}
+	}
+}
+
+/**
+ * Diff the devices against the peer table and queue the delta.
+ * A change racing with a client message is fixed up in the next pass,
+ * because every handler marks its key dirty again.
+ */
+void PeerReconciler::reconcile(bool full) {
+	std::unordered_set<std::string> dirty;
+	{
+		std::lock_guard<std::mutex> lock(_mtx);
+		dirty.swap(_dirty);
+	}
+
+	/* an interface that can't be read is skipped, nothing is removed from it */
+	std::vector<std::vector<wg_device_peer_t>> current(_ifnames.size());
+	std::vector<bool> readable(_ifnames.size(), false);
+	bool all_readable = true;
+	for (size_t shard = 0; shard < _ifnames.size(); shard++) {
+		readable[shard] = backend::wireguard().get_peers(_ifnames[shard], current[shard]);
+		if (!readable[shard]) {
+			spdlog::debug("reconciler: can't read peers of {}.", _ifnames[shard]);
+			all_readable = false;
+		}
+	}
+	if (!all_readable) {
+		std::lock_guard<std::mutex> lock(_mtx);
+		_dirty.insert(dirty.begin(), dirty.end());
+	}
+
+	std::vector<wg_peer_change_t> delta;
+	if (full) {
+		std::vector<std::vector<wg_peer_change_t>> desired(_ifnames.size());
+		for (auto& change : wgacsPtr->get_desired_peers()) {
+			if (change.shard < desired.size()) {
+				desired[change.shard].push_back(change);
+			}
+		}
+		for (size_t shard = 0; shard < _ifnames.size(); shard++) {
+			if (readable[shard]) {
+				diff_interface(shard, desired[shard], current[shard], delta);
+			}
+		}
+	} else {
+		/* only the dirty keys are looked up */
+		std::unordered_map<std::string, std::vector<std::pair<uint16_t, const wg_device_peer_t*>>> found;
+		for (size_t shard = 0; shard < _ifnames.size(); shard++) {
+			for (const auto& peer : current[shard]) {
+				std::string key(reinterpret_cast<const char*>(peer.public_key));
+				if (dirty.count(key)) {
+					found[key].emplace_back(shard, &peer);
+				}
+			}
+		}
+
+		for (const auto& key : dirty) {
+			wg_peer_change_t desired {};
+			const bool wanted = wgacsPtr->get_desired_peer(key, desired);
+			if (wanted && (desired.shard >= _ifnames.size() || !readable[desired.shard])) continue;
+
+			bool in_sync = false;
+			for (const auto& [shard, peer] : found[key]) {
+				if (wanted && shard == desired.shard) {
+					in_sync = same_peer(desired, *peer);
+				} else {
+					delta.push_back(removal(shard, *peer));
+				}
+			}
+			if (wanted && !in_sync) {
+				delta.push_back(desired);
+			}
+		}
+	}
+
+	if (!delta.empty()) {
+		spdlog::info("--- reconciler: {} peer(s) drifted from the peer table.", delta.size());
+		for (const auto& change : delta) {
+			wgacsPtr->getPeerQueue().enqueue(change);
+		}
+	} else {
+		spdlog::debug("--- reconciler: {} interface(s) in sync({} pass).",
+				_ifnames.size(), full ? "full" : "incremental");
+	}
+}
@@ -0,0 +1,243 @@
+/*
+ * rtnetlink routines(link, IPv4 address and route configuration)
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cstring>
+#include <net/if.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+#include "inc/rt_netlink.h"
+#include "spdlog/spdlog.h"
+
+/**
+ * Return the interface index, 0 if the interface does not exist
+ */
+int RtNetlink::link_index(const std::string& ifname) {
+	return if_nametoindex(ifname.c_str());
+}
+
+/**
+ * RTM_NEWLINK: ip link add dev <ifname> type wireguard
+ */
+bool RtNetlink::add_wireguard_link(const std::string& ifname) {
+	if (!open()) {
+		return false;
+	}
+
+	NlMessage msg(RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, sizeof(struct ifinfomsg));
+	msg.header<struct ifinfomsg>()->ifi_family = AF_UNSPEC;
+	msg.put_str(IFLA_IFNAME, ifname);
+	size_t linkinfo = msg.nest_start(IFLA_LINKINFO);
+	msg.put_str(IFLA_INFO_KIND, "wireguard");
+	msg.nest_end(linkinfo);
+
+	return _sock.transact(msg.buffer());
+}
+
+/**
+ * RTM_GETLINK: read the IFF_* flags of an interface
+ */
+bool RtNetlink::get_link_flags(int ifindex, uint32_t& flags) {
+	if (!open()) {
+		return false;
+	}
+
+	NlMessage msg(RTM_GETLINK, 0, sizeof(struct ifinfomsg));
+	msg.header<struct ifinfomsg>()->ifi_family = AF_UNSPEC;
+	msg.header<struct ifinfomsg>()->ifi_index = ifindex;
+
+	bool found = false;
+	bool ok = _sock.transact(msg.buffer(), [&](const struct nlmsghdr* nlh) {
+		if (nlh->nlmsg_type != RTM_NEWLINK) return;
+		const struct ifinfomsg* ifi = reinterpret_cast<const struct ifinfomsg*>(NLMSG_DATA(nlh));
+		if (ifi->ifi_index == ifindex) {
+			flags = ifi->ifi_flags;
+			found = true;
+		}
+	});
+	return ok && found;
+}
+
+/**
+ * RTM_NEWLINK: ip link set up dev <ifname>
+ */
+bool RtNetlink::set_link_up(int ifindex) {
+	if (!open()) {
+		return false;
+	}
+
+	NlMessage msg(RTM_NEWLINK, 0, sizeof(struct ifinfomsg));
+	struct ifinfomsg* ifi = msg.header<struct ifinfomsg>();
+	ifi->ifi_family = AF_UNSPEC;
+	ifi->ifi_index = ifindex;
+	ifi->ifi_flags = IFF_UP;
+	ifi->ifi_change = IFF_UP;
+
+	return _sock.transact(msg.buffer());
+}
+
+/**
+ * RTM_GETLINK: hardware(MAC) address of an interface
+ */
+bool RtNetlink::get_link_address(int ifindex, uint8_t addr[6]) {
+	if (!open()) {
+		return false;
+	}
+
+	NlMessage msg(RTM_GETLINK, 0, sizeof(struct ifinfomsg));
+	msg.header<struct ifinfomsg>()->ifi_family = AF_UNSPEC;
+	msg.header<struct ifinfomsg>()->ifi_index = ifindex;
+
+	bool found = false;
+	bool ok = _sock.transact(msg.buffer(), [&](const struct nlmsghdr* nlh) {
+		if (nlh->nlmsg_type != RTM_NEWLINK) return;
+		const struct ifinfomsg* ifi = reinterpret_cast<const struct ifinfomsg*>(NLMSG_DATA(nlh));
+		if (ifi->ifi_index != ifindex) return;
+		nl_for_each_attr(nlh, sizeof(struct ifinfomsg), [&](const struct nlattr* nla) {
+			if ((nla->nla_type & NLA_TYPE_MASK) == IFLA_ADDRESS && nl_attr_len(nla) == 6) {
+				std::memcpy(addr, nl_attr_data(nla), 6);
+				found = true;
+			}
+		});
+	});
+	return ok && found;
+}
+
+/**
+ * RTM_GETROUTE dump: outgoing interface of the IPv4 default route(lowest metric)
+ */
+bool RtNetlink::get_default_route(int& ifindex) {
+	if (!open()) {
+		return false;
+	}
+
+	NlMessage msg(RTM_GETROUTE, NLM_F_DUMP, sizeof(struct rtmsg));
+	msg.header<struct rtmsg>()->rtm_family = AF_INET;
+
+	bool found = false;
+	uint32_t best_metric = 0;
+	bool ok = _sock.transact(msg.buffer(), [&](const struct nlmsghdr* nlh) {
+		if (nlh->nlmsg_type != RTM_NEWROUTE) return;
+		const struct rtmsg* rtm = reinterpret_cast<const struct rtmsg*>(NLMSG_DATA(nlh));
+		if (rtm->rtm_family != AF_INET || rtm->rtm_dst_len != 0 ||
+				rtm->rtm_table != RT_TABLE_MAIN || rtm->rtm_type != RTN_UNICAST) return;
+
+		uint32_t oif = 0, metric = 0;
+		nl_for_each_attr(nlh, sizeof(struct rtmsg), [&](const struct nlattr* nla) {
+			const uint16_t type = nla->nla_type & NLA_TYPE_MASK;
+			if (type == RTA_OIF && nl_attr_len(nla) >= sizeof(oif)) {
+				std::memcpy(&oif, nl_attr_data(nla), sizeof(oif));
+			} else if (type == RTA_PRIORITY && nl_attr_len(nla) >= sizeof(metric)) {
+				std::memcpy(&metric, nl_attr_data(nla), sizeof(metric));
+			}
+		});
+		if (oif != 0 && (!found || metric < best_metric)) {
+			ifindex = oif;
+			best_metric = metric;
+			found = true;
+		}
+	});
+	return ok && found;
+}
+
+/**
+ * RTM_GETADDR dump: IPv4 addresses of one interface
+ */
+bool RtNetlink::get_ipv4_addresses(int ifindex, std::vector<ipv4_prefix_t>& addrs) {
+	if (!open()) {
+		return false;
+	}
+
+	NlMessage msg(RTM_GETADDR, NLM_F_DUMP, sizeof(struct ifaddrmsg));
+	msg.header<struct ifaddrmsg>()->ifa_family = AF_INET;
+
+	addrs.clear();
+	return _sock.transact(msg.buffer(), [&](const struct nlmsghdr* nlh) {
+		if (nlh->nlmsg_type != RTM_NEWADDR) return;
+		const struct ifaddrmsg* ifa = reinterpret_cast<const struct ifaddrmsg*>(NLMSG_DATA(nlh));
+		if (ifa->ifa_family != AF_INET || static_cast<int>(ifa->ifa_index) != ifindex) return;
+
+		ipv4_prefix_t prefix {};
+		prefix.prefixlen = ifa->ifa_prefixlen;
+		bool has_local = false;
+		nl_for_each_attr(nlh, sizeof(struct ifaddrmsg), [&](const struct nlattr* nla) {
+			const uint16_t type = nla->nla_type & NLA_TYPE_MASK;
+			if ((type == IFA_LOCAL || (type == IFA_ADDRESS && !has_local)) &&
+					nl_attr_len(nla) >= sizeof(prefix.addr)) {
+				std::memcpy(&prefix.addr, nl_attr_data(nla), sizeof(prefix.addr));
+				has_local = has_local || (type == IFA_LOCAL);
+			}
+		});
+		addrs.push_back(prefix);
+	});
+}
+
+bool RtNetlink::change_ipv4_address(uint16_t type, uint16_t flags, int ifindex, const ipv4_prefix_t& prefix) {
+	if (!open()) {
+		return false;
+	}
+
+	NlMessage msg(type, flags, sizeof(struct ifaddrmsg));
+	struct ifaddrmsg* ifa = msg.header<struct ifaddrmsg>();
+	ifa->ifa_family = AF_INET;
+	ifa->ifa_prefixlen = prefix.prefixlen;
+	ifa->ifa_index = ifindex;
+	msg.put(IFA_LOCAL, &prefix.addr, sizeof(prefix.addr));
+	msg.put(IFA_ADDRESS, &prefix.addr, sizeof(prefix.addr));
+
+	return _sock.transact(msg.buffer());
+}
+
+/**
+ * RTM_NEWADDR: ip address replace dev <ifname> <addr>/<prefixlen>
+ */
+bool RtNetlink::add_ipv4_address(int ifindex, const ipv4_prefix_t& prefix) {
+	return change_ipv4_address(RTM_NEWADDR, NLM_F_CREATE | NLM_F_REPLACE, ifindex, prefix);
+}
+
+/**
+ * RTM_DELADDR: ip address del dev <ifname> <addr>/<prefixlen>
+ */
+bool RtNetlink::del_ipv4_address(int ifindex, const ipv4_prefix_t& prefix) {
+	return change_ipv4_address(RTM_DELADDR, 0, ifindex, prefix);
+}
+
+bool RtNetlink::change_ipv4_route(uint16_t type, uint16_t flags, int ifindex, const ipv4_prefix_t& prefix) {
+	if (!open()) {
+		return false;
+	}
+
+	NlMessage msg(type, flags, sizeof(struct rtmsg));
+	struct rtmsg* rtm = msg.header<struct rtmsg>();
+	rtm->rtm_family = AF_INET;
+	rtm->rtm_dst_len = prefix.prefixlen;
+	rtm->rtm_table = RT_TABLE_MAIN;
+	rtm->rtm_type = RTN_UNICAST;
+	if (type == RTM_NEWROUTE) {
+		rtm->rtm_protocol = RTPROT_BOOT;
+		rtm->rtm_scope = RT_SCOPE_LINK;
+	} else {
+		rtm->rtm_scope = RT_SCOPE_NOWHERE;
+	}
+	msg.put(RTA_DST, &prefix.addr, sizeof(prefix.addr));
+	msg.put_u32(RTA_OIF, ifindex);
+
+	return _sock.transact(msg.buffer());
+}
+
+/**
+ * RTM_NEWROUTE: ip route replace <addr>/<prefixlen> dev <ifname>
+ */
+bool RtNetlink::add_ipv4_route(int ifindex, const ipv4_prefix_t& prefix) {
+	return change_ipv4_route(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE, ifindex, prefix);
+}
+
+/**
+ * RTM_DELROUTE: ip route del <addr>/<prefixlen> dev <ifname>
+ */
+bool RtNetlink::del_ipv4_route(int ifindex, const ipv4_prefix_t& prefix) {
+	return change_ipv4_route(RTM_DELROUTE, 0, ifindex, prefix);
+}
@@ -19,6 +19,11 @@
 #include "inc/sodium_ae.h"
 #include <sodium.h>
 #include "inc/parser.h"
+#include "inc/metrics.h"
+#include "inc/trace.h"
+#include "inc/probes.h"
+#include "inc/alloc_stats.h"
+#include "inc/logging.h"
 #include "spdlog/spdlog.h"
 
 //#define DEBUG
@@ -45,6 +50,7 @@ bool recv_all(int sock, uint8_t* data, size_t len) {
 
 Client::Client(int fileDescriptor) {
 	_sockfd.set(fileDescriptor);
+	_session = trace::newSession();
 	setConnected(false);
 	_prepare_public_key.resize(32, 0);  /* client public key for PREPARE stage */
 }
@@ -72,6 +78,8 @@ void Client::startListen() {
  * Send a message to client
  */
 void Client::send(const char* msg, size_t msg_len) const {
+	metrics::StageTimer timer(metrics::Stage::SEND);
+	trace::Span span("send", _session, 0);
 	std::vector<unsigned char> original_message(msg, msg + msg_len);
 	std::vector<unsigned char> encrypted_message = sodium_ae::encrypt_message(original_message,
 			getPreparePublicKey(), wgacsPtr->getPrepareSecretKey());
@@ -83,40 +91,77 @@ void Client::send(const char* msg, size_t msg_len) const {
 	}
 }
 
+/**
+ * Send several messages to client in one write
+ */
+void Client::send(const std::vector<std::string>& msgs) const {
+	metrics::StageTimer timer(metrics::Stage::SEND);
+	trace::Span span("send", _session, 0);
+	std::vector<unsigned char> frames;
+	for (const auto& msg : msgs) {
+		std::vector<unsigned char> original_message(msg.begin(), msg.end());
+		std::vector<unsigned char> encrypted_message = sodium_ae::encrypt_message(original_message,
+				getPreparePublicKey(), wgacsPtr->getPrepareSecretKey());
+		frames.insert(frames.end(), encrypted_message.begin(), encrypted_message.end());
+	}
+
+	if (!send_all(_sockfd.get(), frames.data(), frames.size())) {
+		throw std::runtime_error(strerror(errno));
+	}
+}
+
 /**
  * Thread routine: Receive a message from client
  */
 void Client::receiveTask() {
+	trace::setSession(_session);
+	trace::setThreadName("client " + _ip);
+
 	//step#1: Let's exchange public key
 	uint8_t client_pk_base64[WG_KEY_LEN_BASE64] {};
 	if (!recv_all(_sockfd.get(), client_pk_base64, sizeof(client_pk_base64)-1)) {
-		std::cerr << "Client public key reception failed" << std::endl;
+		LOG_SAMPLED(logging::TOPIC_KEY_EXCHANGE, warn, "Client public key reception failed");
+		metrics::increment(metrics::Counter::KEY_EXCHANGE_FAILED);
 		setConnected(false);
 		return;
 	}
 	//std::cout << "client_pk_base64 --> " << client_pk_base64 << std::endl;
+	const auto keyExchangeStart = std::chrono::steady_clock::now();
+	alloc_stats::Scope keyExchangeAllocs;
 
 	uint8_t client_pk[crypto_box_PUBLICKEYBYTES] {};
 	if (!key_from_base64(client_pk, reinterpret_cast<const char*>(client_pk_base64))) {
-		std::cerr << "Public key is not the correct length or format" << std::endl;
+		LOG_SAMPLED(logging::TOPIC_KEY_EXCHANGE, warn, "Public key is not the correct length or format");
+		metrics::increment(metrics::Counter::KEY_EXCHANGE_FAILED);
 		setConnected(false);
 		return;
 	} else {
 		setPreparePublicKey(client_pk);
 
 		uint8_t server_pk_base64[WG_KEY_LEN_BASE64] {};
-		std::memcpy(server_pk_base64,
-				wgacsPtr->getConfig().getstr("this_public_key").c_str(), WG_KEY_LEN_BASE64);
+		std::memcpy(server_pk_base64, settings::get().this_public_key, WG_KEY_LEN_BASE64);
 
 		if (!send_all(_sockfd.get(), server_pk_base64, sizeof(server_pk_base64)-1)) {
-			std::cerr << "Server public key transmission failed" << std::endl;
+			LOG_SAMPLED(logging::TOPIC_KEY_EXCHANGE, warn, "Server public key transmission failed");
+			metrics::increment(metrics::Counter::KEY_EXCHANGE_FAILED);
 			setConnected(false);
 			return;
 		}
 		//std::cout << "server_pk_base64 --> " << server_pk_base64 << std::endl;
+		const auto keyExchangeEnd = std::chrono::steady_clock::now();
+		metrics::observe(metrics::Stage::KEY_EXCHANGE, keyExchangeEnd - keyExchangeStart);
+		trace::record("key_exchange", _session, keyExchangeStart, keyExchangeEnd);
+		keyExchangeAllocs.finish(logging::TOPIC_KEY_EXCHANGE);
+		WGAC_PROBE2(key_exchange_done, _session,
+				std::chrono::duration_cast<std::chrono::nanoseconds>(keyExchangeEnd - keyExchangeStart).count());
 	}
 
-	/* step#2: PING-PONG Protocol */
+	/*
+	 * step#2: PING-PONG Protocol
+	 * A client with a pinned server key(0-RTT) sends its first request right behind its
+	 * public key, so it may already be waiting here. If the pinned key is stale, the request
+	 * fails to decrypt below and the client gets BYE, then it redoes the full key exchange.
+	 */
 	while (isConnected()) {
 		const fd_wait::Result waitResult = fd_wait::waitFor(_sockfd);
 
@@ -143,27 +188,42 @@ void Client::receiveTask() {
 			return;
 		}
 
+		/* a message is charged for its decrypt, parse, handler and replies */
+		alloc_stats::Scope messageAllocs;
 		bool decrypt_failure = false;
 		std::vector<unsigned char> encrypted_message(recv_buf, recv_buf + received_bytes);
-		std::vector<unsigned char> decrypted_message = sodium_ae::decrypt_message(
-				encrypted_message, getPreparePublicKey(), wgacsPtr->getPrepareSecretKey(),
-				decrypt_failure);
+		std::vector<unsigned char> decrypted_message;
+		{
+			metrics::StageTimer timer(metrics::Stage::DECRYPT);
+			trace::Span span("decrypt", _session, received_bytes);
+			decrypted_message = sodium_ae::decrypt_message(
+					encrypted_message, getPreparePublicKey(), wgacsPtr->getPrepareSecretKey(),
+					decrypt_failure);
+		}
 		if (!decrypt_failure) {
+			WGAC_PROBE2(decrypt_ok, _session, received_bytes);
 			char recv_buf[1024] {};
 			memcpy(recv_buf, reinterpret_cast<char*>(decrypted_message.data()),
 					decrypted_message.size() * sizeof(unsigned char)); 
+			const auto parseStart = std::chrono::steady_clock::now();
 			if (!parser::parse_new_message_string(recv_buf, &rmsg)) {
-				spdlog::error("Failed to parse message string");
+				LOG_SAMPLED(logging::TOPIC_OTHER_MESSAGE, error, "Failed to parse message string");
+				metrics::increment(metrics::Counter::PARSE_FAILED);
 				return;
 			}
+			const auto parseEnd = std::chrono::steady_clock::now();
+			metrics::observe(metrics::Stage::PARSE, parseEnd - parseStart);
+			trace::record("parse", _session, parseStart, parseEnd);
 
 			publishEvent(ClientEvent::INCOMING_MSG, rmsg);
+			messageAllocs.finish(logging::topic(rmsg.type));
 		} else {
+			WGAC_PROBE2(decrypt_fail, _session, received_bytes);
+			metrics::increment(metrics::Counter::DECRYPT_FAILED);
 			message_t smsg{};
 			smsg.type = AUTOCONN::BYE;
 			std::memcpy(smsg.mac_addr, rmsg.mac_addr, 6);
-			std::memcpy(smsg.public_key,
-					wgacsPtr->getConfig().getstr("this_public_key").c_str(), WG_KEY_LEN_BASE64);
+			std::memcpy(smsg.public_key, settings::get().this_public_key, WG_KEY_LEN_BASE64);
 			wgacsPtr->send_BYE(*this, smsg);
 
 			setConnected(false);
@@ -176,6 +236,8 @@ void Client::receiveTask() {
  * Send a message to client
  */
 void Client::send(const char* msg, size_t msg_len) const {
+	metrics::StageTimer timer(metrics::Stage::SEND);
+	trace::Span span("send", _session, 0);
 	const size_t sent_bytes = ::send(_sockfd.get(), (const char *)msg, msg_len, 0);
 
 	if (sent_bytes < 0) {
@@ -189,10 +251,29 @@ void Client::send(const char* msg, size_t msg_len) const {
 	}
 }
 
+/**
+ * Send several messages to client in one write
+ */
+void Client::send(const std::vector<std::string>& msgs) const {
+	metrics::StageTimer timer(metrics::Stage::SEND);
+	trace::Span span("send", _session, 0);
+	std::string text;
+	for (const auto& msg : msgs) {
+		text += msg;
+	}
+
+	if (!send_all(_sockfd.get(), reinterpret_cast<const uint8_t*>(text.data()), text.size())) {
+		throw std::runtime_error(strerror(errno));
+	}
+}
+
 /**
  * Thread routine: Receive a message from client
  */
 void Client::receiveTask() {
+	trace::setSession(_session);
+	trace::setThreadName("client " + _ip);
+
 	while (isConnected()) {
 		const fd_wait::Result waitResult = fd_wait::waitFor(_sockfd);
 
@@ -205,10 +286,16 @@ void Client::receiveTask() {
 		message_t rmsg {};
 		char recv_buf[1024] {};
 		const size_t received_bytes = recv(_sockfd.get(), recv_buf, sizeof(recv_buf), 0);
+		alloc_stats::Scope messageAllocs;
+		const auto parseStart = std::chrono::steady_clock::now();
 		if (!parser::parse_new_message_string(recv_buf, &rmsg)) {
-			spdlog::error("Failed to parse message string");
+			LOG_SAMPLED(logging::TOPIC_OTHER_MESSAGE, error, "Failed to parse message string");
+			metrics::increment(metrics::Counter::PARSE_FAILED);
 			return;
 		}
+		const auto parseEnd = std::chrono::steady_clock::now();
+		metrics::observe(metrics::Stage::PARSE, parseEnd - parseStart);
+		trace::record("parse", _session, parseStart, parseEnd);
 
 		if (received_bytes < 1) {
 			const bool clientClosedConnection = (received_bytes == 0);
@@ -222,6 +309,7 @@ void Client::receiveTask() {
 			return;
 		} else {
 			publishEvent(ClientEvent::INCOMING_MSG, rmsg);
+			messageAllocs.finish(logging::topic(rmsg.type));
 		}
 	}
 }
@@ -246,11 +334,10 @@ void Client::publishEvent(ClientEvent clientEvent, const message_t& msg) {
 }
 
 void Client::print() const {
-	const std::string connected = isConnected() ? "True" : "False";
-	std::cout << "-----------------\n" <<
-		"IP address: " << getIp() << std::endl <<
-		"Connected?: " << connected << std::endl <<
-		"Socket FD: " << _sockfd.get() << std::endl;
+	spdlog::info("-----------------");
+	spdlog::info("IP address: {}", getIp());
+	spdlog::info("Connected?: {}", isConnected() ? "True" : "False");
+	spdlog::info("Socket FD: {}", _sockfd.get());
 }
 
 void Client::terminateReceiveThread() {
@@ -14,8 +14,14 @@
 #include "inc/peer_tbl.h"
 #include "inc/vip_pool.h"
 #include "inc/configuration.h"
+#include "inc/settings.h"
 #include "inc/common.h"
 #include "inc/vtysh.h"
+#include "inc/metrics.h"
+#include "inc/logging.h"
+#include "inc/trace.h"
+#include "inc/probes.h"
+#include "inc/backend.h"
 #include "spdlog/spdlog.h"
 
 WgacServer::WgacServer() {
@@ -30,13 +36,58 @@ WgacServer::~WgacServer() {
 }
 
 void WgacServer::printClients() {
-	std::lock_guard<std::mutex> lock(_clientsMtx);
-	if (_clients.empty()) {
-		std::cout << "no connected clients\n";
+	std::vector<client_info_t> clients;
+	snapshot_clients(0, SIZE_MAX, clients);
+	if (clients.empty()) {
+		spdlog::info("no connected clients");
+	}
+	for (const auto& client : clients) {
+		spdlog::info("IP address: {}, Connected?: {}, Socket FD: {}",
+				client.ip, client.connected ? "True" : "False", client.fd);
+	}
+}
+
+/**
+ * Copy a page of the clients vector. Returns the number of clients.
+ */
+size_t WgacServer::snapshot_clients(size_t offset, size_t limit, std::vector<client_info_t>& page) {
+	std::vector<std::shared_ptr<Client>> clients;
+	size_t total;
+	{
+		std::lock_guard<std::mutex> lock(_clientsMtx);
+		total = _clients.size();
+		for (size_t i = offset; i < total && clients.size() < limit; i++) {
+			clients.push_back(_clients[i]);
+		}
 	}
-	for (const std::shared_ptr<Client> client : _clients) {
-		client->print();
+
+	const auto now = std::chrono::steady_clock::now();
+	for (const auto& client : clients) {
+		page.push_back(client_info_t {client->getIp(), client->getFd(), client->isConnected(),
+				static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+						now - client->getAcceptedAt()).count())});
+	}
+	return total;
+}
+
+size_t WgacServer::connected_clients() {
+	std::lock_guard<std::mutex> lock(_clientsMtx);
+	return std::count_if(_clients.begin(), _clients.end(),
+			[](const std::shared_ptr<Client>& client) { return client->isConnected(); });
+}
+
+/**
+ * Copy a page of the peer table(ordered by mac address). Returns the number of peers.
+ */
+size_t WgacServer::snapshot_peers(size_t offset, size_t limit, std::vector<peer_table_t>& page) {
+	std::lock_guard<std::mutex> lock(_peersMtx);
+	if (offset < _peers.size()) {
+		auto it = std::next(_peers.begin(), offset);
+		for (; it != _peers.end() && page.size() < limit; ++it) {
+			page.push_back(*it->second);
+		}
 	}
+	return _peers.size();
 }
 
 /**
@@ -90,6 +141,9 @@ void WgacServer::clientEventHandler(Client& client, ClientEvent event, const mes
 			break;
 		}
 		case ClientEvent::INCOMING_MSG: {
+			metrics::StageTimer timer(metrics::Stage::HANDLER);
+			trace::Span span(logging::topic_name(logging::topic(msg.type)), client.getSession(), 0);
+			WGAC_PROBE2(message, client.getSession(), static_cast<int>(msg.type));
 			handleClientMsg(client, msg);
 			break;
 		}
@@ -97,133 +151,265 @@ void WgacServer::clientEventHandler(Client& client, ClientEvent event, const mes
 }
 
 #ifndef VTYSH
+/**
+ * wg0 owns the vpn subnet, the others only reach their peers through /32 routes
+ */
+static struct in_addr wg_netmask(size_t shard, const server_settings_t& conf) {
+	struct in_addr netmask = conf.this_vpn_netmask;
+	if (shard != 0) {
+		netmask.s_addr = INADDR_NONE;   /* 255.255.255.255 */
+	}
+	return netmask;
+}
+
+void WgacServer::set_wireguard_address(size_t shard, const server_settings_t& conf) {
+	backend::wireguard().set_address(wg_ifname(shard), conf.this_vpn_ip, wg_netmask(shard, conf));
+}
+
 void WgacServer::init_wireguard() {
-	char szInfo[512] = {};
-	std::string cmd {};
-	std::string error_text;
-	std::vector<std::string> output_list;
-	bool exec_result;
-
-	//TBD: this command should be executed at booting script
-	snprintf(szInfo, sizeof(szInfo), "ip link add dev wg0 type wireguard > /dev/null 2>&1");
-	cmd = szInfo;
-	exec_result = common::exec(cmd, output_list, error_text);
-	if (exec_result) {
-		spdlog::debug("--- wireguard init [{}]", szInfo);
-	} else {
-		spdlog::warn("{}", error_text);
-	}
-
-	snprintf(szInfo, sizeof(szInfo),
-		"ifconfig wg0 %s netmask %s > /dev/null 2>&1",
-		wgacsPtr->getConfig().getstr("this_vpn_ip").c_str(),
-		wgacsPtr->getConfig().getstr("this_vpn_netmask").c_str());
-	cmd = szInfo;
-	exec_result = common::exec(cmd, output_list, error_text);
-	if (exec_result) {
-		spdlog::debug("--- wireguard init [{}]", szInfo);
-	} else {
-		spdlog::warn("{}", error_text);
-	}
-
-	snprintf(szInfo, sizeof(szInfo), "ip link set up dev wg0");
-	cmd = szInfo;
-	exec_result = common::exec(cmd, output_list, error_text);
-	if (exec_result) {
-		spdlog::debug("--- wireguard init [{}]", szInfo);
-	} else {
-		spdlog::warn("{}", error_text);
-	}
-
-	//Note: you must not encrypt the /qrwg/config/privatekey file
-	snprintf(szInfo, sizeof(szInfo),
-		"wg set wg0 listen-port %d private-key /qrwg/config/privatekey",
-		wgacsPtr->getConfig().getint("this_endpoint_port"));
-	cmd = szInfo;
-	exec_result = common::exec(cmd, output_list, error_text);
-	if (exec_result) {
-		spdlog::debug("--- wireguard init [{}]", szInfo);
-	} else {
-		spdlog::warn("{}", error_text);
+	const server_settings_t& conf = settings::get();
+	for (size_t shard = 0; shard < _wgInterfaces; shard++) {
+		backend::wireguard().init_interface(wg_ifname(shard), conf.this_vpn_ip, wg_netmask(shard, conf),
+				wg_listen_port(shard));
 	}
 }
 #endif
 
 /**
- * Setup wireguard configuration with the wg tool or vtysh.
+ * Read the number of wireguard interfaces(wg0..wgN-1) from the config
  */
-void WgacServer::setup_wireguard(const message_t& rmsg) {
-	char szInfo[512] {};
-	char vpnip_str[32] {};
-	char epip_str[32] {};
+void WgacServer::init_shards() {
+	_wgInterfaces = 1;
+	if (_config.contains("wg_interfaces")) {
+		int count = _config.getint("wg_interfaces");
+		if (count > 1 && count <= WG_INTERFACES_MAX) {
+			_wgInterfaces = count;
+		} else if (count != 1) {
+			spdlog::warn("wg_interfaces({}) is out of range, 1 is used.", count);
+		}
+	}
+#ifdef VTYSH
+	if (_wgInterfaces > 1) {
+		spdlog::warn("vtysh manages wg0 only, wg_interfaces is ignored.");
+		_wgInterfaces = 1;
+	}
+#endif
 
-	snprintf(vpnip_str, sizeof(vpnip_str), "%s", inet_ntoa(rmsg.vpnIP));
-	snprintf(epip_str, sizeof(epip_str), "%s", inet_ntoa(rmsg.epIP));
+	_wgListenPort = _config.getint("this_endpoint_port");
+	_wgIfnames.clear();
+	for (size_t shard = 0; shard < _wgInterfaces; shard++) {
+		_wgIfnames.push_back("wg" + std::to_string(shard));
+	}
+	spdlog::debug("--- {} wireguard interface(s)", _wgInterfaces);
+}
 
-#ifdef VTYSH
-	snprintf(szInfo, sizeof(szInfo),
-			"wg peer %s allowed-ips %s/32 endpoint %s:%d persistent-keepalive 25",
-			rmsg.public_key, vpnip_str, epip_str, rmsg.epPort);
+/**
+ * JOIN admission control: a token bucket of join_rate_limit tokens per second.
+ * When a restarted server is hit by the whole fleet at once, the clients over
+ * the limit get a NOK with a retry-after hint and come back later.
+ */
+bool WgacServer::admit_join() {
+	const double rate = settings::get().join_rate_limit;
+	if (rate <= 0) {
+		return true;
+	}
 
-	bool ok_flag = vtyshell::runCommand(szInfo);
-	if (ok_flag) {
-		char xbuf[256] {};
-		sprintf(xbuf, "/usr/bin/qrwg/vtysh -e \"write\"");
-		std::system(xbuf);
+	std::lock_guard<std::mutex> lock(_joinMtx);
+	auto now = std::chrono::steady_clock::now();
+	std::chrono::duration<double> elapsed = now - _joinStamp;
+	_joinStamp = now;
+	_joinTokens = std::min(std::max(rate, 1.0), _joinTokens + elapsed.count() * rate);
+	if (_joinTokens < 1) {
+		return false;
 	}
+	_joinTokens -= 1;
+	return true;
+}
 
-	spdlog::info("--- wireguard rule [{}]", szInfo);
-	spdlog::info("--- OK, wireguard setup is complete.");
-#else
-	std::string error_text;
-	std::vector<std::string> output_list;
-	snprintf(szInfo, sizeof(szInfo),
-			"wg set wg0 peer %s allowed-ips %s/32 endpoint %s:%d persistent-keepalive 25 &",
-			rmsg.public_key, vpnip_str, epip_str, rmsg.epPort);
-
-	std::string cmd(szInfo);
-	bool exec_result = common::exec(cmd, output_list, error_text);
-	if (exec_result) {
-		spdlog::info("--- wireguard rule [{}]", szInfo);
-		spdlog::info("--- OK, wireguard setup is complete.");
-	} else {
-		spdlog::warn("{}", error_text);
+/**
+ * Runs on the config watcher thread after a new snapshot is published.
+ * Message handlers pick the new values up by themselves; this applies the rest.
+ */
+void WgacServer::apply_settings(const server_settings_t& prev, const server_settings_t& next) {
+	if (prev.vpnip_range_begin.s_addr != next.vpnip_range_begin.s_addr ||
+			prev.vpnip_range_end.s_addr != next.vpnip_range_end.s_addr) {
+		if (getVipTable().initialize_viptable()) {
+			std::string begin = inet_ntoa(next.vpnip_range_begin);
+			spdlog::info("--- vpn ip pool is now {} - {}.", begin, inet_ntoa(next.vpnip_range_end));
+		} else {
+			spdlog::warn("vpn ip pool can't be rebuilt, the old one is kept.");
+		}
 	}
+
+	if (prev.this_vpn_ip.s_addr != next.this_vpn_ip.s_addr ||
+			prev.this_vpn_netmask.s_addr != next.this_vpn_netmask.s_addr) {
+#ifndef VTYSH
+		for (size_t shard = 0; shard < _wgInterfaces; shard++) {
+			set_wireguard_address(shard, next);
+		}
+#else
+		spdlog::warn("this_vpn_ip/this_vpn_netmask: wg0 is configured by vtysh, restart to apply.");
 #endif
+	}
+
+	if (prev.server_port != next.server_port || prev.this_endpoint_port != next.this_endpoint_port) {
+		spdlog::warn("server_port/this_endpoint_port take effect after a restart.");
+	}
 }
 
 /**
- * Remove a wireguard configuration with the wg tool or vtysh.
+ * Interface index of a peer: FNV-1a hash of its base64 public key,
+ * so that the same client always lands on the same interface.
  */
-void WgacServer::remove_wireguard(const uint8_t* public_key) {
-	char szInfo[256] {};
+uint16_t WgacServer::wg_shard(const uint8_t* public_key) const {
+	if (_wgInterfaces <= 1) {
+		return 0;
+	}
 
-#ifdef VTYSH
-	sprintf(szInfo, "no wg peer %s", public_key);
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < WG_KEY_LEN_BASE64 - 1 && public_key[i]; i++) {
+		hash ^= public_key[i];
+		hash *= 16777619u;
+	}
+	return hash % _wgInterfaces;
+}
+
+uint16_t WgacServer::wg_listen_port(size_t shard) const {
+	return _wgListenPort + shard;
+}
 
-	bool ok_flag = vtyshell::runCommand(szInfo);
-	if (ok_flag) {
-		char xbuf[256];
-		sprintf(xbuf, "/usr/bin/qrwg/vtysh -e \"write\"");
-		std::system(xbuf);
+/**
+ * Register the gauges and serve the metrics on metrics_address:metrics_port(0: disabled)
+ */
+void WgacServer::init_metrics() {
+	metrics::addGauge("wgac_connected_clients", "Clients connected to the server.", [this]() {
+		std::lock_guard<std::mutex> lock(_clientsMtx);
+		return static_cast<double>(std::count_if(_clients.begin(), _clients.end(),
+				[](const auto& client) { return client->isConnected(); }));
+	});
+	metrics::addGauge("wgac_peers", "Peers in the peer table.", [this]() {
+		std::lock_guard<std::mutex> lock(_peersMtx);
+		return static_cast<double>(_peers.size());
+	});
+	metrics::addGauge("wgac_vip_pool_used", "VPN addresses handed out.", [this]() {
+		size_t used, size;
+		_viptable.get_usage(used, size);
+		return static_cast<double>(used);
+	});
+	metrics::addGauge("wgac_vip_pool_size", "VPN addresses in the pool.", [this]() {
+		size_t used, size;
+		_viptable.get_usage(used, size);
+		return static_cast<double>(size);
+	});
+	metrics::addGauge("wgac_wg_pending_changes", "Peer changes waiting for the wireguard apply thread.", [this]() {
+		return static_cast<double>(_peerQueue.pending());
+	});
+
+	int port = _config.contains("metrics_port") ? _config.getint("metrics_port") : 0;
+	if (port <= 0 || port >= 65536) {
+		return;
 	}
+	std::string address = _config.contains("metrics_address") ? _config.getstr("metrics_address") : "127.0.0.1";
+	metrics::startServer(address, port);
+}
 
-	spdlog::info("--- wireguard rule [{}]", szInfo);
-	spdlog::info("--- OK, wireguard rule is removed.");
-#else
-	std::string error_text;
-	std::vector<std::string> output_list;
-	snprintf(szInfo, sizeof(szInfo), "wg set wg0 peer %s remove", public_key);
-
-	std::string cmd(szInfo);
-	bool exec_result = common::exec(cmd, output_list, error_text);
-	if (exec_result) {
-		spdlog::info("--- wireguard rule [{}]", szInfo);
-		spdlog::info("--- OK, wireguard rule is removed.");
-	} else {
-		spdlog::warn("{}", error_text);
+/**
+ * Queue a wireguard peer setup. The peer-change queue applies it in a batch
+ * with the other changes arriving at about the same time.
+ */
+void WgacServer::setup_wireguard(const message_t& rmsg) {
+	wg_peer_change_t change {};
+	change.op = wg_peer_change_t::Op::SET;
+	std::memcpy(change.public_key, rmsg.public_key, WG_KEY_LEN_BASE64);
+	change.public_key[WG_KEY_LEN_BASE64 - 1] = '\0';
+	change.vpnIP = rmsg.vpnIP;
+	change.epIP = rmsg.epIP;
+	change.epPort = rmsg.epPort;
+	change.keepalive = 25;
+	change.shard = wg_shard(change.public_key);
+
+	enable_peer_table(rmsg);
+	_peerQueue.enqueue(change);
+	_reconciler.markDirty(change.public_key);
+	spdlog::debug("--- wireguard peer [{}] is queued.", reinterpret_cast<const char*>(change.public_key));
+}
+
+/**
+ * Queue a wireguard peer removal. vpnIP(if known) is used to remove the peer's route.
+ */
+void WgacServer::remove_wireguard(const uint8_t* public_key, struct in_addr vpnIP) {
+	wg_peer_change_t change {};
+	change.op = wg_peer_change_t::Op::REMOVE;
+	std::memcpy(change.public_key, public_key, WG_KEY_LEN_BASE64);
+	change.public_key[WG_KEY_LEN_BASE64 - 1] = '\0';
+	change.vpnIP = vpnIP;
+	change.shard = wg_shard(change.public_key);
+
+	_peerQueue.enqueue(change);
+	_reconciler.markDirty(change.public_key);
+	spdlog::debug("--- wireguard peer [{}] removal is queued.", reinterpret_cast<const char*>(change.public_key));
+}
+
+/**
+ * HELLO: register the peer and bind a vpn ip to its mac address.
+ * smsg is the HELLO reply carrying the vpn ip.
+ */
+bool WgacServer::prepare_hello(const message_t& rmsg, message_t& smsg) {
+	if (!add_peer_table(rmsg)) {
+		return false;
 	}
-#endif
+
+	smsg = message_t {};
+	smsg.type = AUTOCONN::HELLO;
+	std::memcpy(smsg.mac_addr, rmsg.mac_addr, 6);
+	smsg.vpnNetmask = settings::get().this_vpn_netmask;
+
+	/* vpn ip allocation(for clients) routine */
+	std::shared_ptr<vip_entry_t> vip = getVipTable().search_address_binding(rmsg);
+	if (vip) {
+		smsg.vpnIP.s_addr = vip->vpnIP;
+		std::string s = inet_ntoa(smsg.vpnNetmask);
+		LOG_SAMPLED(logging::topic(rmsg.type), info, "--- Preparing an used vpnIP({}/{}) for client.", inet_ntoa(smsg.vpnIP), s);
+		return true;
+	}
+
+	vip = getVipTable().add_address_binding(rmsg);
+	if (vip) {
+		smsg.vpnIP.s_addr = vip->vpnIP;
+		std::string s = inet_ntoa(smsg.vpnNetmask);
+		LOG_SAMPLED(logging::topic(rmsg.type), info, "--- Preparing a new vpnIP({}/{}) for client.", inet_ntoa(smsg.vpnIP), s);
+		return true;
+	}
+
+	spdlog::warn("Can't bind mac address to ip address.");
+	return false;
+}
+
+/**
+ * PING: update the peer with its vpn ip and endpoint.
+ * smsg is the PONG reply carrying this server's wireguard settings.
+ */
+bool WgacServer::prepare_pong(const message_t& rmsg, message_t& smsg) {
+	if (!update_peer_table(rmsg)) {
+		return false;
+	}
+
+	/* one snapshot for the whole reply, even if a reload happens meanwhile */
+	const server_settings_t& conf = settings::get();
+	smsg = message_t {};
+	smsg.type = AUTOCONN::PONG;
+	std::memcpy(smsg.mac_addr, rmsg.mac_addr, 6);
+	smsg.vpnIP = conf.this_vpn_ip;
+	smsg.vpnNetmask = conf.this_vpn_netmask;
+	std::memcpy(smsg.public_key, conf.this_public_key, WG_KEY_LEN_BASE64);
+	smsg.epIP = conf.this_endpoint_ip;
+
+	/* endpoint port of the interface this client is assigned to */
+	smsg.epPort = wg_listen_port(wg_shard(rmsg.public_key));
+	static_assert(sizeof(smsg.allowed_ips) == sizeof(conf.this_allowed_ips), "allowed_ips size");
+	std::memcpy(smsg.allowed_ips, conf.this_allowed_ips, sizeof(smsg.allowed_ips));
+	spdlog::debug("--- This Allowed_IPS ----> {}", reinterpret_cast<const char*>(conf.this_allowed_ips));
+	return true;
 }
 
 /**
@@ -231,109 +417,77 @@ void WgacServer::remove_wireguard(const uint8_t* public_key) {
  */
 void WgacServer::handleClientMsg(Client& client, const message_t& rmsg) {
 	switch (rmsg.type) {
-		case AUTOCONN::HELLO:
-			spdlog::info(">>> HELLO message received.");
-			if (add_peer_table(rmsg)) {
-				message_t smsg {};
-				smsg.type = AUTOCONN::HELLO;
-				std::memcpy(smsg.mac_addr, rmsg.mac_addr, 6);
-
-				if (inet_pton(AF_INET,
-					wgacsPtr->getConfig().getstr("this_vpn_netmask").c_str(), &(smsg.vpnNetmask)) != 1) {
-					spdlog::warn("inet_pton(this_vpn_netmask) failed.");
-					send_NOK(client);
-				} else {
-					/* vpn ip allocation(for clients) routine */
-					std::shared_ptr<vip_entry_t> vip = getVipTable().search_address_binding(rmsg);
-					if (vip) {
-						smsg.vpnIP.s_addr = vip->vpnIP;
-						std::string s = inet_ntoa(smsg.vpnNetmask);
-						spdlog::info("--- Preparing an used vpnIP({}/{}) for client.",
-								inet_ntoa(smsg.vpnIP), s);
-						send_HELLO(client, smsg);
-					} else {
-						vip = getVipTable().add_address_binding(rmsg);
-						if (vip) {
-							smsg.vpnIP.s_addr = vip->vpnIP;
-							std::string s = inet_ntoa(smsg.vpnNetmask);
-							spdlog::info("--- Preparing a new vpnIP({}/{}) for client.",
-									inet_ntoa(smsg.vpnIP), s);
-							send_HELLO(client, smsg);
-						} else {
-							spdlog::warn("Can't bind mac address to ip address.");
-							send_NOK(client);
-						}
-					}
-				}
+		case AUTOCONN::HELLO: {
+			LOG_SAMPLED(logging::topic(rmsg.type), info, ">>> HELLO message received.");
+			message_t smsg {};
+			if (prepare_hello(rmsg, smsg)) {
+				send_HELLO(client, smsg);
 			} else {
 				send_NOK(client);
 			}
 			break;
+		}
 
-		case AUTOCONN::PING:
-			spdlog::info(">>> PING message received.");
-			if (update_peer_table(rmsg)) {
-				message_t smsg{};
-				smsg.type = AUTOCONN::PONG;
-				std::memcpy(smsg.mac_addr, rmsg.mac_addr, 6);
-				if (inet_pton(AF_INET,
-					wgacsPtr->getConfig().getstr("this_vpn_ip").c_str(), &(smsg.vpnIP)) != 1) {
-					spdlog::warn("inet_pton(this_vpn_ip) failed.");
-					send_NOK(client);
-				} else {
-					if (inet_pton(AF_INET,
-						wgacsPtr->getConfig().getstr("this_vpn_netmask").c_str(), &(smsg.vpnNetmask)) != 1) {
-						spdlog::warn("inet_pton(this_vpn_netmask) failed.");
-						send_NOK(client);
-					} else {
-						std::memcpy(smsg.public_key,
-								wgacsPtr->getConfig().getstr("this_public_key").c_str(), WG_KEY_LEN_BASE64);
-						if (inet_pton(AF_INET,
-							wgacsPtr->getConfig().getstr("this_endpoint_ip").c_str(), &(smsg.epIP)) != 1) {
-							spdlog::warn("inet_pton(this_endpoint_ip) failed.");
-							send_NOK(client);
-						} else {
-							smsg.epPort = wgacsPtr->getConfig().getint("this_endpoint_port");
-							std::string str = wgacsPtr->getConfig().getstr("this_allowed_ips");
-							int len = str.length();
-							std::memset(smsg.allowed_ips, 0, sizeof(smsg.allowed_ips));
-							std::memcpy(smsg.allowed_ips, str.c_str(), len);
-							spdlog::debug("--- This Allowed_IPS ----> {}", str);
-							send_PONG(client, smsg);
-							setup_wireguard(rmsg);
-						}
-					}
-				}
+		case AUTOCONN::PING: {
+			LOG_SAMPLED(logging::topic(rmsg.type), info, ">>> PING message received.");
+			message_t smsg {};
+			if (prepare_pong(rmsg, smsg)) {
+				send_PONG(client, smsg);
+				setup_wireguard(rmsg);
 			} else {
 				send_NOK(client);
 			}
 			break;
+		}
+
+		case AUTOCONN::JOIN: {
+			/* HELLO and PING in one round trip: both replies go out in one write */
+			LOG_SAMPLED(logging::topic(rmsg.type), info, ">>> JOIN message received.");
+			if (!admit_join()) {
+				LOG_SAMPLED(logging::topic(rmsg.type), info, "--- JOIN is over join_rate_limit.");
+				metrics::increment(metrics::Counter::JOIN_REJECTED);
+				send_NOK(client, settings::get().nok_retry_after_s);
+				break;
+			}
+			message_t hello {}, pong {};
+			if (prepare_hello(rmsg, hello)) {
+				message_t pmsg = rmsg;
+				pmsg.type = AUTOCONN::PING;
+				pmsg.vpnIP = hello.vpnIP;
+				pmsg.vpnNetmask = hello.vpnNetmask;
+				if (prepare_pong(pmsg, pong)) {
+					send_JOIN(client, hello, pong);
+					setup_wireguard(pmsg);
+					break;
+				}
+			}
+			send_NOK(client);
+			break;
+		}
 
 		case AUTOCONN::BYE:
-			spdlog::info(">>> BYE message received.");
+			LOG_SAMPLED(logging::topic(rmsg.type), info, ">>> BYE message received.");
 			if (remove_peer_table(rmsg)) {
 				message_t smsg {};
 				smsg.type = AUTOCONN::BYE;
 				std::memcpy(smsg.mac_addr, rmsg.mac_addr, 6);
-				std::memcpy(smsg.public_key,
-						wgacsPtr->getConfig().getstr("this_public_key").c_str(), WG_KEY_LEN_BASE64);
+				std::memcpy(smsg.public_key, settings::get().this_public_key, WG_KEY_LEN_BASE64);
 				send_BYE(client, smsg);
 				if (getVipTable().remove_address_binding(rmsg)) {
-					spdlog::info("--- Binding address is removed.");
+					LOG_SAMPLED(logging::topic(rmsg.type), info, "--- Binding address is removed.");
 				}
-				remove_wireguard(rmsg.public_key);
+				remove_wireguard(rmsg.public_key, rmsg.vpnIP);
 			} else {
 				send_NOK(client);
 			}
 			break;
 
 		default:
-			spdlog::info(">>> UNKNOWN message received.");
+			LOG_SAMPLED(logging::topic(rmsg.type), info, ">>> UNKNOWN message received.");
 			message_t smsg {};
 			smsg.type = AUTOCONN::BYE;
 			std::memcpy(smsg.mac_addr, rmsg.mac_addr, 6);
-			std::memcpy(smsg.public_key,
-					wgacsPtr->getConfig().getstr("this_public_key").c_str(), WG_KEY_LEN_BASE64);
+			std::memcpy(smsg.public_key, settings::get().this_public_key, WG_KEY_LEN_BASE64);
 			send_BYE(client, smsg);
 
 			client.setConnected(false);
@@ -364,6 +518,19 @@ pipe_ret_t WgacServer::start(unsigned short port, int maxNumOfClients, bool remo
 	} catch (const std::runtime_error &error) {
 		return pipe_ret_t::failure(error.what());
 	}
+
+	/* batched wireguard peer programming */
+	size_t batchSize = _config.contains("wg_batch_size") ? _config.getint("wg_batch_size") : 64;
+	uint32_t batchInterval = _config.contains("wg_batch_interval_ms") ? _config.getint("wg_batch_interval_ms") : 50;
+	_peerQueue.start(_wgIfnames, batchSize, batchInterval);
+
+	/* desired-state reconciliation(0: disabled) */
+	uint32_t reconcileInterval = _config.contains("wg_reconcile_interval_s") ? _config.getint("wg_reconcile_interval_s") : 10;
+	uint32_t reconcileFull = _config.contains("wg_reconcile_full_s") ? _config.getint("wg_reconcile_full_s") : 300;
+	if (reconcileInterval > 0) {
+		_reconciler.start(_wgIfnames, reconcileInterval, std::max(reconcileFull, reconcileInterval));
+	}
+
 	return pipe_ret_t::success();
 }
 
@@ -372,7 +539,7 @@ void WgacServer::initializeSocket() {
 	const bool socketFailed = (_sockfd.get() == -1);
 	if (socketFailed) {
 #ifdef DEBUG
-		std::cout << "(WgacServer::initializeSocket) socket Failed !!!\n";
+		spdlog::debug("(WgacServer::initializeSocket) socket Failed !!!");
 #endif
 		throw std::runtime_error(strerror(errno));
 	}
@@ -392,7 +559,7 @@ void WgacServer::bindAddress(int port) {
 	const bool bindFailed = (bindResult == -1);
 	if (bindFailed) {
 #ifdef DEBUG
-		std::cout << "(WgacServer::bindAddress) bind Failed !!!\n";
+		spdlog::debug("(WgacServer::bindAddress) bind Failed !!!");
 #endif
 		throw std::runtime_error(strerror(errno));
 	}
@@ -403,7 +570,7 @@ void WgacServer::listenToClients(int maxNumOfClients) {
 	const bool listenFailed = (listen(_sockfd.get(), clientsQueueSize) == -1);
 	if (listenFailed) {
 #ifdef DEBUG
-		std::cout << "(WgacServer::listenToClients) listen Failed !!!\n";
+		spdlog::debug("(WgacServer::listenToClients) listen Failed !!!");
 #endif
 		throw std::runtime_error(strerror(errno));
 	}
@@ -421,18 +588,19 @@ std::string WgacServer::acceptClient(uint timeout) {
 	const pipe_ret_t waitingForClient = waitForClient(timeout);
 	if (!waitingForClient.isSuccessful()) {
 #ifdef DEBUG
-		std::cout << "(WgacServer::acceptClient) !waitingForClient.isSuccessful() !!!\n";
+		spdlog::debug("(WgacServer::acceptClient) !waitingForClient.isSuccessful() !!!");
 #endif
 		throw std::runtime_error(waitingForClient.message());
 	}
 
 	socklen_t socketSize  = sizeof(_clientAddress);
 	const int fileDescriptor = accept(_sockfd.get(), (struct sockaddr*)&_clientAddress, &socketSize);
+	metrics::StageTimer timer(metrics::Stage::ACCEPT);   /* accept() blocks until a client comes */
 
 	const bool acceptFailed = (fileDescriptor == -1);
 	if (acceptFailed) {
 #ifdef DEBUG
-		std::cout << "(WgacServer::acceptClient) accept Failed !!!\n";
+		spdlog::debug("(WgacServer::acceptClient) accept Failed !!!");
 #endif
 		throw std::runtime_error(strerror(errno));
 	}
@@ -442,6 +610,10 @@ std::string WgacServer::acceptClient(uint timeout) {
 	using namespace std::placeholders;
 	newClient->setEventsHandler(std::bind(&WgacServer::clientEventHandler, this, _1, _2, _3));
 	newClient->startListen(); /* receive packets from client */
+	metrics::increment(metrics::Counter::ACCEPTED);
+	trace::record("accept", newClient->getSession(), newClient->getAcceptedAt(),
+			std::chrono::steady_clock::now(), fileDescriptor);
+	WGAC_PROBE2(accept, fileDescriptor, newClient->getSession());
 
 	std::lock_guard<std::mutex> lock(_clientsMtx);
 	_clients.push_back(newClient);
@@ -521,10 +693,11 @@ pipe_ret_t WgacServer::sendToClient(const std::string& clientIP, unsigned char*
 		Public_key  string  `publickey:=01234567890123456789012345678901234567890123\n`
 		EpIp        string  `epip:=192.168.1.1\n`
 		EpPort      string  `epport:=51280\n`
+		RetryAfter  string  `retryafter:=10\n`                 (NOK only, if retryAfter > 0)
 		Allowed_ips string  `allowedips:=10.1.1.0/24,192.168.1.0\n
 	}
 */
-std::string convert_message2string(const message_t& msg, size_t size) {
+std::string convert_message2string(const message_t& msg, size_t size, uint32_t retryAfter) {
 	std::string total_s {}, s {};
 	char buffer[512] {};
 
@@ -540,6 +713,8 @@ std::string convert_message2string(const message_t& msg, size_t size) {
 		total_s = "cmd:=NOK\n";
 	else if (msg.type == AUTOCONN::BYE)
 		total_s = "cmd:=BYE\n";
+	else if (msg.type == AUTOCONN::JOIN)
+		total_s = "cmd:=JOIN\n";
 	else
 		total_s = "cmd:=NOK\n";
 
@@ -568,6 +743,13 @@ std::string convert_message2string(const message_t& msg, size_t size) {
 	s = buffer;
 	total_s += s;
 
+	/* before allowedips, which ends a message */
+	if (retryAfter > 0) {
+		snprintf(buffer, sizeof(buffer), "retryafter:=%u\n", retryAfter);
+		s = buffer;
+		total_s += s;
+	}
+
 	std::string allowed(reinterpret_cast<const char*>(msg.allowed_ips));
 	total_s = total_s + "allowedips:=" + allowed + "\n";
 
@@ -583,7 +765,7 @@ bool WgacServer::sendMessage(const Client& client, const message_t& msg) {
 	try {
 		client.send(buf_ptr, total_s.length());
 	} catch (const std::runtime_error &error) {
-		spdlog::info("<<< Oops message sending is failed.");
+		LOG_SAMPLED(logging::topic(msg.type), info, "<<< Oops message sending is failed.");
 		return false;
 	}
 
@@ -591,33 +773,64 @@ bool WgacServer::sendMessage(const Client& client, const message_t& msg) {
 }
 
 bool WgacServer::send_PREPARE(const Client& client, const message_t& smsg) {
-	spdlog::info("<<< PREPARE message sent to client.");
+	LOG_SAMPLED(logging::topic(AUTOCONN::PREPARE), info, "<<< PREPARE message sent to client.");
 	return sendMessage(client, smsg);
 }
 
 bool WgacServer::send_HELLO(const Client& client, const message_t& smsg) {
-	spdlog::info("<<< HELLO message sent to client.");
+	LOG_SAMPLED(logging::topic(AUTOCONN::HELLO), info, "<<< HELLO message sent to client.");
 	return sendMessage(client, smsg);
 }
 
 bool WgacServer::send_OK(const Client& client, const message_t& smsg) {
-	spdlog::info("<<< OK message sent to client.");
+	LOG_SAMPLED(logging::topic(AUTOCONN::OK), info, "<<< OK message sent to client.");
 	return sendMessage(client, smsg);
 }
 
-bool WgacServer::send_NOK(const Client& client) {
-	spdlog::info("<<< NOK message sent to client.");
+bool WgacServer::send_NOK(const Client& client, uint32_t retryAfter) {
+	LOG_SAMPLED(logging::topic(AUTOCONN::NOK), info, "<<< NOK message sent to client.");
 	message_t smsg{};
-	return sendMessage(client, smsg);
+	smsg.type = AUTOCONN::NOK;
+	if (retryAfter == 0) {
+		return sendMessage(client, smsg);
+	}
+
+	std::string total_s = convert_message2string(smsg, sizeof(message_t), retryAfter);
+	try {
+		client.send(total_s.c_str(), total_s.length());
+	} catch (const std::runtime_error &error) {
+		LOG_SAMPLED(logging::topic(AUTOCONN::NOK), info, "<<< Oops message sending is failed.");
+		return false;
+	}
+	return true;
 }
 
 bool WgacServer::send_PONG(const Client& client, const message_t& smsg) {
-	spdlog::info("<<< PONG message sent to client.");
+	LOG_SAMPLED(logging::topic(AUTOCONN::PONG), info, "<<< PONG message sent to client.");
 	return sendMessage(client, smsg);
 }
 
+/**
+ * Replies of a JOIN(HELLO + PONG) in one write, so that they reach the client together
+ */
+bool WgacServer::send_JOIN(const Client& client, const message_t& hello, const message_t& pong) {
+	std::vector<std::string> msgs {
+		convert_message2string(hello, sizeof(message_t)),
+		convert_message2string(pong, sizeof(message_t))
+	};
+	try {
+		client.send(msgs);
+	} catch (const std::runtime_error &error) {
+		LOG_SAMPLED(logging::topic(AUTOCONN::JOIN), info, "<<< Oops message sending is failed.");
+		return false;
+	}
+
+	LOG_SAMPLED(logging::topic(AUTOCONN::JOIN), info, "<<< HELLO + PONG messages sent to client.");
+	return true;
+}
+
 bool WgacServer::send_BYE(const Client& client, const message_t& smsg) {
-	spdlog::info("<<< BYE message sent to client.");
+	LOG_SAMPLED(logging::topic(AUTOCONN::BYE), info, "<<< BYE message sent to client.");
 	return sendMessage(client, smsg);
 }
 
@@ -635,12 +848,21 @@ void WgacServer::setTerminate(bool flag) {
 	_flagTerminate = flag;
 }
 
+/**
+ * Make a blocked accept() return(EINVAL), the socket itself is closed by close().
+ */
+void WgacServer::wakeAccept() {
+	::shutdown(_sockfd.get(), SHUT_RDWR);
+}
+
 /**
  * Close server and clients resources.
  * Return true is successFlag, false otherwise
  */
 pipe_ret_t WgacServer::close() {
 	terminateDeadClientsRemover();
+	_reconciler.stop();
+	_peerQueue.stop();
 	{ // close clients
 		std::lock_guard<std::mutex> lock(_clientsMtx);
 
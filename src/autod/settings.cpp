@@ -0,0 +1,316 @@
+/*
+ * Typed configuration snapshot of the server and its hot reload(SIGHUP, inotify)
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/inotify.h>
+#include "inc/settings.h"
+#include "spdlog/spdlog.h"
+
+#define RELOAD_SETTLE_MS 200   /* editors write a file in several steps */
+
+namespace settings
+{
+/*
+ * Owner of the snapshots. Readers only load _current. A replaced snapshot
+ * is kept until exit, since a reader may still hold it(reloads are rare).
+ */
+class SettingsStore {
+public:
+	~SettingsStore() { stopWatcher(); }
+
+	const server_settings_t& get() const {
+		return *_current.load(std::memory_order_acquire);
+	}
+
+	bool load(Config& config);
+	void set_public_key(const std::string& pubkey);
+	void startWatcher(const std::string& path,
+			std::function<void(const server_settings_t&, const server_settings_t&)> onReload);
+	void stopWatcher();
+	void requestReload();
+
+private:
+	bool build(Config& config, server_settings_t& s);
+	void publish(std::unique_ptr<server_settings_t> next);
+	void reload();
+	void watch();
+
+	static const server_settings_t _empty;
+	std::atomic<const server_settings_t*> _current {&_empty};
+	std::vector<std::unique_ptr<server_settings_t>> _snapshots;
+	std::mutex _mtx;                         /* writers: load, set_public_key, reload */
+	std::string _publicKey;                  /* derived from the private key */
+
+	std::string _path;
+	std::function<void(const server_settings_t&, const server_settings_t&)> _onReload;
+	std::thread _thread;
+	int _inotifyfd = -1;
+	int _pipefd[2] = {-1, -1};
+	std::atomic<bool> _running {false};
+};
+
+const server_settings_t SettingsStore::_empty {};
+
+static bool parse_address(Config& config, const char* key, struct in_addr& addr) {
+	if (!config.contains(key) || inet_pton(AF_INET, config.getstr(key).c_str(), &addr) != 1) {
+		spdlog::error("{} is missing or not an IPv4 address.", key);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Convert and check every value once. A bad value rejects the whole snapshot.
+ */
+bool SettingsStore::build(Config& config, server_settings_t& s) {
+	try {
+		s.server_port = 51822;
+		if (config.contains("server_port") &&
+				config.getint("server_port") >= 1024 && config.getint("server_port") < 65536) {
+			s.server_port = config.getint("server_port");
+		}
+
+		if (!parse_address(config, "this_vpn_ip", s.this_vpn_ip) ||
+				!parse_address(config, "this_vpn_netmask", s.this_vpn_netmask) ||
+				!parse_address(config, "this_endpoint_ip", s.this_endpoint_ip) ||
+				!parse_address(config, "vpnip_range_begin", s.vpnip_range_begin) ||
+				!parse_address(config, "vpnip_range_end", s.vpnip_range_end)) {
+			return false;
+		}
+
+		const std::string pubkey = _publicKey.empty() ? config.getstr("this_public_key") : _publicKey;
+		if (pubkey.length() != WG_KEY_LEN_BASE64 - 1) {
+			spdlog::error("this_public_key is not a base64 wireguard key.");
+			return false;
+		}
+		std::memcpy(s.this_public_key, pubkey.c_str(), WG_KEY_LEN_BASE64);
+
+		if (!config.contains("this_endpoint_port") ||
+				config.getint("this_endpoint_port") <= 0 || config.getint("this_endpoint_port") >= 65536) {
+			spdlog::error("this_endpoint_port is missing or out of range.");
+			return false;
+		}
+		s.this_endpoint_port = config.getint("this_endpoint_port");
+
+		const std::string allowed = config.getstr("this_allowed_ips");
+		if (allowed.length() >= sizeof(s.this_allowed_ips)) {
+			spdlog::error("this_allowed_ips is too long.");
+			return false;
+		}
+		std::memcpy(s.this_allowed_ips, allowed.c_str(), allowed.length() + 1);
+
+		s.join_rate_limit = 0;
+		if (config.contains("join_rate_limit")) {
+			int rate = config.getint("join_rate_limit");
+			if (rate > 0) {
+				s.join_rate_limit = rate;
+			} else if (rate < 0) {
+				spdlog::warn("join_rate_limit({}) is out of range, no limit is used.", rate);
+			}
+		}
+		s.nok_retry_after_s = 10;
+		if (config.contains("nok_retry_after_s")) {
+			int seconds = config.getint("nok_retry_after_s");
+			if (seconds >= 0 && seconds <= UINT16_MAX) {
+				s.nok_retry_after_s = seconds;
+			} else {
+				spdlog::warn("nok_retry_after_s({}) is out of range, {} is used.", seconds, s.nok_retry_after_s);
+			}
+		}
+	} catch (const std::exception& e) {
+		spdlog::error("Invalid number in the config: {}", e.what());
+		return false;
+	}
+	return true;
+}
+
+void SettingsStore::publish(std::unique_ptr<server_settings_t> next) {
+	next->generation = get().generation + 1;
+	_current.store(next.get(), std::memory_order_release);
+	_snapshots.push_back(std::move(next));
+}
+
+bool SettingsStore::load(Config& config) {
+	std::lock_guard<std::mutex> lock(_mtx);
+	auto next = std::make_unique<server_settings_t>();
+	if (!build(config, *next)) {
+		return false;
+	}
+	publish(std::move(next));
+	return true;
+}
+
+void SettingsStore::set_public_key(const std::string& pubkey) {
+	std::lock_guard<std::mutex> lock(_mtx);
+	_publicKey = pubkey;
+	auto next = std::make_unique<server_settings_t>(get());
+	std::memset(next->this_public_key, 0, sizeof(next->this_public_key));
+	std::memcpy(next->this_public_key, pubkey.c_str(),
+			std::min(pubkey.length(), sizeof(next->this_public_key) - 1));
+	publish(std::move(next));
+}
+
+/**
+ * Parse the file again. On any error the running snapshot stays.
+ */
+void SettingsStore::reload() {
+	Config config;
+	if (!config.parse(_path)) {
+		spdlog::warn("Config reload failed, the running config is kept.");
+		return;
+	}
+
+	const server_settings_t* prev;
+	const server_settings_t* next;
+	{
+		std::lock_guard<std::mutex> lock(_mtx);
+		auto snapshot = std::make_unique<server_settings_t>();
+		if (!build(config, *snapshot)) {
+			spdlog::warn("Config reload failed, the running config is kept.");
+			return;
+		}
+		prev = &get();
+		publish(std::move(snapshot));
+		next = &get();
+	}
+
+	spdlog::info("--- Config is reloaded(generation {}).", next->generation);
+	if (_onReload) {
+		_onReload(*prev, *next);
+	}
+}
+
+void SettingsStore::startWatcher(const std::string& path,
+		std::function<void(const server_settings_t&, const server_settings_t&)> onReload) {
+	if (_running) {
+		return;
+	}
+	_path = path;
+	_onReload = std::move(onReload);
+
+	if (pipe2(_pipefd, O_NONBLOCK | O_CLOEXEC) < 0) {
+		spdlog::warn("Config watcher is not started: {}", strerror(errno));
+		return;
+	}
+
+	/* the directory is watched: editors and config tools replace the file by a rename */
+	_inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	const size_t slash = _path.find_last_of('/');
+	const std::string dir = (slash == std::string::npos) ? "." : _path.substr(0, slash + 1);
+	if (_inotifyfd < 0 || inotify_add_watch(_inotifyfd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		spdlog::warn("No inotify on {}, the config is reloaded on SIGHUP only.", dir);
+	}
+
+	_running = true;
+	_thread = std::thread(&SettingsStore::watch, this);
+}
+
+void SettingsStore::stopWatcher() {
+	if (!_running.exchange(false)) {
+		return;
+	}
+	requestReload();   /* wakes the thread up */
+	if (_thread.joinable()) {
+		_thread.join();
+	}
+	for (int* fd : {&_inotifyfd, &_pipefd[0], &_pipefd[1]}) {
+		if (*fd >= 0) {
+			::close(*fd);
+			*fd = -1;
+		}
+	}
+}
+
+void SettingsStore::requestReload() {
+	if (_pipefd[1] >= 0) {
+		const char c = 'R';
+		[[maybe_unused]] ssize_t n = write(_pipefd[1], &c, 1);
+	}
+}
+
+void SettingsStore::watch() {
+	const size_t slash = _path.find_last_of('/');
+	const std::string name = (slash == std::string::npos) ? _path : _path.substr(slash + 1);
+
+	struct pollfd fds[2] = {{_pipefd[0], POLLIN, 0}, {_inotifyfd, POLLIN, 0}};
+	const nfds_t nfds = (_inotifyfd >= 0) ? 2 : 1;
+	bool pending = false;
+	while (_running) {
+		int n = poll(fds, nfds, pending ? RELOAD_SETTLE_MS : -1);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			spdlog::warn("Config watcher failed: {}", strerror(errno));
+			break;
+		}
+		if (n == 0) {
+			pending = false;
+			reload();
+			continue;
+		}
+
+		char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		if (fds[0].revents & POLLIN) {
+			while (read(_pipefd[0], buf, sizeof(buf)) > 0) {}
+			if (_running) {
+				spdlog::info(">>> SIGHUP, reloading the config.");
+				pending = true;
+			}
+		}
+		if (nfds > 1 && (fds[1].revents & POLLIN)) {
+			ssize_t len;
+			while ((len = read(_inotifyfd, buf, sizeof(buf))) > 0) {
+				for (char* p = buf; p < buf + len;) {
+					const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*>(p);
+					if (ev->len > 0 && name == ev->name) {
+						pending = true;
+					}
+					p += sizeof(struct inotify_event) + ev->len;
+				}
+			}
+		}
+	}
+}
+
+static SettingsStore store;
+
+const server_settings_t& get() {
+	return store.get();
+}
+
+bool load(Config& config) {
+	return store.load(config);
+}
+
+void set_public_key(const std::string& pubkey) {
+	store.set_public_key(pubkey);
+}
+
+void startWatcher(const std::string& path,
+		std::function<void(const server_settings_t& prev, const server_settings_t& next)> onReload) {
+	store.startWatcher(path, std::move(onReload));
+}
+
+void stopWatcher() {
+	store.stopWatcher();
+}
+
+void requestReload() {
+	store.requestReload();
+}
+
+}
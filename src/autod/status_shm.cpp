@@ -0,0 +1,184 @@
+/*
+ * Shared memory status segment of the server(seqlock writer)
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "inc/status_shm.h"
+#include "inc/server.h"
+#include "spdlog/spdlog.h"
+
+namespace status_shm
+{
+/*
+ * The segment is written by its own thread only. The server state is read
+ * through the snapshot functions, so the message handlers never wait for
+ * the segment, and readers never wait for the server.
+ */
+class StatusPublisher {
+public:
+	~StatusPublisher() { stop(); }
+
+	bool start(const std::string& path, uint32_t intervalMs, uint32_t peerCapacity);
+	void stop();
+
+private:
+	void publishTask();
+	void publish();
+
+	std::string _path;
+	uint8_t* _base = nullptr;
+	size_t _size = 0;
+	uint32_t _capacity = 0;
+	std::chrono::milliseconds _interval {100};
+	std::vector<peer_table_t> _peers;       /* reused between updates */
+
+	std::thread _thread;
+	std::mutex _mtx;                         /* only used to park the thread */
+	std::condition_variable _cond;
+	bool _running = false;
+};
+
+bool StatusPublisher::start(const std::string& path, uint32_t intervalMs, uint32_t peerCapacity) {
+	if (_base) {
+		return true;
+	}
+
+	_capacity = peerCapacity;
+	_size = sizeof(wgac_status_header_t) + static_cast<size_t>(_capacity) * sizeof(wgac_status_peer_t);
+	/* always a new file of our own: never follow or reuse what others left there(/dev/shm is world-writable) */
+	::unlink(path.c_str());
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+			S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fd < 0 || ftruncate(fd, _size) < 0) {
+		spdlog::warn("Status segment {} is not created: {}", path, strerror(errno));
+		if (fd >= 0) {
+			::close(fd);
+			::unlink(path.c_str());
+		}
+		return false;
+	}
+	fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);   /* readable, whatever the umask */
+
+	void* base = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (base == MAP_FAILED) {
+		spdlog::warn("Status segment {} is not mapped: {}", path, strerror(errno));
+		::unlink(path.c_str());
+		return false;
+	}
+	_base = static_cast<uint8_t*>(base);
+	_path = path;
+	_interval = std::chrono::milliseconds(intervalMs);
+	_peers.reserve(_capacity);
+
+	/* the header is valid before the magic is: a reader checks the magic first */
+	wgac_status_header_t* head = reinterpret_cast<wgac_status_header_t*>(_base);
+	head->version = WGAC_STATUS_VERSION;
+	head->header_size = sizeof(wgac_status_header_t);
+	head->peer_record_size = sizeof(wgac_status_peer_t);
+	head->peer_capacity = _capacity;
+	head->pid = getpid();
+	head->started = time(nullptr);
+	__atomic_store_n(&head->magic, WGAC_STATUS_MAGIC, __ATOMIC_RELEASE);
+
+	_running = true;
+	_thread = std::thread(&StatusPublisher::publishTask, this);
+	spdlog::info("--- Status segment is {}({} peers, every {} ms)", path, _capacity, intervalMs);
+	return true;
+}
+
+void StatusPublisher::stop() {
+	{
+		std::lock_guard<std::mutex> lock(_mtx);
+		_running = false;
+	}
+	_cond.notify_one();
+	if (_thread.joinable()) {
+		_thread.join();
+	}
+	if (_base) {
+		munmap(_base, _size);
+		_base = nullptr;
+		::unlink(_path.c_str());   /* readers still mapping it keep the last snapshot */
+	}
+}
+
+void StatusPublisher::publishTask() {
+	std::unique_lock<std::mutex> lock(_mtx);
+	while (_running) {
+		lock.unlock();
+		publish();
+		lock.lock();
+		_cond.wait_for(lock, _interval, [this] { return !_running; });
+	}
+}
+
+/**
+ * Take the snapshots first, then write the segment inside the seqlock
+ */
+void StatusPublisher::publish() {
+	size_t used, size;
+	_peers.clear();
+	const size_t nclients = wgacsPtr->connected_clients();
+	const size_t npeers = wgacsPtr->snapshot_peers(0, _capacity, _peers);
+	wgacsPtr->getVipTable().get_usage(used, size);
+	const size_t pending = wgacsPtr->getPeerQueue().pending();
+	const uint64_t generation = settings::get().generation;
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	wgac_status_header_t* head = reinterpret_cast<wgac_status_header_t*>(_base);
+	wgac_status_peer_t* records = reinterpret_cast<wgac_status_peer_t*>(_base + head->header_size);
+	const uint32_t seq = head->seq;
+	__atomic_store_n(&head->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	head->updated_ns = static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+	head->config_generation = generation;
+	head->clients = nclients;
+	head->peers = npeers;
+	head->peer_count = _peers.size();
+	head->pool_used = used;
+	head->pool_size = size;
+	head->wg_pending = pending;
+	for (size_t i = 0; i < _peers.size(); i++) {
+		const peer_table_t& peer = _peers[i];
+		wgac_status_peer_t& record = records[i];
+		std::memset(&record, 0, sizeof(record));
+		record.last_seen = peer.time;
+		std::memcpy(record.mac_addr, peer.mac_addr, sizeof(record.mac_addr));
+		record.wireguard_enabled = peer.wireguard_enabled;
+		record.vpnIP = peer.vpnIP.s_addr;
+		record.epIP = peer.epIP.s_addr;
+		record.epPort = peer.epPort;
+		std::memcpy(record.public_key, peer.public_key, sizeof(record.public_key));
+		record.public_key[WG_KEY_LEN_BASE64 - 1] = '\0';
+	}
+
+	__atomic_store_n(&head->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static StatusPublisher publisher;
+
+bool start(const std::string& path, uint32_t intervalMs, uint32_t peerCapacity) {
+	return publisher.start(path, intervalMs, peerCapacity);
+}
+
+void stop() {
+	publisher.stop();
+}
+
+}
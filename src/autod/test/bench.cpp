@@ -0,0 +1,291 @@
+/*
+ * Microbenchmarks of the server hot path: message codec, crypto and tables
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * usage: wgac_bench [--filter <substring>] [--min-time-ms <ms>] [--list]
+ *
+ * Every benchmark repeats its operation in doubling batches until it ran for
+ * min-time-ms, then reports the mean and the fastest batch per operation as
+ * one JSON document on stdout. allocs_per_op/bytes_per_op are measured in a
+ * WGAC_ALLOC_STATS build only(null otherwise). Redis commands of the peer
+ * table go to the fake redis backend.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sodium.h>
+#include "../inc/server.h"
+#include "../inc/parser.h"
+#include "../inc/sodium_ae.h"
+#include "../inc/settings.h"
+#include "../inc/alloc_stats.h"
+#include "../inc/backend.h"
+#include "spdlog/spdlog.h"
+
+std::unique_ptr<WgacServer> wgacsPtr;
+
+using steady_clock = std::chrono::steady_clock;
+
+struct bench_result {
+	std::string name;
+	uint64_t iterations;
+	double ns_per_op;                        // mean over all batches
+	double min_ns_per_op;                    // fastest batch
+	double allocs_per_op;
+	double bytes_per_op;
+};
+
+using bench_result_t = struct bench_result;
+
+static std::vector<bench_result_t> results;
+static std::string filter;
+static double min_time_ns = 200e6;
+static bool list_only = false;
+
+/* keeps the optimizer from dropping a result */
+template <typename T>
+static void keep(T&& value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static void run(const std::string& name, const std::function<void()>& op) {
+	if (!filter.empty() && name.find(filter) == std::string::npos) {
+		return;
+	}
+	if (list_only) {
+		printf("%s\n", name.c_str());
+		return;
+	}
+
+	op();   /* warm up: first touch of the tables and caches */
+
+	uint64_t iterations = 0, batch = 1;
+	double total_ns = 0, min_ns = 1e18;
+	const alloc_counts_t allocs_before = alloc_stats::thread_counts();
+	while (total_ns < min_time_ns) {
+		const auto start = steady_clock::now();
+		for (uint64_t i = 0; i < batch; i++) {
+			op();
+		}
+		const double ns = std::chrono::duration<double, std::nano>(steady_clock::now() - start).count();
+		total_ns += ns;
+		iterations += batch;
+		min_ns = std::min(min_ns, ns / batch);
+		if (batch < (1u << 20)) batch *= 2;
+	}
+	const alloc_counts_t allocs_after = alloc_stats::thread_counts();
+
+	results.push_back({name, iterations, total_ns / iterations, min_ns,
+			static_cast<double>(allocs_after.allocs - allocs_before.allocs) / iterations,
+			static_cast<double>(allocs_after.bytes - allocs_before.bytes) / iterations});
+}
+
+static message_t sample_message(AUTOCONN type, uint32_t n) {
+	message_t msg {};
+	msg.type = type;
+	const uint8_t mac[6] = {0x02, 0x00, uint8_t(n >> 24), uint8_t(n >> 16), uint8_t(n >> 8), uint8_t(n)};
+	std::memcpy(msg.mac_addr, mac, sizeof(mac));
+	inet_pton(AF_INET, "10.1.1.7", &msg.vpnIP);
+	inet_pton(AF_INET, "255.255.255.0", &msg.vpnNetmask);
+	std::memcpy(msg.public_key, "Fuj6ODu9nLkCtxzueHh3AB4CRakbX6PkzbFW8T0smAA=", WG_KEY_LEN_BASE64);
+	inet_pton(AF_INET, "192.168.8.10", &msg.epIP);
+	msg.epPort = 51820;
+	std::strcpy(reinterpret_cast<char*>(msg.allowed_ips), "10.1.1.0/24,192.168.0.0/16");
+	return msg;
+}
+
+/* settings snapshot with a vpn pool of .1 ~ .poolEnd */
+static bool load_settings(int poolEnd) {
+	char path[] = "/tmp/wgac_bench.XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		return false;
+	}
+	::close(fd);
+
+	std::ofstream conf(path);
+	conf << "this_vpn_ip = 10.1.1.254\n"
+		"this_vpn_netmask = 255.255.255.0\n"
+		"this_public_key = \"Fuj6ODu9nLkCtxzueHh3AB4CRakbX6PkzbFW8T0smAA=\"\n"
+		"this_endpoint_ip = 192.168.8.162\n"
+		"this_endpoint_port = 51820\n"
+		"this_allowed_ips = \"10.1.1.0/24\"\n"
+		"vpnip_range_begin = 10.1.1.1\n"
+		"vpnip_range_end = 10.1.1." << poolEnd << "\n"
+		"wireguard_backend = fake\n"
+		"redis_backend = fake\n";
+	conf.close();
+
+	Config config;
+	const bool ok_flag = config.parse(path) && settings::load(config);
+	if (ok_flag) {
+		backend::select(config);
+	}
+	::unlink(path);
+	return ok_flag;
+}
+
+static void bench_codec() {
+	const message_t msg = sample_message(AUTOCONN::JOIN, 1);
+	const std::string text = convert_message2string(msg, sizeof(message_t));
+
+	run("codec/convert_message2string", [&] {
+		keep(convert_message2string(msg, sizeof(message_t)));
+	});
+
+	/* the parser cuts its input, so every round parses a fresh copy */
+	char buf[1024];
+	run("codec/parse_new_message_string", [&] {
+		message_t rmsg {};
+		std::memcpy(buf, text.c_str(), text.size() + 1);
+		keep(parser::parse_new_message_string(buf, &rmsg));
+	});
+}
+
+static void bench_crypto() {
+	std::vector<unsigned char> server_pk(crypto_box_PUBLICKEYBYTES), server_sk(crypto_box_SECRETKEYBYTES);
+	std::vector<unsigned char> client_pk(crypto_box_PUBLICKEYBYTES), client_sk(crypto_box_SECRETKEYBYTES);
+	crypto_box_keypair(server_pk.data(), server_sk.data());
+	crypto_box_keypair(client_pk.data(), client_sk.data());
+
+	const std::string text = convert_message2string(sample_message(AUTOCONN::JOIN, 1), sizeof(message_t));
+	const std::vector<unsigned char> plain(text.begin(), text.end());
+	std::vector<unsigned char> sealed = sodium_ae::encrypt_message(plain, server_pk, client_sk);
+
+	run("crypto/encrypt_message", [&] {
+		keep(sodium_ae::encrypt_message(plain, server_pk, client_sk));
+	});
+
+	run("crypto/decrypt_message", [&] {
+		bool failure = false;
+		keep(sodium_ae::decrypt_message(sealed, client_pk, server_sk, failure));
+	});
+
+	char base64[WG_KEY_LEN_BASE64];
+	key_to_base64(base64, server_pk.data());
+	run("crypto/key_from_base64", [&] {
+		uint8_t key[WG_KEY_LEN];
+		keep(key_from_base64(key, base64));
+	});
+}
+
+static void bench_vip_pool() {
+	for (int pool : {16, 64, 253}) {
+		if (!load_settings(pool)) {
+			spdlog::error("Can't load the benchmark settings.");
+			return;
+		}
+		VipTable table;
+		table.initialize_viptable();
+
+		/* all but one address handed out: add/remove keeps cycling the last one */
+		for (int i = 1; i < pool; i++) {
+			table.add_address_binding(sample_message(AUTOCONN::HELLO, i));
+		}
+		const message_t probe = sample_message(AUTOCONN::HELLO, 0);
+		const message_t bound = sample_message(AUTOCONN::HELLO, pool / 2);
+		const std::string suffix = "/pool:" + std::to_string(pool);
+
+		run("vip_pool/search" + suffix, [&] {
+			keep(table.search_address_binding(bound));
+		});
+		run("vip_pool/add_remove" + suffix, [&] {
+			keep(table.add_address_binding(probe));
+			keep(table.remove_address_binding(probe));
+		});
+	}
+}
+
+static void bench_peer_table() {
+	wgacsPtr = std::make_unique<WgacServer>();
+
+	for (uint32_t peers : {100u, 1000u, 10000u}) {
+		for (uint32_t i = 1; i <= peers; i++) {
+			wgacsPtr->add_peer_table(sample_message(AUTOCONN::HELLO, i));
+		}
+		const message_t probe = sample_message(AUTOCONN::HELLO, 0);
+		const message_t bound = sample_message(AUTOCONN::HELLO, peers / 2);
+		const std::string suffix = "/peers:" + std::to_string(peers);
+
+		run("peer_table/get" + suffix, [&] {
+			keep(wgacsPtr->get_peer_table(bound));
+		});
+		run("peer_table/update" + suffix, [&] {
+			keep(wgacsPtr->update_peer_table(bound));
+		});
+		run("peer_table/add_remove" + suffix, [&] {
+			keep(wgacsPtr->add_peer_table(probe));
+			keep(wgacsPtr->remove_peer_table(probe));
+		});
+
+		for (uint32_t i = 1; i <= peers; i++) {
+			wgacsPtr->remove_peer_table(sample_message(AUTOCONN::HELLO, i));
+		}
+	}
+}
+
+static void print_json() {
+	printf("{\n  \"benchmark\": \"wgac_bench\",\n  \"min_time_ms\": %.0f,\n"
+			"  \"alloc_stats\": %s,\n  \"redis\": %s,\n  \"results\": [",
+			min_time_ns / 1e6, alloc_stats::enabled ? "true" : "false",
+#ifdef REDIS
+			"true"
+#else
+			"false"
+#endif
+			);
+	for (size_t i = 0; i < results.size(); i++) {
+		const bench_result_t& r = results[i];
+		printf("%s\n    {\"name\": \"%s\", \"iterations\": %lu, \"ns_per_op\": %.1f, \"min_ns_per_op\": %.1f, "
+				"\"ops_per_sec\": %.0f, ", i ? "," : "", r.name.c_str(), r.iterations,
+				r.ns_per_op, r.min_ns_per_op, 1e9 / r.ns_per_op);
+		if (alloc_stats::enabled) {
+			printf("\"allocs_per_op\": %.2f, \"bytes_per_op\": %.1f}", r.allocs_per_op, r.bytes_per_op);
+		} else {
+			printf("\"allocs_per_op\": null, \"bytes_per_op\": null}");
+		}
+	}
+	printf("\n  ]\n}\n");
+}
+
+int main(int argc, char* argv[]) {
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		if (arg == "--filter" && i + 1 < argc) {
+			filter = argv[++i];
+		} else if (arg == "--min-time-ms" && i + 1 < argc) {
+			min_time_ns = std::stod(argv[++i]) * 1e6;
+		} else if (arg == "--list") {
+			list_only = true;
+		} else {
+			fprintf(stderr, "usage: %s [--filter <substring>] [--min-time-ms <ms>] [--list]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* stdout carries the JSON only */
+	spdlog::set_level(spdlog::level::off);
+	sodium_ae::initialize_sodium();
+	if (!load_settings(253)) {
+		fprintf(stderr, "Can't load the benchmark settings.\n");
+		return EXIT_FAILURE;
+	}
+
+	bench_codec();
+	bench_crypto();
+	bench_vip_pool();
+	bench_peer_table();
+
+	if (!list_only) {
+		print_json();
+	}
+	return EXIT_SUCCESS;
+}
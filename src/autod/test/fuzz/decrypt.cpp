@@ -0,0 +1,48 @@
+/*
+ * Fuzz harness: sodium_ae::decrypt_message()
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * The input is one received buffer, decrypted with the fixed keys of
+ * fuzz.h(the seed frames are valid). A frame that decrypts yields exactly
+ * its plaintext, a failure yields nothing. The input is also sealed as a
+ * plaintext and must come back unchanged.
+ */
+
+#include <vector>
+#include "fuzz.h"
+#include "../../inc/server.h"
+#include "../../inc/common.h"
+#include "../../inc/sodium_ae.h"
+#include "spdlog/spdlog.h"
+
+std::unique_ptr<WgacServer> wgacsPtr;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	static const bool quiet = (spdlog::set_level(spdlog::level::off), true);
+	(void)quiet;
+	static const fuzz_keys_t keys;
+
+	std::vector<unsigned char> received(data, data + size);
+	bool decrypt_failure = false;
+	std::vector<unsigned char> plain = sodium_ae::decrypt_message(
+			received, keys.client_pk, keys.server_sk, decrypt_failure);
+	if (decrypt_failure) {
+		FUZZ_CHECK(plain.empty());
+	} else {
+		bool bad_frame = false;
+		const size_t frame_len = sodium_ae::frame_size(received.data(), received.size(), bad_frame);
+		FUZZ_CHECK(!bad_frame && frame_len > 0);
+		FUZZ_CHECK(plain.size() == frame_len - sizeof(uint32_t) - crypto_box_NONCEBYTES - crypto_box_MACBYTES);
+	}
+
+	/* round trip: anything that fits a frame */
+	if (size + crypto_box_NONCEBYTES + crypto_box_MACBYTES <= MAX_PACKET_SIZE) {
+		std::vector<unsigned char> sealed = sodium_ae::encrypt_message(received, keys.server_pk, keys.client_sk);
+		decrypt_failure = false;
+		FUZZ_CHECK(sodium_ae::decrypt_message(sealed, keys.client_pk, keys.server_sk, decrypt_failure) == received);
+		FUZZ_CHECK(!decrypt_failure);
+	}
+	return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Fuzz harness: length-prefix framing of the encrypted stream
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * The input is one byte of chunk size and the bytes of a connection. The
+ * stream is fed in chunks of that size and cut into frames with
+ * sodium_ae::next_frame() as WgacClient::nextMessage() does, every frame is
+ * decrypted and parsed. The frames cut must not depend on the chunking.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "fuzz.h"
+#include "../../inc/server.h"
+#include "../../inc/parser.h"
+#include "../../inc/sodium_ae.h"
+#include "spdlog/spdlog.h"
+
+std::unique_ptr<WgacServer> wgacsPtr;
+
+/* the sizes of the frames cut out of the stream, -1 for a bad frame */
+static std::vector<long> cut(const uint8_t* data, size_t size, size_t chunk) {
+	static const fuzz_keys_t keys;
+	std::vector<long> frames;
+	std::vector<unsigned char> rbuf;
+
+	for (size_t off = 0; off < size; off += chunk) {
+		rbuf.insert(rbuf.end(), data + off, data + std::min(size, off + chunk));
+		while (!rbuf.empty()) {
+			bool bad_frame = false;
+			const size_t buffered = rbuf.size();
+			std::vector<unsigned char> encrypted_message;
+			if (!sodium_ae::next_frame(rbuf, encrypted_message, bad_frame)) {
+				if (bad_frame) {
+					frames.push_back(-1);
+					return frames;             /* the connection is dropped */
+				}
+				FUZZ_CHECK(rbuf.size() == buffered);
+				break;
+			}
+			const size_t frame_len = encrypted_message.size();
+			FUZZ_CHECK(rbuf.size() == buffered - frame_len);
+			FUZZ_CHECK(frame_len >= sizeof(uint32_t) + crypto_box_NONCEBYTES + crypto_box_MACBYTES);
+			frames.push_back(frame_len);
+
+			bool decrypt_failure = false;
+			std::vector<unsigned char> decrypted_message = sodium_ae::decrypt_message(
+					encrypted_message, keys.client_pk, keys.server_sk, decrypt_failure);
+			if (decrypt_failure) {
+				continue;
+			}
+			std::string xbuf(decrypted_message.begin(), decrypted_message.end());
+			message_t rmsg {};
+			parser::parse_new_message_string(xbuf.data(), &rmsg);
+		}
+	}
+	return frames;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	static const bool quiet = (spdlog::set_level(spdlog::level::off), true);
+	(void)quiet;
+	if (size < 1) {
+		return 0;
+	}
+
+	const size_t chunk = data[0] ? data[0] : 1;
+	FUZZ_CHECK(cut(data + 1, size - 1, chunk) == cut(data + 1, size - 1, size));
+	return 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <sodium.h>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+/*
+ * Keypairs of a client and the server derived from fixed seeds, so the
+ * encrypted frames of the seed corpora(client -> server) stay decryptable.
+ */
+struct fuzz_keys {
+	std::vector<unsigned char> client_pk, client_sk, server_pk, server_sk;
+
+	fuzz_keys() : client_pk(crypto_box_PUBLICKEYBYTES), client_sk(crypto_box_SECRETKEYBYTES),
+			server_pk(crypto_box_PUBLICKEYBYTES), server_sk(crypto_box_SECRETKEYBYTES) {
+		unsigned char seed[crypto_box_SEEDBYTES];
+		if (sodium_init() < 0) {
+			__builtin_trap();
+		}
+		std::fill(seed, seed + sizeof(seed), 'c');
+		crypto_box_seed_keypair(client_pk.data(), client_sk.data(), seed);
+		std::fill(seed, seed + sizeof(seed), 's');
+		crypto_box_seed_keypair(server_pk.data(), server_sk.data(), seed);
+	}
+};
+
+using fuzz_keys_t = struct fuzz_keys;
+
+/* a broken invariant: libFuzzer and AFL keep the input as a crash */
+#define FUZZ_CHECK(cond)    do { if (!(cond)) __builtin_trap(); } while (0)
@@ -0,0 +1,36 @@
+/*
+ * Fuzz harness: message parser
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * The input is the text of one decrypted message, NUL-terminated as the
+ * server hands it to parse_new_message_string().
+ */
+
+#include <cstring>
+#include <vector>
+#include "fuzz.h"
+#include "../../inc/server.h"
+#include "../../inc/parser.h"
+#include "spdlog/spdlog.h"
+
+std::unique_ptr<WgacServer> wgacsPtr;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	static const bool quiet = (spdlog::set_level(spdlog::level::off), true);
+	(void)quiet;
+
+	std::vector<char> text(data, data + size);
+	text.push_back('\0');
+
+	message_t rmsg {};
+	uint32_t retry_after = 0;
+	if (parser::parse_new_message_string(text.data(), &rmsg, &retry_after)) {
+		/* the strings of an accepted message are terminated within their fields */
+		FUZZ_CHECK(memchr(rmsg.public_key, '\0', sizeof(rmsg.public_key)) != nullptr);
+		FUZZ_CHECK(memchr(rmsg.allowed_ips, '\0', sizeof(rmsg.allowed_ips)) != nullptr);
+		FUZZ_CHECK(retry_after <= UINT16_MAX);
+	}
+	return 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * Fuzz harness driver without libFuzzer
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * usage: wgac_fuzz_<harness> [-flags] <file or corpus directory>...
+ *
+ * Runs every input file once through the harness: the corpus regression
+ * tests with gcc, and AFL(afl-fuzz ... -- wgac_fuzz_<harness> @@).
+ * libFuzzer style -flags are ignored, so the same command line works for
+ * both builds.
+ */
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "fuzz.h"
+
+static bool replay(const std::filesystem::path& path) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		fprintf(stderr, "Can't read %s\n", path.c_str());
+		return false;
+	}
+	const std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	LLVMFuzzerTestOneInput(data.data(), data.size());
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	size_t inputs = 0;
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] == '-') {
+			continue;
+		}
+		std::error_code ec;
+		if (std::filesystem::is_directory(argv[i], ec)) {
+			for (const auto& entry : std::filesystem::directory_iterator(argv[i])) {
+				if (entry.is_regular_file()) {
+					if (!replay(entry.path())) return EXIT_FAILURE;
+					inputs++;
+				}
+			}
+		} else {
+			if (!replay(argv[i])) return EXIT_FAILURE;
+			inputs++;
+		}
+	}
+	printf("%zu inputs replayed\n", inputs);
+	return inputs > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,257 @@
+#!/usr/bin/env python3
+#
+# End-to-end performance suite: wg_autod(fake backends) against wg_autoc_loadgen
+# Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+#
+# SPDX-License-Identifier: MIT
+#
+# usage: perf.py --autod <wg_autod> --loadgen <wg_autoc_loadgen> --baseline <perf_baseline.json>
+#                [--scenario <name>] [--repeat N] [--port P] [--update] [--json <file>]
+#
+# Every scenario starts a fresh server on loopback with the in-memory
+# wireguard/redis backends(no root needed), runs the load generator against
+# it and samples the server's /proc status for the peak RSS(VmHWM) and the
+# peak thread count. Every session must succeed. The throughput, the p99 of
+# the scenario's stage, the peak RSS and the threads are compared with the
+# baseline, and a metric worse than its threshold fails the run(exit status 1).
+# --repeat keeps the best of N runs against a noisy box, --update rewrites the
+# measured values into the baseline after a deliberate change or on a new
+# reference machine. ctest runs it(ctest -L perf) only in a build configured
+# with -DWGAC_PERF=ON, the baseline holds for the machine it was measured on.
+#
+
+import argparse
+import json
+import os
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+# name: loadgen arguments, the throughput and the latency(p99 of a stage) to compare
+SCENARIOS = {
+    # a restarted server hit by its fleet: key exchange, HELLO, one PING and BYE per session
+    "connect_storm": {
+        "args": ["--sessions", "2000", "--concurrency", "200", "--threads", "2"],
+        "throughput": "handshakes_per_sec",
+        "stage": "hello",
+    },
+    # sessions kept open with keepalives
+    "ping_churn": {
+        "args": ["--sessions", "200", "--concurrency", "100", "--pings", "50", "--think-ms", "2",
+                 "--threads", "2"],
+        "throughput": "pings_per_sec",
+        "stage": "ping",
+    },
+    # the whole fleet leaving at once: every BYE held until the same instant
+    "mass_bye": {
+        "args": ["--sessions", "200", "--concurrency", "200", "--bye-at-ms", "1500", "--threads", "2"],
+        "throughput": None,
+        "stage": "bye",
+    },
+}
+
+SERVER_CONF = """\
+debug_mode = 0
+server_port = {port}
+this_vpn_ip = 10.1.1.254
+this_vpn_netmask = 255.255.255.0
+this_public_key = "Fuj6ODu9nLkCtxzueHh3AB4CRakbX6PkzbFW8T0smAA="
+this_endpoint_ip = 127.0.0.1
+this_endpoint_port = 51820
+this_allowed_ips = "10.1.1.0/24"
+vpnip_range_begin = 10.1.1.1
+vpnip_range_end = 10.1.1.253
+control_socket = {dir}/ctl.sock
+status_shm_path = ""
+trace_dump_path = {dir}/trace.json
+wireguard_backend = fake
+redis_backend = fake
+fake_wireguard_latency_us = 200
+fake_redis_latency_us = 50
+"""
+
+
+def proc_status(pid):
+    """VmHWM(kB) and Threads of a running process, None once it is gone"""
+    try:
+        with open("/proc/%d/status" % pid) as f:
+            fields = dict(line.split(":", 1) for line in f if ":" in line)
+        return int(fields["VmHWM"].split()[0]), int(fields["Threads"])
+    except (OSError, KeyError, ValueError):
+        return None
+
+
+class Server:
+    """wg_autod in the foreground, its status sampled every 10 ms"""
+
+    def __init__(self, autod, port, workdir):
+        self.conf = os.path.join(workdir, "server.conf")
+        with open(self.conf, "w") as f:
+            f.write(SERVER_CONF.format(port=port, dir=workdir))
+        self.log = open(os.path.join(workdir, "server.log"), "w")
+        self.proc = subprocess.Popen([autod, "--foreground", "--config", self.conf],
+                                     stdout=self.log, stderr=subprocess.STDOUT)
+        self.port = port
+        self.peak_rss_kb = 0
+        self.threads = 0
+        self._done = threading.Event()
+        self._sampler = threading.Thread(target=self._sample, daemon=True)
+        self._sampler.start()
+
+    def _sample(self):
+        while not self._done.is_set():
+            status = proc_status(self.proc.pid)
+            if status:
+                self.peak_rss_kb = max(self.peak_rss_kb, status[0])
+                self.threads = max(self.threads, status[1])
+            self._done.wait(0.01)
+
+    def wait_ready(self, timeout_s=10):
+        deadline = time.monotonic() + timeout_s
+        while time.monotonic() < deadline:
+            if self.proc.poll() is not None:
+                return False
+            try:
+                socket.create_connection(("127.0.0.1", self.port), timeout=0.2).close()
+                return True
+            except OSError:
+                time.sleep(0.05)
+        return False
+
+    def stop(self):
+        status = proc_status(self.proc.pid)
+        if status:
+            self.peak_rss_kb = max(self.peak_rss_kb, status[0])
+        self._done.set()
+        self._sampler.join()
+        self.proc.send_signal(signal.SIGTERM)
+        try:
+            self.proc.wait(timeout=10)
+        except subprocess.TimeoutExpired:
+            self.proc.kill()
+            self.proc.wait()
+        self.log.close()
+
+
+def run_scenario(opts, name, scenario):
+    """One run on a fresh server: the metrics, or None and the reason"""
+    with tempfile.TemporaryDirectory(prefix="wgac_perf.") as workdir:
+        server = Server(opts.autod, opts.port, workdir)
+        try:
+            if not server.wait_ready():
+                return None, "wg_autod did not come up(see its log below)\n" + \
+                    open(os.path.join(workdir, "server.log")).read()[-2000:]
+            loadgen = subprocess.run([opts.loadgen, "--port", str(opts.port), "--json"] + scenario["args"],
+                                     stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True, timeout=240)
+        finally:
+            server.stop()
+
+    try:
+        report = json.loads(loadgen.stdout)
+    except ValueError:
+        return None, "no report from wg_autoc_loadgen: " + loadgen.stderr.strip()
+    if report["failed"] > 0:
+        noks = sum(stage["nok"] for stage_name, stage in report["stages"].items() if stage_name != "session")
+        return None, "%d of %d sessions failed(%d NOK, %d lost)" % (
+            report["failed"], report["sessions"], noks, report["failed"] - noks)
+
+    metrics = {}
+    if scenario["throughput"]:
+        metrics[scenario["throughput"]] = report[scenario["throughput"]]
+    metrics["p99_ms"] = report["stages"][scenario["stage"]]["p99_ms"]
+    metrics["peak_rss_kb"] = server.peak_rss_kb
+    metrics["threads"] = server.threads
+    return metrics, None
+
+
+def best_of(runs):
+    """the best value of every metric over the runs: highest rate, lowest everything else"""
+    best = dict(runs[0])
+    for metrics in runs[1:]:
+        for key, value in metrics.items():
+            best[key] = max(best[key], value) if key.endswith("_per_sec") else min(best[key], value)
+    return best
+
+
+def compare(name, metrics, baseline):
+    """rows of(metric, baseline, measured, change, verdict) and whether all of them pass"""
+    rows, passed = [], True
+    base = baseline["scenarios"].get(name)
+    for key, value in metrics.items():
+        if base is None or key not in base:
+            rows.append((key, None, value, None, "new"))
+            continue
+        ref = base[key]
+        kind = "throughput" if key.endswith("_per_sec") else key
+        threshold = baseline["thresholds"][kind]
+        slack = baseline["slack"].get(kind, 0)
+        change = (value - ref) / ref if ref else 0.0
+        if key.endswith("_per_sec"):
+            regressed = value < ref * (1 - threshold)
+            improved = value > ref * (1 + threshold)
+        else:
+            regressed = value > ref * (1 + threshold) + slack
+            improved = value < ref * (1 - threshold) - slack
+        verdict = "REGRESSED" if regressed else "improved" if improved else "ok"
+        passed = passed and not regressed
+        rows.append((key, ref, value, change, verdict))
+    return rows, passed
+
+
+def main():
+    parser = argparse.ArgumentParser(description="wg_autod end-to-end performance suite")
+    parser.add_argument("--autod", required=True, help="wg_autod binary")
+    parser.add_argument("--loadgen", required=True, help="wg_autoc_loadgen binary")
+    parser.add_argument("--baseline", required=True, help="baseline JSON")
+    parser.add_argument("--scenario", action="append", choices=sorted(SCENARIOS), help="run this one only")
+    parser.add_argument("--repeat", type=int, default=1, help="runs per scenario, the best one counts")
+    parser.add_argument("--port", type=int, default=51899, help="server port(default 51899)")
+    parser.add_argument("--update", action="store_true", help="write the measured values into the baseline")
+    parser.add_argument("--json", help="also write the measured values to this file")
+    opts = parser.parse_args()
+
+    with open(opts.baseline) as f:
+        baseline = json.load(f)
+
+    names = opts.scenario or list(SCENARIOS)
+    measured, passed = {}, True
+    for name in names:
+        runs = []
+        for _ in range(max(opts.repeat, 1)):
+            metrics, error = run_scenario(opts, name, SCENARIOS[name])
+            if error:
+                print("%-14s FAILED: %s" % (name, error))
+                passed = False
+                break
+            runs.append(metrics)
+        if len(runs) < max(opts.repeat, 1):
+            continue
+        measured[name] = best_of(runs)
+
+        rows, ok = compare(name, measured[name], baseline)
+        passed = passed and ok
+        for key, ref, value, change, verdict in rows:
+            print("%-14s %-20s %12s %12.1f %8s  %s" % (
+                name, key, "-" if ref is None else "%.1f" % ref, value,
+                "-" if change is None else "%+.0f%%" % (change * 100), verdict))
+
+    if opts.json:
+        with open(opts.json, "w") as f:
+            json.dump({"scenarios": measured}, f, indent=2)
+            f.write("\n")
+    if opts.update:
+        baseline["scenarios"].update(measured)
+        with open(opts.baseline, "w") as f:
+            json.dump(baseline, f, indent=2)
+            f.write("\n")
+        print("baseline %s updated" % opts.baseline)
+        return 0
+    return 0 if passed else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
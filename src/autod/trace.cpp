@@ -0,0 +1,282 @@
+/*
+ * Per-session span rings of the server and their chrome trace-event export
+ * Copyright (c) 2026 Chunghan Yi <chunghan.yi@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <atomic>
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <cinttypes>
+#include <unistd.h>
+#include <fcntl.h>
+#include "inc/trace.h"
+#include "spdlog/spdlog.h"
+
+namespace trace
+{
+using steady_clock = std::chrono::steady_clock;
+
+struct SpanRecord {
+	const char* name;
+	uint64_t session;
+	int64_t start_ns;                        // since the process start
+	int64_t end_ns;
+	uint64_t arg;
+};
+
+/* spans of one thread: written by that thread only, copied by dumps */
+struct Ring {
+	std::vector<SpanRecord> spans;
+	std::atomic<uint64_t> head {0};          // spans written so far
+	std::atomic<bool> inUse {true};
+	uint32_t tid = 0;                        // track of the ring in the dump
+	std::string name;                        // protected by the registry mutex
+};
+
+static thread_local uint64_t current_session = 0;
+
+class TraceRegistry {
+public:
+	~TraceRegistry() { stop(); }
+
+	void start(size_t ringSize, const std::string& path);
+	void stop();
+	bool enabled() const { return _ringSize.load(std::memory_order_relaxed) > 0; }
+	uint64_t newSession() { return _sessions.fetch_add(1, std::memory_order_relaxed) + 1; }
+	void setThreadName(const std::string& name);
+	void record(const char* name, uint64_t session, steady_clock::time_point start,
+			steady_clock::time_point end, uint64_t arg);
+	long dump(const std::string& path);
+	long dump() { return dump(_path); }
+	void requestDump();
+
+private:
+	Ring* ring();
+	void dumpTask();
+
+	const steady_clock::time_point _base = steady_clock::now();
+	std::atomic<size_t> _ringSize {0};       /* 0: tracing off */
+	std::atomic<uint64_t> _sessions {0};
+	std::mutex _mtx;                         /* protects _rings, Ring::name */
+	std::vector<Ring*> _rings;               /* never freed: a ring outlives its thread */
+
+	std::string _path;
+	std::thread _thread;
+	int _pipefd[2] = {-1, -1};
+};
+
+void TraceRegistry::start(size_t ringSize, const std::string& path) {
+	_path = path;
+	_ringSize = ringSize;
+	if (ringSize == 0 || _thread.joinable()) {
+		return;
+	}
+	if (pipe2(_pipefd, O_CLOEXEC) < 0) {
+		spdlog::warn("Trace dumps on SIGUSR2 are not available: {}", strerror(errno));
+		return;
+	}
+	_thread = std::thread(&TraceRegistry::dumpTask, this);
+}
+
+void TraceRegistry::stop() {
+	_ringSize = 0;
+	if (_pipefd[1] >= 0) {
+		::close(_pipefd[1]);   /* read() returns 0: the dump thread exits */
+		_pipefd[1] = -1;
+	}
+	if (_thread.joinable()) {
+		_thread.join();
+	}
+	if (_pipefd[0] >= 0) {
+		::close(_pipefd[0]);
+		_pipefd[0] = -1;
+	}
+}
+
+/**
+ * Ring of the calling thread. A ring of an exited thread is taken over with
+ * its spans, they are overwritten as the new owner records.
+ */
+Ring* TraceRegistry::ring() {
+	struct RingRef {
+		Ring* ring = nullptr;
+		~RingRef() {
+			if (ring) ring->inUse.store(false, std::memory_order_release);
+		}
+	};
+	thread_local RingRef ref;
+
+	if (ref.ring == nullptr) {
+		std::lock_guard<std::mutex> lock(_mtx);
+		for (Ring* r : _rings) {
+			bool expected = false;
+			if (r->inUse.compare_exchange_strong(expected, true)) {
+				ref.ring = r;
+				break;
+			}
+		}
+		if (ref.ring == nullptr) {
+			ref.ring = new Ring();
+			ref.ring->spans.resize(_ringSize.load());
+			ref.ring->tid = _rings.size() + 1;
+			_rings.push_back(ref.ring);
+		}
+		ref.ring->name = "thread " + std::to_string(ref.ring->tid);
+	}
+	return ref.ring;
+}
+
+void TraceRegistry::setThreadName(const std::string& name) {
+	if (!enabled()) {
+		return;
+	}
+	Ring* r = ring();
+	std::lock_guard<std::mutex> lock(_mtx);
+	r->name = name;
+}
+
+void TraceRegistry::record(const char* name, uint64_t session, steady_clock::time_point start,
+		steady_clock::time_point end, uint64_t arg) {
+	if (!enabled()) {
+		return;
+	}
+	Ring* r = ring();
+	const uint64_t head = r->head.load(std::memory_order_relaxed);
+	SpanRecord& span = r->spans[head % r->spans.size()];
+	span.name = name;
+	span.session = session;
+	span.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(start - _base).count();
+	span.end_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - _base).count();
+	span.arg = arg;
+	r->head.store(head + 1, std::memory_order_release);
+}
+
+static void write_event(std::ofstream& out, bool& first, const SpanRecord& span, uint32_t tid, int pid) {
+	char buf[320];
+	snprintf(buf, sizeof(buf),
+			"%s{\"name\":\"%s\",\"cat\":\"wgac\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+			"\"pid\":%d,\"tid\":%u,\"args\":{\"session\":%" PRIu64 ",\"arg\":%" PRIu64 "}}",
+			first ? "" : ",\n", span.name, span.start_ns / 1e3,
+			std::max<int64_t>(span.end_ns - span.start_ns, 0) / 1e3,
+			pid, tid, span.session, span.arg);
+	out << buf;
+	first = false;
+}
+
+/**
+ * Write all rings as chrome trace events. Spans the owner overwrote while
+ * they were copied are left out.
+ */
+long TraceRegistry::dump(const std::string& path) {
+	std::vector<std::pair<Ring*, std::string>> rings;
+	{
+		std::lock_guard<std::mutex> lock(_mtx);
+		for (Ring* r : _rings) {
+			rings.emplace_back(r, r->name);
+		}
+	}
+
+	std::ofstream out(path, std::ios::trunc);
+	if (!out) {
+		spdlog::warn("Can't write the trace to {}.", path);
+		return -1;
+	}
+
+	const int pid = getpid();
+	long count = 0;
+	bool first = true;
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	for (const auto& [r, name] : rings) {
+		const size_t size = r->spans.size();
+		const uint64_t head = r->head.load(std::memory_order_acquire);
+		const uint64_t from = head > size ? head - size : 0;
+		std::vector<SpanRecord> spans;
+		for (uint64_t i = from; i < head; i++) {
+			spans.push_back(r->spans[i % size]);
+		}
+		/* the owner may be writing span 'after' right now: its slot(after - size) is left out too */
+		std::atomic_thread_fence(std::memory_order_acquire);
+		const uint64_t after = r->head.load(std::memory_order_relaxed);
+		const uint64_t valid = after + 1 > size ? after + 1 - size : 0;
+
+		char meta[200];
+		snprintf(meta, sizeof(meta), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+				"\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", pid, r->tid, name.c_str());
+		out << meta;
+		first = false;
+		for (uint64_t i = std::max(from, valid); i < head; i++) {
+			write_event(out, first, spans[i - from], r->tid, pid);
+			count++;
+		}
+	}
+	out << "\n]}\n";
+	out.close();
+
+	spdlog::info("--- {} trace spans are written to {}.", count, path);
+	return count;
+}
+
+void TraceRegistry::requestDump() {
+	if (_pipefd[1] >= 0) {
+		const char c = 'D';
+		[[maybe_unused]] ssize_t n = write(_pipefd[1], &c, 1);
+	}
+}
+
+void TraceRegistry::dumpTask() {
+	char c;
+	while (read(_pipefd[0], &c, 1) > 0) {
+		dump();
+	}
+}
+
+static TraceRegistry registry;
+
+void start(size_t ringSize, const std::string& path) {
+	registry.start(ringSize, path);
+}
+
+void stop() {
+	registry.stop();
+}
+
+bool enabled() {
+	return registry.enabled();
+}
+
+uint64_t newSession() {
+	return registry.newSession();
+}
+
+void setSession(uint64_t session) {
+	current_session = session;
+}
+
+uint64_t currentSession() {
+	return current_session;
+}
+
+void setThreadName(const std::string& name) {
+	registry.setThreadName(name);
+}
+
+void record(const char* name, uint64_t session, std::chrono::steady_clock::time_point start,
+		std::chrono::steady_clock::time_point end, uint64_t arg) {
+	registry.record(name, session, start, end, arg);
+}
+
+long dump() {
+	return registry.dump();
+}
+
+void requestDump() {
+	registry.requestDump();
+}
+
+}
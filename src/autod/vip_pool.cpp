@@ -12,9 +12,12 @@
 #include <stdexcept>
 #include <vector>
 #include <map>
+#include <algorithm>
 #include "inc/server.h"
 #include "inc/common.h"
 #include "inc/vip_pool.h"
+#include "inc/settings.h"
+#include "inc/probes.h"
 #include "spdlog/spdlog.h"
 
 //#define DEBUG
@@ -57,61 +60,86 @@ std::vector<uint8_t> VipTable::parse_ipv4_address(const std::string& ip_address)
 }
 
 /**
- * Initialize vip-pool-table(vector table)
+ * Initialize vip-pool-table(vector table) from vpnip_range_begin/end.
+ * Called again after a config reload: addresses in use stay bound.
+ * Slot i is host address i+1, slots below the pool are never handed out.
  */
 bool VipTable::initialize_viptable() {
-	vip_entry_t v {};
-	std::string ip_address = wgacsPtr->getConfig().getstr("vpnip_range_begin");
-	if (inet_pton(AF_INET, ip_address.c_str(), &(v.vpnIP)) <= 0) {
+	const server_settings_t& conf = settings::get();
+	std::vector<uint8_t> begin_array, byte_array;
+	try {
+		begin_array = parse_ipv4_address(inet_ntoa(conf.vpnip_range_begin));
+		byte_array = parse_ipv4_address(inet_ntoa(conf.vpnip_range_end));
+	} catch (const std::exception& e) {
+		spdlog::warn("Invalid vpn ip range: {}", e.what());
 		return false;
 	}
-	std::vector<uint8_t> byte_array = parse_ipv4_address(ip_address);
 #ifdef DEBUG
 	spdlog::debug("### begin/byte_array => {}.{}.{}.{}",
+			begin_array[0], begin_array[1], begin_array[2], begin_array[3]);
+	spdlog::debug("### end/byte_array => {}.{}.{}.{}",
 			byte_array[0], byte_array[1], byte_array[2], byte_array[3]);
 #endif
-	_vip_pool_index.first = static_cast<uint32_t>(byte_array[3]);
-	_vip_pool_index.first -= 1;  /* not 10.1.0.0 but 10.1.0.1 */
-
-	ip_address = wgacsPtr->getConfig().getstr("vpnip_range_end");
-	if (inet_pton(AF_INET, ip_address.c_str(), &(v.vpnIP)) <= 0) {
+	if (begin_array[3] == 0 || byte_array[3] == 0) {
+		spdlog::warn("Oops, vpn ip range must not start or end with .0 !!!");
 		return false;
 	}
-	byte_array = parse_ipv4_address(ip_address);
-#ifdef DEBUG
-	spdlog::debug("### end/byte_array => {}.{}.{}.{}",
-			byte_array[0], byte_array[1], byte_array[2], byte_array[3]);
-#endif
-	_vip_pool_index.last = static_cast<uint32_t>(byte_array[3]);
-	_vip_pool_index.last -= 1;
-
-	if (_vip_pool_index.first > _vip_pool_index.last) {
+	struct pool_indexes index {};
+	index.first = static_cast<uint32_t>(begin_array[3]) - 1;  /* not 10.1.0.0 but 10.1.0.1 */
+	index.last = static_cast<uint32_t>(byte_array[3]) - 1;
+	if (index.first > index.last) {
 		spdlog::warn("Oops, _vip_pool_index.first > _vip_pool_index.last !!!");
 		return false;
 	}
-	for (int i = _vip_pool_index.first; i <= _vip_pool_index.last; i++) {
+
+	std::vector<vip_entry_t> table;
+	for (uint32_t i = 0; i <= index.last; i++) {
+		vip_entry_t v {};
 		v.vpnIP = byteArrayToIpAddress(i+1, byte_array[2], byte_array[1], byte_array[0]);
-		v.used = false;
+		v.used = (i < index.first);
 		v.index = i;
-		_vip_pool_table.push_back(v);
+		table.push_back(v);
 #ifdef DEBUG
 		struct in_addr xIP;
 		xIP.s_addr = v.vpnIP;
 		spdlog::info("### i:{}, IP:{} pushed into vip pool table", i, inet_ntoa(xIP));
 #endif
 	}
-	_vip_pool_index.current = _vip_pool_index.first;
+	index.current = index.first;
+
+	std::lock_guard<std::mutex> lock(_mtx);
+	for (const auto& old : _vip_pool_table) {
+		if (!old.used || static_cast<uint32_t>(old.index) < _vip_pool_index.first) {
+			continue;
+		}
+		for (auto& v : table) {
+			if (v.vpnIP == old.vpnIP) {
+				v.used = true;
+			}
+		}
+	}
+	_vip_pool_table = std::move(table);
+	_vip_pool_index = index;
 	return true;
 }
 
 /**
  * Get an entry from vip-used-table(map table)
+ * A binding kept after BYE takes its address back while the slot is still free.
  */
 std::shared_ptr<vip_entry_t> VipTable::search_address_binding(const message_t& rmsg) {
 	std::string macstr = common::get_mac_addr_string(rmsg);
+	std::lock_guard<std::mutex> lock(_mtx);
 
 	auto it = _vip_used_table.find(macstr);
 	if (it != _vip_used_table.end()) {
+		if (!it->second || static_cast<uint32_t>(it->second->index) < _vip_pool_index.first ||
+				static_cast<uint32_t>(it->second->index) > _vip_pool_index.last ||
+				_vip_pool_table[it->second->index].vpnIP != it->second->vpnIP) {
+			_vip_used_table.erase(it);  /* pool rebuilt by a config reload */
+			return nullptr;
+		}
+		_vip_pool_table[it->second->index].used = true;
 #ifdef DEBUG
 		struct in_addr xIP;
 		xIP.s_addr = it->second->vpnIP;
@@ -135,14 +163,22 @@ std::shared_ptr<vip_entry_t> VipTable::add_address_binding(const message_t& rmsg
 		return nullptr;
 	}
 
-	while (1) {
-		if (_vip_pool_index.current > _vip_pool_index.last) {
-			tip.reset();  //the object is deleted here and tip becomes null.
-			_vip_pool_index.current = 0;
-			ok_flag = false;
-			spdlog::warn("Oops, _vip_pool_index.current > _vip_pool_index.last !!!");
-			break;
-		} else if (_vip_pool_table[_vip_pool_index.current].used == false) {
+	std::lock_guard<std::mutex> lock(_mtx);
+	/* one round from the cursor: wraps to the first slot, fails only if all are used */
+	const uint32_t slots = _vip_pool_table.empty() ? 0 : _vip_pool_index.last - _vip_pool_index.first + 1;
+	for (uint32_t n = 0; n < slots; n++) {
+		if (_vip_pool_index.current > _vip_pool_index.last || _vip_pool_index.current < _vip_pool_index.first) {
+			_vip_pool_index.current = _vip_pool_index.first;
+		}
+		if (_vip_pool_table[_vip_pool_index.current].used == false) {
+			/* a mac address released this slot earlier: its binding goes with it */
+			for (auto it = _vip_used_table.begin(); it != _vip_used_table.end(); ) {
+				if (it->second && static_cast<uint32_t>(it->second->index) == _vip_pool_index.current) {
+					it = _vip_used_table.erase(it);
+				} else {
+					++it;
+				}
+			}
 			_vip_pool_table[_vip_pool_index.current].used = true;
 			tip->vpnIP = _vip_pool_table[_vip_pool_index.current].vpnIP;
 			tip->used = _vip_pool_table[_vip_pool_index.current].used;
@@ -150,6 +186,7 @@ std::shared_ptr<vip_entry_t> VipTable::add_address_binding(const message_t& rmsg
 			_vip_used_table.insert(std::make_pair(macstr, tip));
 			_vip_pool_index.current++;
 			ok_flag = true;
+			WGAC_PROBE2(vip_alloc, tip->vpnIP, tip->index);
 			break;
 		} else {
 			_vip_pool_index.current++;
@@ -166,20 +203,47 @@ std::shared_ptr<vip_entry_t> VipTable::add_address_binding(const message_t& rmsg
 #endif
 		return tip;
 	} else {
+		spdlog::warn("Oops, vip pool is exhausted({} addresses) !!!", slots);
 		return nullptr;
 	}
 }
 
+/**
+ * Addresses handed out and addresses of the pool
+ */
+void VipTable::get_usage(size_t& used, size_t& size) {
+	std::lock_guard<std::mutex> lock(_mtx);
+	size = _vip_pool_table.empty() ? 0 : _vip_pool_index.last - _vip_pool_index.first + 1;
+	used = std::count_if(_vip_pool_table.begin() + std::min<size_t>(_vip_pool_index.first, _vip_pool_table.size()),
+			_vip_pool_table.end(), [](const vip_entry_t& v) { return v.used; });
+}
+
+/**
+ * Copy a page of the mac -> vpn ip bindings. Returns the number of bindings.
+ */
+size_t VipTable::snapshot_bindings(size_t offset, size_t limit, std::vector<std::pair<std::string, vip_entry_t>>& page) {
+	std::lock_guard<std::mutex> lock(_mtx);
+	if (offset < _vip_used_table.size()) {
+		auto it = std::next(_vip_used_table.begin(), offset);
+		for (; it != _vip_used_table.end() && page.size() < limit; ++it) {
+			page.emplace_back(it->first, *it->second);
+		}
+	}
+	return _vip_used_table.size();
+}
+
 /**
  * Remove an entry from vip-used-table(map table) and update vip pool table(vector table)
  */
 bool VipTable::remove_address_binding(const message_t& rmsg) {
 	std::string macstr = common::get_mac_addr_string(rmsg);
+	std::lock_guard<std::mutex> lock(_mtx);
 
 	auto it = _vip_used_table.find(macstr);
 	if (it != _vip_used_table.end()) {
 		if (it->second) {
-			if (it->second->index <= _vip_pool_index.last)
+			if (static_cast<uint32_t>(it->second->index) <= _vip_pool_index.last &&
+					_vip_pool_table[it->second->index].vpnIP == it->second->vpnIP)
 				_vip_pool_table[it->second->index].used = false;
 #ifdef DEBUG
 			struct in_addr xIP;
@@ -1,6 +1,6 @@
 /*
  * vtysh action routines
- * Copyright (c) 2025 Chunghan Yi <chunghan.yi@gmail.com>
+ * Copyright (c) 2025-2026 Chunghan Yi <chunghan.yi@gmail.com>
  *
  * SPDX-License-Identifier: MIT
  */
@@ -10,10 +10,161 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <chrono>
+#include <memory>
 #include "inc/server.h"
+#include "inc/common.h"
 #include "inc/vtysh.h"
 #include "spdlog/spdlog.h"
 
+#define VTYSH_PATH          "/usr/bin/qrwg/vtysh"
+#define VTYSH_CMDS_PER_EXEC 64
+
+namespace
+{
+
+/*
+ * Collects vtysh commands and runs them with a single
+ * "vtysh -e cmd1 -e cmd2 ..." (posix_spawn, no shell).
+ * "write" rewrites the whole config, so it runs at most once per interval.
+ * The submitter of commands gets the result of the invocation(s) running them.
+ */
+class VtyshBatcher {
+public:
+	~VtyshBatcher() { stop(); }
+
+	void start(std::chrono::milliseconds interval) {
+		std::lock_guard<std::mutex> lock(_mtx);
+		_interval = interval;
+		_stopBatchTask = false;
+		if (!_batchThread) {
+			_batchThread = std::make_unique<std::thread>(&VtyshBatcher::batchTask, this);
+		}
+	}
+
+	/* run what is still pending, including the last write */
+	void stop() {
+		if (_batchThread) {
+			{
+				std::lock_guard<std::mutex> lock(_mtx);
+				_stopBatchTask = true;
+			}
+			_cond.notify_all();
+			if (_batchThread->joinable()) {
+				_batchThread->join();
+			}
+			_batchThread.reset();
+		}
+	}
+
+	/* true once every command ran; a pure write request is not waited for */
+	bool submit(const std::vector<std::string>& cmds, bool write) {
+		std::future<bool> result;
+		bool queued = false;
+		{
+			std::lock_guard<std::mutex> lock(_mtx);
+			if (_batchThread && !_stopBatchTask) {
+				queued = true;
+				_pending.insert(_pending.end(), cmds.begin(), cmds.end());
+				_writePending = _writePending || write;
+				if (!cmds.empty()) {
+					_waiters.emplace_back();
+					result = _waiters.back().get_future();
+				}
+				_cond.notify_one();
+			}
+		}
+		if (!queued) {
+			/* no batcher thread(yet): run it right away */
+			return execute(cmds, write);
+		}
+		return result.valid() ? result.get() : true;
+	}
+
+private:
+	void batchTask() {
+		std::vector<std::string> cmds;
+		std::vector<std::promise<bool>> waiters;
+		std::unique_lock<std::mutex> lock(_mtx);
+
+		while (true) {
+			if (_pending.empty() && !_writePending) {
+				if (_stopBatchTask) break;
+				_cond.wait(lock);
+				continue;
+			}
+
+			const auto now = std::chrono::steady_clock::now();
+			const bool writeDue = _writePending && (_stopBatchTask || now >= _lastWrite + _interval);
+			if (_pending.empty() && !writeDue) {
+				_cond.wait_until(lock, _lastWrite + _interval);
+				continue;
+			}
+
+			cmds.swap(_pending);
+			waiters.swap(_waiters);
+			if (writeDue) {
+				_writePending = false;
+				_lastWrite = now;
+			}
+
+			lock.unlock();
+			const bool ok_flag = execute(cmds, writeDue);
+			for (auto& waiter : waiters) {
+				waiter.set_value(ok_flag);
+			}
+			cmds.clear();
+			waiters.clear();
+			lock.lock();
+		}
+	}
+
+	bool execute(const std::vector<std::string>& cmds, bool write) {
+		bool ok_flag = true;
+		size_t i = 0;
+		do {
+			std::vector<std::string> argv {VTYSH_PATH};
+			for (size_t n = 0; i < cmds.size() && n < VTYSH_CMDS_PER_EXEC; i++, n++) {
+				argv.push_back("-e");
+				argv.push_back(cmds[i]);
+			}
+			if (write && i == cmds.size()) {
+				argv.push_back("-e");
+				argv.push_back("write");
+			}
+			if (argv.size() == 1) break;
+
+			std::string error_text;
+			if (common::spawn(argv, error_text)) {
+				spdlog::debug("--- vtysh: {} argument(s) executed.", argv.size() - 1);
+			} else {
+				spdlog::warn("{}", error_text);
+				ok_flag = false;
+			}
+		} while (i < cmds.size());
+		return ok_flag;
+	}
+
+	std::vector<std::string> _pending;
+	std::vector<std::promise<bool>> _waiters;    // submitters of the pending commands
+	bool _writePending = false;
+	std::chrono::steady_clock::time_point _lastWrite {};
+	std::chrono::milliseconds _interval {1000};
+
+	std::mutex _mtx;
+	std::condition_variable _cond;
+	std::unique_ptr<std::thread> _batchThread;
+	bool _stopBatchTask = false;
+};
+
+VtyshBatcher batcher;
+
+}
+
 namespace vtyshell
 {
 
@@ -75,11 +226,35 @@ bool getIPNetmask(std::string netinfo, char* ipstr, char* netmaskstr) {
 	return true;
 }
 
+void startBatcher(uint32_t writeIntervalMs) {
+	batcher.start(std::chrono::milliseconds(writeIntervalMs));
+}
+
+void stopBatcher() {
+	batcher.stop();
+}
+
+/**
+ * Run one vtysh command(with the other pending ones), false if vtysh failed
+ */
 bool runCommand(const char* buf) {
-	char command[256];
-	sprintf(command, "/usr/bin/qrwg/vtysh -e \"%s\"", buf);
-	std::system(command);
-	return true;
+	return batcher.submit({buf}, false);
+}
+
+/**
+ * Run several vtysh commands at once, so that they share one invocation
+ * (with "write" appended when it is requested and not debounced).
+ * Waits for that invocation, false if vtysh can't be spawned or failed.
+ */
+bool runCommands(const std::vector<std::string>& cmds, bool write) {
+	return batcher.submit(cmds, write);
+}
+
+/**
+ * Ask for a "write"(debounced)
+ */
+void requestWrite() {
+	batcher.submit({}, true);
 }
 
 bool doAction(std::string& s) {
@@ -195,11 +370,9 @@ bool doAction(std::string& s) {
 
 	ok_flag = runCommand(scmd);
 	if (ok_flag) {
-		char command[256];
-		sprintf(command, "/usr/bin/qrwg/vtysh -e \"write\"");
-		std::system(command);
+		requestWrite();
 	}
-	return true;
+	return ok_flag;
 }
 
 }